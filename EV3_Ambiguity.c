@@ -0,0 +1,717 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Offline map ambiguity analysis - see EV3_Ambiguity.h
+
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "EV3_Ambiguity.h"
+
+#define AMB_CHUNK 16384             // States per parallel task
+
+struct refine{
+ int n4;                    // Number of states
+ int horizon;
+ int n_threads;
+ int *succ;                 // succ[(s*4)+a] - macro_move(s,a)
+ int *pred_start, *pred;    // Predecessors of state t are pred[pred_start[t]] up to pred[pred_start[t+1]-1]
+ // The partition - block b holds the states elems[first[b]] up to elems[first[b]+size[b]-1]
+ int *elems, *loc, *cls;
+ int *first, *size;
+ int *tuple;                // tuple[(b*4)+a] - block of the successor under a, the same for all of b's members
+ int *node;                 // Splitting tree node of each block
+ int n_blocks;
+ // One round
+ int *changed, *changed_next;   // States moved to another block by the last round, and by this one
+ int n_changed, n_changed_next;
+ int *affected, n_affected;     // Their predecessors, the states whose tuple may have changed
+ int *atuple;               // The tuples of affected[], taken before anything moves
+ unsigned int *stamp;       // stamp[s]==round - s is already in affected[]
+ unsigned int round;
+ // Affected states grouped by (block, tuple) - open addressing on the hash of both
+ unsigned long long *gkey;
+ int *gid, gcap;
+ int *grep;                 // Per group: an affected[] index with its tuple, its size, where its members go
+ int *gcount, *gstart;
+ int *gnext;                // Next group of the same block, -1 after the last
+ int *gmembers;             // Members, group by group
+ int *agroup;               // Group of each affected state, -1 if its tuple is still its block's
+ int n_groups;
+ int *ghead, *moved;        // Per block: first group and number of members in groups this round
+ unsigned int *bstamp;      // bstamp[b]==round - b has groups this round
+ int *touched, n_touched;
+ // Splitting tree - node 0 is the root, which splits into the P_0 blocks at level 0
+ int *parent, *born, *split;    // born - level the block first appears, split - level its pieces do (-1 never)
+ int *wit_a, *wit_b;            // Two states in different pieces of the block
+ int n_nodes;
+ int *leaf;                 // Tree node of each state's final block
+ struct ambiguity *amb;
+ int *class_node;           // Tree node of each class
+ int failed;
+};
+
+static inline unsigned long long mix64(unsigned long long x)
+{
+ x^=x>>33;
+ x*=0xFF51AFD7ED558CCDULL;
+ x^=x>>33;
+ x*=0xC4CEB9FE1A85EC53ULL;
+ x^=x>>33;
+ return(x);
+}
+
+static void succ_task(int task, int worker, void *arg)
+{
+ struct refine *r=(struct refine *)arg;
+ int end=(task+1)*AMB_CHUNK;
+
+ (void)worker;
+ if (end>r->n4) end=r->n4;
+ for (int s=task*AMB_CHUNK; s<end; s++)
+  for (int a=0; a<N_MOVES; a++)
+   r->succ[(s*4)+a]=macro_move(s,a);
+}
+
+static void tuple_task(int task, int worker, void *arg)
+{
+ struct refine *r=(struct refine *)arg;
+ int end=(task+1)*AMB_CHUNK, s;
+
+ (void)worker;
+ if (end>r->n_affected) end=r->n_affected;
+ for (int i=task*AMB_CHUNK; i<end; i++)
+ {
+  s=r->affected[i];
+  for (int a=0; a<N_MOVES; a++)
+   r->atuple[(i*4)+a]=r->cls[r->succ[(s*4)+a]];
+ }
+}
+
+static int new_node(struct refine *r, int parent, int level)
+{
+ int x=r->n_nodes++;
+
+ r->parent[x]=parent;
+ r->born[x]=level;
+ r->split[x]=-1;
+ r->wit_a[x]=-1;
+ r->wit_b[x]=-1;
+ return(x);
+}
+
+static void group_affected(struct refine *r)
+{
+ // Groups the affected states whose tuple is no longer their block's by (block, tuple)
+ unsigned int mask;
+ int cap=1, s, b, g, *t;
+
+ while (cap<2*r->n_affected) cap*=2;
+ mask=cap-1;
+ memset(r->gkey,0,(size_t)cap*sizeof(unsigned long long));
+ r->n_groups=0;
+ r->n_touched=0;
+ for (int i=0; i<r->n_affected; i++)
+ {
+  unsigned long long h;
+  unsigned int k;
+
+  s=r->affected[i];
+  b=r->cls[s];
+  t=&r->atuple[i*4];
+  if (t[0]==r->tuple[b*4]&&t[1]==r->tuple[(b*4)+1]&&t[2]==r->tuple[(b*4)+2]&&t[3]==r->tuple[(b*4)+3])
+  {
+   r->agroup[i]=-1;
+   continue;
+  }
+  h=mix64((unsigned long long)b+1);
+  for (int a=0; a<N_MOVES; a++)
+   h=mix64(h^((unsigned long long)t[a]+((unsigned long long)(a+1)<<40)));
+  h|=1;
+  k=(unsigned int)(h&mask);
+  for (;;)
+  {
+   if (r->gkey[k]==0)
+   {
+    g=r->n_groups++;
+    r->gkey[k]=h;
+    r->gid[k]=g;
+    r->grep[g]=i;
+    r->gcount[g]=0;
+    if (r->bstamp[b]!=r->round)
+    {
+     r->bstamp[b]=r->round;
+     r->ghead[b]=-1;
+     r->moved[b]=0;
+     r->touched[r->n_touched++]=b;
+    }
+    r->gnext[g]=r->ghead[b];
+    r->ghead[b]=g;
+    break;
+   }
+   if (r->gkey[k]==h)
+   {
+    int *u=&r->atuple[r->grep[r->gid[k]]*4];
+    g=r->gid[k];
+    if (r->cls[r->affected[r->grep[g]]]==b&&u[0]==t[0]&&u[1]==t[1]&&u[2]==t[2]&&u[3]==t[3]) break;
+   }
+   k=(k+1)&mask;
+  }
+  r->gcount[g]++;
+  r->moved[b]++;
+  r->agroup[i]=g;
+ }
+
+ // Members listed group by group
+ s=0;
+ for (g=0; g<r->n_groups; g++)
+ {
+  r->gstart[g]=s;
+  s+=r->gcount[g];
+ }
+ for (int i=0; i<r->n_affected; i++)
+  if (r->agroup[i]>=0) r->gmembers[r->gstart[r->agroup[i]]++]=r->affected[i];
+ for (g=0; g<r->n_groups; g++)
+  r->gstart[g]-=r->gcount[g];
+}
+
+static void move_group(struct refine *r, int b, int g, int parent, int level)
+{
+ // The members of group g leave block b for a new block at the end of b's range, a new
+ // piece of tree node parent
+ int nb=r->n_blocks++, s, j, e;
+
+ for (int k=0; k<r->gcount[g]; k++)
+ {
+  s=r->gmembers[r->gstart[g]+k];
+  j=r->first[b]+r->size[b]-1;
+  e=r->elems[j];
+  r->elems[r->loc[s]]=e;
+  r->loc[e]=r->loc[s];
+  r->elems[j]=s;
+  r->loc[s]=j;
+  r->size[b]--;
+  r->cls[s]=nb;
+  r->changed_next[r->n_changed_next++]=s;
+ }
+ r->first[nb]=r->first[b]+r->size[b];
+ r->size[nb]=r->gcount[g];
+ memcpy(&r->tuple[nb*4],&r->atuple[r->grep[g]*4],4*sizeof(int));
+ r->node[nb]=new_node(r,parent,level);
+}
+
+static int refine_round(struct refine *r, int level)
+{
+ // P_level to P_level+1. Only the predecessors of the states that moved in the last round
+ // can have a different tuple, so only they are looked at; in each block they are grouped
+ // by tuple, and every group but one (those left alone, if any) gets a block of its own.
+ // Returns the number of blocks that split.
+ int n_tasks, splits=0, b, g, stay, x;
+
+ r->round++;
+ if (level==0)
+ {
+  r->n_affected=r->n4;
+  for (int s=0; s<r->n4; s++)
+   r->affected[s]=s;
+ }
+ else
+ {
+  r->n_affected=0;
+  for (int k=0; k<r->n_changed; k++)
+  {
+   int c=r->changed[k];
+   for (int p=r->pred_start[c]; p<r->pred_start[c+1]; p++)
+    if (r->stamp[r->pred[p]]!=r->round)
+    {
+     r->stamp[r->pred[p]]=r->round;
+     r->affected[r->n_affected++]=r->pred[p];
+    }
+  }
+ }
+ r->n_changed_next=0;
+ if (r->n_affected==0) return(0);
+ n_tasks=(r->n_affected+AMB_CHUNK-1)/AMB_CHUNK;
+ run_parallel(n_tasks,r->n_threads,tuple_task,r);
+ group_affected(r);
+
+ for (int k=0; k<r->n_touched; k++)
+ {
+  b=r->touched[k];
+  g=r->ghead[b];
+  if (r->moved[b]==r->size[b]&&r->gnext[g]<0)
+  {
+   // All members moved the same way - same block, new tuple
+   memcpy(&r->tuple[b*4],&r->atuple[r->grep[g]*4],4*sizeof(int));
+   continue;
+  }
+  // The block splits. Its members left alone keep it - or, if there are none, the largest group does.
+  splits++;
+  x=r->node[b];
+  stay=-1;
+  if (r->moved[b]==r->size[b])
+  {
+   stay=g;
+   for (int h=r->gnext[g]; h>=0; h=r->gnext[h])
+    if (r->gcount[h]>r->gcount[stay]) stay=h;
+  }
+  r->node[b]=new_node(r,x,level+1);
+  for (int h=g; h>=0; h=r->gnext[h])
+   if (h!=stay)
+   {
+    move_group(r,b,h,x,level+1);
+    if (r->wit_b[x]<0) r->wit_b[x]=r->elems[r->first[r->n_blocks-1]];
+   }
+  if (stay>=0) memcpy(&r->tuple[b*4],&r->atuple[r->grep[stay]*4],4*sizeof(int));
+  r->split[x]=level+1;
+  r->wit_a[x]=r->elems[r->first[b]];
+ }
+ {
+  int *t=r->changed;
+  r->changed=r->changed_next;
+  r->changed_next=t;
+  r->n_changed=r->n_changed_next;
+ }
+ return(splits);
+}
+
+static int separation_level(const struct refine *r, int u, int v)
+{
+ // Level at which states u and v are first told apart, -1 if never. That is the level the
+ // children below their lowest common ancestor in the splitting tree were born at.
+ int a=r->leaf[u], b=r->leaf[v], last=-1;
+
+ if (a==b) return(-1);
+ while (a!=b)
+ {
+  if (r->born[a]>=r->born[b])
+  {
+   last=r->born[a];
+   a=r->parent[a];
+  }
+  else
+  {
+   last=r->born[b];
+   b=r->parent[b];
+  }
+ }
+ return(last);
+}
+
+static void horizon_task(int task, int worker, void *arg)
+{
+ // Block of each state at the horizon - the tree node on its path alive at that level
+ struct refine *r=(struct refine *)arg;
+ int end=(task+1)*AMB_CHUNK, x;
+
+ (void)worker;
+ if (end>r->n4) end=r->n4;
+ for (int s=task*AMB_CHUNK; s<end; s++)
+ {
+  x=r->leaf[s];
+  while (r->born[x]>r->horizon) x=r->parent[x];
+  r->amb->class_of[s]=x;
+ }
+}
+
+static void sequence_task(int task, int worker, void *arg)
+{
+ // Shortest sequence separating the two witnesses of class task - at every step an action
+ // that takes them to states separated one level earlier
+ struct refine *r=(struct refine *)arg;
+ struct amb_class *c=&r->amb->classes[task];
+ int x=r->class_node[task], u=r->wit_a[x], v=r->wit_b[x], d=c->level, a, u2=0, v2=0;
+ unsigned char *out=r->amb->actions+c->seq;
+
+ (void)worker;
+ for (int k=0; k<c->level; k++)
+ {
+  for (a=0; a<N_MOVES; a++)
+  {
+   u2=r->succ[(u*4)+a];
+   v2=r->succ[(v*4)+a];
+   if (separation_level(r,u2,v2)==d-1) break;
+  }
+  if (a==N_MOVES)
+  {
+   r->failed=1;
+   return;
+  }
+  out[k]=(unsigned char)a;
+  u=u2;
+  v=v2;
+  d--;
+ }
+}
+
+static void free_refine(struct refine *r)
+{
+ free(r->succ);
+ free(r->pred_start);
+ free(r->pred);
+ free(r->elems);
+ free(r->loc);
+ free(r->cls);
+ free(r->first);
+ free(r->size);
+ free(r->tuple);
+ free(r->node);
+ free(r->changed);
+ free(r->changed_next);
+ free(r->affected);
+ free(r->atuple);
+ free(r->stamp);
+ free(r->gkey);
+ free(r->gid);
+ free(r->grep);
+ free(r->gcount);
+ free(r->gstart);
+ free(r->gnext);
+ free(r->gmembers);
+ free(r->agroup);
+ free(r->ghead);
+ free(r->moved);
+ free(r->bstamp);
+ free(r->touched);
+ free(r->parent);
+ free(r->born);
+ free(r->split);
+ free(r->wit_a);
+ free(r->wit_b);
+ free(r->leaf);
+ free(r->class_node);
+}
+
+static int alloc_refine(struct refine *r)
+{
+ size_t n4=r->n4, nodes=(2*n4)+2;
+
+ r->gcap=1;
+ while ((size_t)r->gcap<2*n4) r->gcap*=2;
+ r->succ=(int *)malloc(n4*4*sizeof(int));
+ r->pred_start=(int *)calloc(n4+1,sizeof(int));
+ r->pred=(int *)malloc(n4*4*sizeof(int));
+ r->elems=(int *)malloc(n4*sizeof(int));
+ r->loc=(int *)malloc(n4*sizeof(int));
+ r->cls=(int *)malloc(n4*sizeof(int));
+ r->first=(int *)malloc(n4*sizeof(int));
+ r->size=(int *)malloc(n4*sizeof(int));
+ r->tuple=(int *)malloc(n4*4*sizeof(int));
+ r->node=(int *)malloc(n4*sizeof(int));
+ r->changed=(int *)malloc(n4*sizeof(int));
+ r->changed_next=(int *)malloc(n4*sizeof(int));
+ r->affected=(int *)malloc(n4*sizeof(int));
+ r->atuple=(int *)malloc(n4*4*sizeof(int));
+ r->stamp=(unsigned int *)calloc(n4,sizeof(unsigned int));
+ r->gkey=(unsigned long long *)malloc((size_t)r->gcap*sizeof(unsigned long long));
+ r->gid=(int *)malloc((size_t)r->gcap*sizeof(int));
+ r->grep=(int *)malloc(n4*sizeof(int));
+ r->gcount=(int *)malloc(n4*sizeof(int));
+ r->gstart=(int *)malloc(n4*sizeof(int));
+ r->gnext=(int *)malloc(n4*sizeof(int));
+ r->gmembers=(int *)malloc(n4*sizeof(int));
+ r->agroup=(int *)malloc(n4*sizeof(int));
+ r->ghead=(int *)malloc(n4*sizeof(int));
+ r->moved=(int *)malloc(n4*sizeof(int));
+ r->bstamp=(unsigned int *)calloc(n4,sizeof(unsigned int));
+ r->touched=(int *)malloc(n4*sizeof(int));
+ r->parent=(int *)malloc(nodes*sizeof(int));
+ r->born=(int *)malloc(nodes*sizeof(int));
+ r->split=(int *)malloc(nodes*sizeof(int));
+ r->wit_a=(int *)malloc(nodes*sizeof(int));
+ r->wit_b=(int *)malloc(nodes*sizeof(int));
+ r->leaf=(int *)malloc(n4*sizeof(int));
+ r->class_node=(int *)malloc((n4+1)*sizeof(int));
+ return(r->succ!=NULL&&r->pred_start!=NULL&&r->pred!=NULL&&r->elems!=NULL&&r->loc!=NULL&&r->cls!=NULL&&
+        r->first!=NULL&&r->size!=NULL&&r->tuple!=NULL&&r->node!=NULL&&r->changed!=NULL&&r->changed_next!=NULL&&
+        r->affected!=NULL&&r->atuple!=NULL&&r->stamp!=NULL&&r->gkey!=NULL&&r->gid!=NULL&&r->grep!=NULL&&
+        r->gcount!=NULL&&r->gstart!=NULL&&r->gnext!=NULL&&r->gmembers!=NULL&&r->agroup!=NULL&&r->ghead!=NULL&&
+        r->moved!=NULL&&r->bstamp!=NULL&&r->touched!=NULL&&r->parent!=NULL&&r->born!=NULL&&r->split!=NULL&&
+        r->wit_a!=NULL&&r->wit_b!=NULL&&r->leaf!=NULL&&r->class_node!=NULL);
+}
+
+int build_ambiguity(struct ambiguity *amb, int horizon, int n_threads)
+{
+ // Analyses the current map for the given look-ahead (macro actions). n_threads 0 uses
+ // default_threads(). Returns 1 on success, 0 if out of memory.
+ struct refine r;
+ int start[N_SIGNATURES+1], block_of[N_SIGNATURES];
+ int n_tasks, level, *count_of;
+ long long seq;
+
+ memset(amb,0,sizeof(struct ambiguity));
+ memset(&r,0,sizeof(struct refine));
+ if (n_threads<=0) n_threads=default_threads();
+ if (horizon<0) horizon=0;
+ amb->n=sx*sy;
+ amb->horizon=horizon;
+ r.n4=amb->n*4;
+ r.horizon=horizon;
+ r.n_threads=n_threads;
+ r.amb=amb;
+ n_tasks=(r.n4+AMB_CHUNK-1)/AMB_CHUNK;
+ amb->class_of=(int *)malloc((size_t)r.n4*sizeof(int));
+ amb->equiv=(int *)malloc((size_t)r.n4*sizeof(int));
+ if (amb->class_of==NULL||amb->equiv==NULL||alloc_refine(&r)==0)
+ {
+  free_refine(&r);
+  free_ambiguity(amb);
+  return(0);
+ }
+
+ // Successors, and predecessors (counting sort)
+ run_parallel(n_tasks,n_threads,succ_task,&r);
+ for (int k=0; k<r.n4*4; k++)
+  r.pred_start[r.succ[k]+1]++;
+ for (int s=0; s<r.n4; s++)
+  r.pred_start[s+1]+=r.pred_start[s];
+ for (int k=0; k<r.n4*4; k++)
+  r.pred[r.pred_start[r.succ[k]]++]=k/4;
+ for (int s=r.n4; s>0; s--)
+  r.pred_start[s]=r.pred_start[s-1];
+ r.pred_start[0]=0;
+
+ // P_0 - blocks by scan signature, below the root. Their tuples are unknown, so round 0 looks at every state.
+ new_node(&r,-1,-1);
+ r.split[0]=0;
+ memset(&start[0],0,sizeof(start));
+ for (int s=0; s<r.n4; s++)
+  start[map_sig[s]+1]++;
+ for (int z=0; z<N_SIGNATURES; z++)
+ {
+  block_of[z]=-1;
+  if (start[z+1]>0)
+  {
+   block_of[z]=r.n_blocks++;
+   r.first[block_of[z]]=start[z];
+   r.size[block_of[z]]=start[z+1];
+   r.node[block_of[z]]=new_node(&r,0,0);
+   for (int a=0; a<N_MOVES; a++)
+    r.tuple[(block_of[z]*4)+a]=-1;
+  }
+  start[z+1]+=start[z];
+ }
+ for (int s=0; s<r.n4; s++)
+ {
+  int z=map_sig[s];
+  r.cls[s]=block_of[z];
+  r.loc[s]=start[z]++;
+  r.elems[r.loc[s]]=s;
+ }
+
+ // Refine until nothing splits
+ level=0;
+ while (refine_round(&r,level)>0)
+  level++;
+ amb->levels=level;
+ for (int s=0; s<r.n4; s++)
+  r.leaf[s]=r.node[r.cls[s]];
+
+ // States no sequence tells apart share a final block
+ for (int b=0; b<r.n_blocks; b++)
+  r.touched[b]=(r.size[b]>1)?amb->n_equiv++:-1;
+ for (int s=0; s<r.n4; s++)
+  amb->equiv[s]=r.touched[r.cls[s]];
+
+ // Classes - blocks at the horizon that split later on. The per-node counts reuse the
+ // tuple array, which is no longer needed.
+ run_parallel(n_tasks,n_threads,horizon_task,&r);
+ count_of=r.tuple;
+ memset(count_of,0,(size_t)r.n_nodes*sizeof(int));
+ for (int s=0; s<r.n4; s++)
+  count_of[amb->class_of[s]]++;
+ for (int x=0; x<r.n_nodes; x++)
+  if (count_of[x]>1&&r.split[x]>0)
+  {
+   r.class_node[amb->n_classes]=x;
+   count_of[x]=-1-amb->n_classes;       // Class number, encoded
+   amb->n_classes++;
+  }
+ for (int s=0; s<r.n4; s++)
+ {
+  int x=amb->class_of[s];
+  amb->class_of[s]=(count_of[x]<0)?-1-count_of[x]:-1;
+ }
+ amb->classes=(struct amb_class *)calloc(amb->n_classes+1,sizeof(struct amb_class));
+ if (amb->classes==NULL)
+ {
+  free_refine(&r);
+  free_ambiguity(amb);
+  return(0);
+ }
+ for (int s=0; s<r.n4; s++)
+  if (amb->class_of[s]>=0) amb->classes[amb->class_of[s]].size++;
+ seq=0;
+ for (int c=0; c<amb->n_classes; c++)
+ {
+  amb->classes[c].level=r.split[r.class_node[c]];
+  amb->classes[c].seq=seq;
+  seq+=amb->classes[c].level;
+ }
+ amb->n_actions=seq;
+ amb->actions=(unsigned char *)malloc((size_t)seq+1);
+ if (amb->actions!=NULL) run_parallel(amb->n_classes,n_threads,sequence_task,&r);
+ if (amb->actions==NULL||r.failed)
+ {
+  if (r.failed) fprintf(stderr,"build_ambiguity(): Inconsistent splitting tree\n");
+  free_refine(&r);
+  free_ambiguity(amb);
+  return(0);
+ }
+ free_refine(&r);
+ return(1);
+}
+
+void free_ambiguity(struct ambiguity *amb)
+{
+ if (amb->mapped!=NULL) munmap(amb->mapped,amb->mapped_size);
+ else
+ {
+  free(amb->class_of);
+  free(amb->equiv);
+  free(amb->classes);
+  free(amb->actions);
+ }
+ memset(amb,0,sizeof(struct ambiguity));
+}
+
+int ambiguity_sequence(const struct ambiguity *amb, int state, unsigned char *actions, int max_actions)
+{
+ // Copies the separating sequence for the class of state to actions[]. Returns its length,
+ // or -1 if state has none or it is longer than max_actions.
+ const struct amb_class *c;
+
+ if (amb->class_of==NULL||state<0||state>=amb->n*4||amb->class_of[state]<0) return(-1);
+ c=&amb->classes[amb->class_of[state]];
+ if (c->level>max_actions) return(-1);
+ memcpy(actions,amb->actions+c->seq,(size_t)c->level);
+ return(c->level);
+}
+
+int load_ambiguity(struct ambiguity *amb, const char *mapname, int horizon)
+{
+ // Maps the stored analysis for the current map (map_hash, see load_map_cache()) if there is
+ // one for the same horizon. Returns 1 on success, 0 otherwise.
+ char path[1024];
+ struct stat st;
+ struct amb_header *hdr;
+ unsigned char *data;
+ unsigned long long n4;
+ int fd;
+
+ memset(amb,0,sizeof(struct ambiguity));
+ if (map_hash==0) return(0);
+ map_cache_path(mapname,"amb",&path[0],1024);
+ fd=open(&path[0],O_RDONLY);
+ if (fd<0) return(0);
+ if (fstat(fd,&st)!=0||(size_t)st.st_size<sizeof(struct amb_header))
+ {
+  close(fd);
+  return(0);
+ }
+ data=(unsigned char *)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+ close(fd);
+ if (data==MAP_FAILED) return(0);
+
+ hdr=(struct amb_header *)data;
+ n4=(unsigned long long)sx*sy*4;
+ if (strncmp(&hdr->magic[0],AMB_MAGIC,8)!=0||hdr->version!=AMB_VERSION||
+     hdr->header_size!=sizeof(struct amb_header)||hdr->file_size!=(unsigned long long)st.st_size||
+     hdr->map_hash!=map_hash||hdr->sx!=sx||hdr->sy!=sy||hdr->horizon!=horizon||hdr->n_classes<0||
+     hdr->class_of_offset+(n4*sizeof(int))>hdr->file_size||hdr->equiv_offset+(n4*sizeof(int))>hdr->file_size||
+     hdr->classes_offset+((unsigned long long)hdr->n_classes*sizeof(struct amb_class))>hdr->file_size||
+     hdr->actions_offset+hdr->n_actions>hdr->file_size)
+ {
+  fprintf(stderr,"Ambiguity analysis %s is stale or invalid, rebuilding it\n",&path[0]);
+  munmap(data,st.st_size);
+  return(0);
+ }
+ amb->n=sx*sy;
+ amb->horizon=horizon;
+ amb->levels=hdr->levels;
+ amb->n_classes=hdr->n_classes;
+ amb->n_equiv=hdr->n_equiv;
+ amb->class_of=(int *)(data+hdr->class_of_offset);
+ amb->equiv=(int *)(data+hdr->equiv_offset);
+ amb->classes=(struct amb_class *)(data+hdr->classes_offset);
+ amb->actions=data+hdr->actions_offset;
+ amb->n_actions=(long long)hdr->n_actions;
+ amb->mapped=data;
+ amb->mapped_size=st.st_size;
+ return(1);
+}
+
+static unsigned long long aligned(unsigned long long offset)
+{
+ return(((offset+CMAP_ALIGN-1)/CMAP_ALIGN)*CMAP_ALIGN);
+}
+
+static int write_section(FILE *f, unsigned long long *at, unsigned long long offset, const void *data, unsigned long long size)
+{
+ static const unsigned char pad[CMAP_ALIGN]={0};
+
+ if (offset>*at&&fwrite(&pad[0],offset-*at,1,f)!=1) return(0);
+ if (size>0&&fwrite(data,size,1,f)!=1) return(0);
+ *at=offset+size;
+ return(1);
+}
+
+int save_ambiguity(const struct ambiguity *amb, const char *mapname)
+{
+ // Writes the analysis next to the map image (under a temporary name, then renamed into
+ // place like save_map_cache()). Returns 1 on success, 0 otherwise.
+ char path[1024], tmp_path[1100];
+ struct amb_header hdr;
+ unsigned long long n4, size, at;
+ FILE *f;
+ int ok;
+
+ if (amb->class_of==NULL||amb->n!=sx*sy) return(0);
+ if (map_hash==0&&hash_map_file(mapname,&map_hash,&size)==0) return(0);
+
+ n4=(unsigned long long)amb->n*4;
+ memset(&hdr,0,sizeof(struct amb_header));
+ strncpy(&hdr.magic[0],AMB_MAGIC,8);
+ hdr.version=AMB_VERSION;
+ hdr.header_size=sizeof(struct amb_header);
+ hdr.map_hash=map_hash;
+ hdr.sx=sx;
+ hdr.sy=sy;
+ hdr.horizon=amb->horizon;
+ hdr.levels=amb->levels;
+ hdr.n_classes=amb->n_classes;
+ hdr.n_equiv=amb->n_equiv;
+ hdr.class_of_offset=aligned(sizeof(struct amb_header));
+ hdr.equiv_offset=aligned(hdr.class_of_offset+(n4*sizeof(int)));
+ hdr.classes_offset=aligned(hdr.equiv_offset+(n4*sizeof(int)));
+ hdr.actions_offset=aligned(hdr.classes_offset+((unsigned long long)amb->n_classes*sizeof(struct amb_class)));
+ hdr.n_actions=(unsigned long long)amb->n_actions;
+ hdr.file_size=hdr.actions_offset+hdr.n_actions;
+
+ map_cache_path(mapname,"amb",&path[0],1024);
+ snprintf(&tmp_path[0],1100,"%s.tmp%d",&path[0],(int)getpid());
+ f=fopen(&tmp_path[0],"wb");
+ if (f==NULL)
+ {
+  fprintf(stderr,"Unable to write ambiguity analysis %s\n",&path[0]);
+  return(0);
+ }
+ at=0;
+ ok=write_section(f,&at,0,&hdr,sizeof(struct amb_header));
+ ok=ok&&write_section(f,&at,hdr.class_of_offset,amb->class_of,n4*sizeof(int));
+ ok=ok&&write_section(f,&at,hdr.equiv_offset,amb->equiv,n4*sizeof(int));
+ ok=ok&&write_section(f,&at,hdr.classes_offset,amb->classes,(unsigned long long)amb->n_classes*sizeof(struct amb_class));
+ ok=ok&&write_section(f,&at,hdr.actions_offset,amb->actions,hdr.n_actions);
+ if (fclose(f)!=0) ok=0;
+ if (!ok||rename(&tmp_path[0],&path[0])!=0)
+ {
+  fprintf(stderr,"Unable to write ambiguity analysis %s\n",&path[0]);
+  unlink(&tmp_path[0]);
+  return(0);
+ }
+ return(1);
+}
@@ -0,0 +1,119 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Offline map ambiguity analysis.
+
+ Maps with repeated building patterns have places where the robot can drive around and
+ scan for several steps and still not know which of two (or more) states it is in.
+ select_action() (EV3_Explore.h) only looks EXPLORE_DEPTH macro actions ahead, so there
+ every action looks equally useless and the robot dithers. This module finds those
+ places once per map, together with the moves that get the robot out of them.
+
+ Two states are told apart by a sequence of macro actions (turn or not, drive one block,
+ scan - macro_move() in EV3_Motion.h, noise free as in EV3_Explore.h) if their scans
+ differ somewhere along it. P_k is the partition of the states into blocks that no
+ sequence of k macro actions tells apart: P_0 groups states by scan signature (map_sig[]),
+ and two states stay together in P_k+1 if they are together in P_k and so are their
+ successors under every action. build_ambiguity() refines P_0, P_1, ... until nothing
+ splits (Moore's algorithm for automaton minimization). Only states with a successor
+ that changed block last round can split, so each round looks at the predecessors of the
+ moved states alone: their successor blocks are gathered in parallel, then grouped by
+ (block, successor blocks) and the new pieces moved to the end of their block's range.
+
+ The blocks form a splitting tree: a block that splits in round k gets a child per piece,
+ born at level k. Two states are first told apart at the level of the children below
+ their lowest common ancestor, and a shortest sequence that does it is found by walking
+ the tree: with separation level d, some first action takes them to states separated at
+ level d-1, and so on down to level 0, where their scans differ.
+
+ The classes are the blocks of P_horizon with more than one member: sets of states that
+ the explorer's look-ahead can not tell apart. For each class whose members can be told
+ apart at all, the shortest separating sequence - one for two members from different
+ pieces of the class's first split, as long as that split's level, so no shorter one
+ separates any members - is worked out (in parallel over the classes) and stored. Then
+ during localization
+
+     ambiguity_action(amb, state)
+
+ gives the first move of the stored sequence for the class of the most likely state in
+ O(1), and ambiguity_sequence() the whole sequence. States that no sequence ever tells
+ apart (a map with a symmetric region that is truly the same) are marked in equiv[] as
+ well, so the robot can stop trying.
+
+ The analysis is stored next to the map image like the route table (EV3_RouteTable.h):
+
+    Map1.ppm  -->  Map1.ppm.amb
+
+ with map_hash and the horizon in its header, and mmap()ed on load. map_ambiguity in
+ EV3_Benchmarks builds it offline and prints a summary.
+
+*/
+
+#ifndef __ambiguity_header
+#define __ambiguity_header
+
+#include "EV3_Motion.h"
+#include "EV3_MapCache.h"
+#include "EV3_Threads.h"
+
+#define AMB_MAGIC "EV3AMB"
+#define AMB_VERSION 1
+
+struct amb_class{
+ int size;                  // States in the class
+ int level;                 // Level of its first split - the length of its sequence
+ long long seq;             // Its separating sequence starts at actions[seq]
+};
+
+struct amb_header{
+ char magic[8];                     // AMB_MAGIC, zero padded
+ unsigned int version;              // AMB_VERSION
+ unsigned int header_size;          // sizeof(struct amb_header)
+ unsigned long long map_hash;       // map_hash of the map the analysis was built for
+ int sx, sy;
+ int horizon;
+ int levels;
+ int n_classes;
+ int n_equiv;
+ unsigned long long class_of_offset;    // int[sx*sy*4]
+ unsigned long long equiv_offset;       // int[sx*sy*4]
+ unsigned long long classes_offset;     // struct amb_class[n_classes]
+ unsigned long long actions_offset;     // unsigned char[n_actions]
+ unsigned long long n_actions;
+ unsigned long long file_size;
+};
+
+struct ambiguity{
+ int n;                     // Number of intersections
+ int horizon;               // Classes are the blocks of P_horizon
+ int levels;                // Rounds until the partition was stable
+ int *class_of;             // class_of[s] - class of state s, -1 if the horizon tells it apart or nothing ever does
+ int *equiv;                // equiv[s] - group of states no sequence tells apart, -1 if s is not in one
+ int n_classes;
+ int n_equiv;
+ struct amb_class *classes;
+ unsigned char *actions;    // All separating sequences, MOVE_* macro actions
+ long long n_actions;
+ void *mapped;              // Set if the arrays point into a mapped file
+ size_t mapped_size;
+};
+
+int build_ambiguity(struct ambiguity *amb, int horizon, int n_threads);
+void free_ambiguity(struct ambiguity *amb);
+int load_ambiguity(struct ambiguity *amb, const char *mapname, int horizon);
+int save_ambiguity(const struct ambiguity *amb, const char *mapname);
+int ambiguity_sequence(const struct ambiguity *amb, int state, unsigned char *actions, int max_actions);
+
+// First macro action of the separating sequence for the class of state, -1 if it has none
+static inline int ambiguity_action(const struct ambiguity *amb, int state)
+{
+ int c;
+
+ if (amb->class_of==NULL||state<0||state>=amb->n*4) return(-1);
+ c=amb->class_of[state];
+ if (c<0||amb->classes[c].level<1) return(-1);
+ return(amb->actions[amb->classes[c].seq]);
+}
+
+#endif
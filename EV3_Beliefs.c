@@ -0,0 +1,587 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Histogram filter kernels - see EV3_Beliefs.h
+
+*/
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include <math.h>
+#include <string.h>
+#include "EV3_Beliefs.h"
+
+#define SOA_ALIGN 32
+#define SOA_SUM_BLOCK 4096          // Floats summed in float lanes before carrying into a double
+#define SOA_BELIEF_FLOOR 1e-30f     // Smallest belief kept in the float kernels
+
+void init_beliefs(double (*b)[4], int n, double *scale)
+{
+ // Uniform probability for each location and direction
+ for (int i=0; i<n; i++)
+ {
+  b[i][0]=1.0/(double)(n*4);
+  b[i][1]=1.0/(double)(n*4);
+  b[i][2]=1.0/(double)(n*4);
+  b[i][3]=1.0/(double)(n*4);
+ }
+ *scale=1.0;
+}
+
+void fold_belief_scale(double (*b)[4], int n, double *scale)
+{
+ // Multiplies the lazy scale back into the array and renormalizes exactly
+ double *p=&b[0][0];
+ double sum=0;
+
+ for (int s=0; s<n*4; s++)
+  sum+=p[s];
+ if (sum<=0)
+ {
+  init_beliefs(b,n,scale);
+  return;
+ }
+ for (int s=0; s<n*4; s++)
+  p[s]/=sum;
+ *scale=1.0;
+}
+
+void reseed_beliefs(double (*b)[4], int n, double *scale, double floor)
+{
+ // Keeps (1-floor) of the current (lazily scaled) beliefs and spreads floor uniformly over
+ // all states, so every state can be recovered. Leaves the array normalized (scale 1).
+ double *p=&b[0][0];
+ double u=floor/(double)(n*4);
+
+ fold_belief_scale(b,n,scale);
+ for (int s=0; s<n*4; s++)
+  p[s]=((1.0-floor)*p[s])+u;
+}
+
+void top2_insert(double v, int state, double *m1, int *i1, double *m2, int *i2)
+{
+ // Keeps the two largest values seen so far (and their states), ties go to the lower state
+ if (v>*m1||(v==*m1&&state<*i1))
+ {
+  *m2=*m1;
+  *i2=*i1;
+  *m1=v;
+  *i1=state;
+ }
+ else if (v>*m2||(v==*m2&&state<*i2))
+ {
+  *m2=v;
+  *i2=state;
+ }
+}
+
+void finish_belief_stats(struct belief_stats *st, int n, double sum, double plogp, double m1, int i1, double m2, int i2)
+{
+ // Statistics of the normalized beliefs over n intersections from the sum S of the
+ // unnormalized values, the sum of p*log2(p) over them, and the top two (see the comment
+ // in EV3_Beliefs.h). If S is not positive the beliefs were reset to uniform.
+ if (!(sum>0)||i1<0)
+ {
+  st->best=0;
+  st->second=(n*4>1)?1:-1;
+  st->p_best=1.0/(double)(n*4);
+  st->p_second=(n*4>1)?st->p_best:0;
+  st->entropy=log2((double)(n*4));
+  return;
+ }
+ st->best=i1;
+ st->second=i2;
+ st->p_best=m1/sum;
+ st->p_second=(i2>=0)?m2/sum:0;
+ st->entropy=log2(sum)-(plogp/sum);
+ if (st->entropy<0) st->entropy=0;
+}
+
+void belief_stats(double (*b)[4], int n, struct belief_stats *st)
+{
+ // Most likely state, runner-up and entropy of the (lazily scaled) beliefs, in one pass.
+ // The normalized statistics do not depend on the lazy scale.
+ double *p=&b[0][0];
+ double sum=0, plogp=0, m1=-1, m2=-1;
+ int i1=-1, i2=-1;
+
+ for (int s=0; s<n*4; s++)
+ {
+  sum+=p[s];
+  if (p[s]>0) plogp+=p[s]*log2(p[s]);
+  if (p[s]>=m2) top2_insert(p[s],s,&m1,&i1,&m2,&i2);
+ }
+ finish_belief_stats(st,n,sum,plogp,m1,i1,m2,i2);
+}
+
+void update_beliefs_indexed(double (*b)[4], int n, double *scale, int sig, double p_match)
+{
+ // Measurement update for a scan with signature sig (see scan_signature() in EV3_Map.h)
+ // using the inverted signature index. Only the states that agree with the scan are
+ // visited, the rest are rescaled implicitly through *scale.
+ double *p=&b[0][0];
+ double p_miss, ratio, m, z;
+ int first, last;
+
+ if (sig<0||sig>=N_SIGNATURES) return;
+ p_miss=(1.0-p_match)/(double)(N_SIGNATURES-1);
+ ratio=p_match/p_miss;
+ first=map_sig_start[sig];
+ last=map_sig_start[sig+1];
+
+ // Probability mass currently on the matching states
+ m=0;
+ for (int k=first; k<last; k++)
+  m+=p[map_sig_states[k]];
+ m*=(*scale);
+ if (m>1.0) m=1.0;
+
+ // Normalizer for the posterior: matches weighted by p_match, everything else by p_miss
+ z=(p_match*m)+(p_miss*(1.0-m));
+ if (z<=0)
+ {
+  init_beliefs(b,n,scale);
+  return;
+ }
+
+ for (int k=first; k<last; k++)
+  p[map_sig_states[k]]*=ratio;
+ *scale*=p_miss/z;
+
+ if (*scale<BELIEF_FOLD_LIMIT) fold_belief_scale(b,n,scale);
+}
+
+static inline unsigned char match_count(unsigned char p, unsigned char q)
+{
+ // Number of equal 2-bit fields in p and q
+ unsigned char x=p^q;
+ unsigned char t=(x|(x>>1))&0x55;             // One bit per building that differs
+ t=(t&0x33)+((t>>2)&0x33);
+ t=(t&0x0F)+((t>>4)&0x0F);
+ return((unsigned char)(4-t));
+}
+
+#if defined(__SSE2__)
+static inline __m128i match_count_sse2(__m128i p, __m128i q)
+{
+ // match_count() on 16 bytes. SSE2 only has 16-bit shifts, the masks drop the bits that
+ // cross over from the neighbouring byte.
+ __m128i x=_mm_xor_si128(p,q);
+ __m128i t=_mm_and_si128(_mm_or_si128(x,_mm_srli_epi16(x,1)),_mm_set1_epi8(0x55));
+ t=_mm_add_epi8(_mm_and_si128(t,_mm_set1_epi8(0x33)),_mm_and_si128(_mm_srli_epi16(t,2),_mm_set1_epi8(0x33)));
+ t=_mm_add_epi8(_mm_and_si128(t,_mm_set1_epi8(0x0F)),_mm_and_si128(_mm_srli_epi16(t,4),_mm_set1_epi8(0x0F)));
+ return(_mm_sub_epi8(_mm_set1_epi8(4),t));
+}
+
+static inline void store_interleaved(unsigned char *out, __m128i r0, __m128i r1, __m128i r2, __m128i r3)
+{
+ // r0..r3 hold the counts for directions 0..3 of 16 consecutive intersections, write them
+ // out in state order (idx*4)+d
+ __m128i t0=_mm_unpacklo_epi8(r0,r1);
+ __m128i t1=_mm_unpackhi_epi8(r0,r1);
+ __m128i t2=_mm_unpacklo_epi8(r2,r3);
+ __m128i t3=_mm_unpackhi_epi8(r2,r3);
+ _mm_storeu_si128((__m128i *)(out),_mm_unpacklo_epi16(t0,t2));
+ _mm_storeu_si128((__m128i *)(out+16),_mm_unpackhi_epi16(t0,t2));
+ _mm_storeu_si128((__m128i *)(out+32),_mm_unpacklo_epi16(t1,t3));
+ _mm_storeu_si128((__m128i *)(out+48),_mm_unpackhi_epi16(t1,t3));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline __m256i match_count_avx2(__m256i p, __m256i q)
+{
+ __m256i x=_mm256_xor_si256(p,q);
+ __m256i t=_mm256_and_si256(_mm256_or_si256(x,_mm256_srli_epi16(x,1)),_mm256_set1_epi8(0x55));
+ t=_mm256_add_epi8(_mm256_and_si256(t,_mm256_set1_epi8(0x33)),_mm256_and_si256(_mm256_srli_epi16(t,2),_mm256_set1_epi8(0x33)));
+ t=_mm256_add_epi8(_mm256_and_si256(t,_mm256_set1_epi8(0x0F)),_mm256_and_si256(_mm256_srli_epi16(t,4),_mm256_set1_epi8(0x0F)));
+ return(_mm256_sub_epi8(_mm256_set1_epi8(4),t));
+}
+#endif
+
+void match_scan_packed(int tl, int tr, int br, int bl, unsigned char *counts)
+{
+ // Compares the scan (tl, tr, br, bl - robot relative) against every intersection of the
+ // packed map for all four facing directions. counts must hold 4*sx*sy entries, on return
+ // counts[(idx*4)+d] is the number of buildings that agree with the scan if the robot is
+ // at intersection idx facing d.
+ //
+ // Facing d, the robot's k-th building is map building (k+d)&3, so the scan is compared
+ // with a pattern that has the k-th scanned colour in 2-bit slot (k+d)&3.
+ int obs[4];
+ unsigned char q[4];
+ int n=sx*sy;
+ int idx=0;
+
+ obs[0]=colour_code(tl);
+ obs[1]=colour_code(tr);
+ obs[2]=colour_code(br);
+ obs[3]=colour_code(bl);
+ for (int d=0; d<4; d++)
+ {
+  q[d]=0;
+  for (int k=0; k<4; k++)
+   q[d]|=(unsigned char)(obs[k]<<(2*((k+d)&3)));
+ }
+
+#if defined(__AVX2__)
+ {
+  __m256i q0=_mm256_set1_epi8((char)q[0]), q1=_mm256_set1_epi8((char)q[1]);
+  __m256i q2=_mm256_set1_epi8((char)q[2]), q3=_mm256_set1_epi8((char)q[3]);
+  for (; idx+32<=n; idx+=32)
+  {
+   __m256i p=_mm256_loadu_si256((const __m256i *)(map_packed+idx));
+   __m256i r0=match_count_avx2(p,q0), r1=match_count_avx2(p,q1);
+   __m256i r2=match_count_avx2(p,q2), r3=match_count_avx2(p,q3);
+   store_interleaved(counts+(idx*4),_mm256_castsi256_si128(r0),_mm256_castsi256_si128(r1),
+                     _mm256_castsi256_si128(r2),_mm256_castsi256_si128(r3));
+   store_interleaved(counts+((idx+16)*4),_mm256_extracti128_si256(r0,1),_mm256_extracti128_si256(r1,1),
+                     _mm256_extracti128_si256(r2,1),_mm256_extracti128_si256(r3,1));
+  }
+ }
+#endif
+#if defined(__SSE2__)
+ {
+  __m128i q0=_mm_set1_epi8((char)q[0]), q1=_mm_set1_epi8((char)q[1]);
+  __m128i q2=_mm_set1_epi8((char)q[2]), q3=_mm_set1_epi8((char)q[3]);
+  for (; idx+16<=n; idx+=16)
+  {
+   __m128i p=_mm_loadu_si128((const __m128i *)(map_packed+idx));
+   store_interleaved(counts+(idx*4),match_count_sse2(p,q0),match_count_sse2(p,q1),
+                     match_count_sse2(p,q2),match_count_sse2(p,q3));
+  }
+ }
+#endif
+ for (; idx<n; idx++)
+  for (int d=0; d<4; d++)
+   counts[(idx*4)+d]=match_count(map_packed[idx],q[d]);
+}
+
+void update_beliefs_counts(double (*b)[4], int n, double *scale, const unsigned char *counts, double misread)
+{
+ // Measurement update from match counts (see match_scan_packed()). Each building is read
+ // correctly with probability 1-misread, or as one of the two other colours with
+ // probability misread/2 each, so a state with m agreeing buildings has likelihood
+ // (1-misread)^m * (misread/2)^(4-m).
+ double like[5];
+ double *p=&b[0][0];
+ double sum=0;
+
+ for (int m=0; m<=4; m++)
+  like[m]=pow(1.0-misread,m)*pow(misread/2.0,4-m);
+ for (int s=0; s<n*4; s++)
+ {
+  p[s]*=like[counts[s]];
+  sum+=p[s];
+ }
+ if (sum<=0)
+ {
+  init_beliefs(b,n,scale);
+  return;
+ }
+ *scale=1.0/sum;
+ if (*scale<BELIEF_FOLD_LIMIT||*scale>1.0/BELIEF_FOLD_LIMIT) fold_belief_scale(b,n,scale);
+}
+
+int alloc_belief_soa(struct belief_soa *bs, int n)
+{
+ // Allocates 32-byte aligned per-direction arrays, padded to a multiple of 8 floats.
+ // Returns 1 on success, 0 if out of memory.
+ size_t bytes=((((size_t)n+7)/8)*8)*sizeof(float);
+
+ bs->n=n;
+ for (int d=0; d<4; d++)
+  bs->b[d]=NULL;
+ for (int d=0; d<4; d++)
+ {
+  if (posix_memalign((void **)&bs->b[d],SOA_ALIGN,bytes)!=0)
+  {
+   bs->b[d]=NULL;
+   free_belief_soa(bs);
+   return(0);
+  }
+  memset(bs->b[d],0,bytes);
+ }
+ return(1);
+}
+
+void free_belief_soa(struct belief_soa *bs)
+{
+ for (int d=0; d<4; d++)
+ {
+  free(bs->b[d]);
+  bs->b[d]=NULL;
+ }
+}
+
+void init_belief_soa(struct belief_soa *bs)
+{
+ float u=1.0f/(float)(bs->n*4);
+
+ for (int d=0; d<4; d++)
+  for (int i=0; i<bs->n; i++)
+   bs->b[d][i]=u;
+}
+
+void beliefs_to_soa(double (*b)[4], double scale, struct belief_soa *bs)
+{
+ for (int i=0; i<bs->n; i++)
+  for (int d=0; d<4; d++)
+   bs->b[d][i]=(float)(b[i][d]*scale);
+}
+
+void soa_to_beliefs(struct belief_soa *bs, double (*b)[4], double *scale)
+{
+ for (int i=0; i<bs->n; i++)
+  for (int d=0; d<4; d++)
+   b[i][d]=bs->b[d][i];
+ *scale=1.0;
+}
+
+void match_scan_packed_soa(int tl, int tr, int br, int bl, unsigned char *counts)
+{
+ // Same as match_scan_packed(), but counts are written per direction:
+ // counts[(d*sx*sy)+idx]. No transpose is needed, each direction is a plain stream.
+ int obs[4];
+ unsigned char q;
+ int n=sx*sy;
+
+ obs[0]=colour_code(tl);
+ obs[1]=colour_code(tr);
+ obs[2]=colour_code(br);
+ obs[3]=colour_code(bl);
+ for (int d=0; d<4; d++)
+ {
+  unsigned char *out=counts+((size_t)d*n);
+  int idx=0;
+
+  q=0;
+  for (int k=0; k<4; k++)
+   q|=(unsigned char)(obs[k]<<(2*((k+d)&3)));
+#if defined(__AVX2__)
+  for (; idx+32<=n; idx+=32)
+   _mm256_storeu_si256((__m256i *)(out+idx),match_count_avx2(_mm256_loadu_si256((const __m256i *)(map_packed+idx)),_mm256_set1_epi8((char)q)));
+#endif
+#if defined(__SSE2__)
+  for (; idx+16<=n; idx+=16)
+   _mm_storeu_si128((__m128i *)(out+idx),match_count_sse2(_mm_loadu_si128((const __m128i *)(map_packed+idx)),_mm_set1_epi8((char)q)));
+#endif
+  for (; idx<n; idx++)
+   out[idx]=match_count(map_packed[idx],q);
+ }
+}
+
+void misread_likelihoods(double misread, float like[5])
+{
+ // Likelihood of a scan given m agreeing buildings, see update_beliefs_counts()
+ for (int m=0; m<=4; m++)
+  like[m]=(float)(pow(1.0-misread,m)*pow(misread/2.0,4-m));
+}
+
+static double fused_multiply_sum(float *b, const unsigned char *cnt, int n, const float like[5])
+{
+ // b[i]*=like[cnt[i]] and returns the sum of the updated values - one pass over memory
+ double sum=0;
+ int i=0;
+
+#if defined(__AVX2__)
+ {
+  __m256 tbl=_mm256_setr_ps(like[0],like[1],like[2],like[3],like[4],0,0,0);
+  while (i+8<=n)
+  {
+   __m256 acc0=_mm256_setzero_ps(), acc1=_mm256_setzero_ps();
+   int end=i+SOA_SUM_BLOCK;
+   if (end>n) end=n;
+   for (; i+16<=end; i+=16)
+   {
+    __m256 l0=_mm256_permutevar8x32_ps(tbl,_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(cnt+i))));
+    __m256 l1=_mm256_permutevar8x32_ps(tbl,_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(cnt+i+8))));
+    __m256 p0=_mm256_mul_ps(_mm256_load_ps(b+i),l0);
+    __m256 p1=_mm256_mul_ps(_mm256_load_ps(b+i+8),l1);
+    _mm256_store_ps(b+i,p0);
+    _mm256_store_ps(b+i+8,p1);
+    acc0=_mm256_add_ps(acc0,p0);
+    acc1=_mm256_add_ps(acc1,p1);
+   }
+   for (; i+8<=end; i+=8)
+   {
+    __m256 l0=_mm256_permutevar8x32_ps(tbl,_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(cnt+i))));
+    __m256 p0=_mm256_mul_ps(_mm256_load_ps(b+i),l0);
+    _mm256_store_ps(b+i,p0);
+    acc0=_mm256_add_ps(acc0,p0);
+   }
+   {
+    float lanes[8];
+    _mm256_storeu_ps(&lanes[0],_mm256_add_ps(acc0,acc1));
+    for (int k=0; k<8; k++) sum+=lanes[k];
+   }
+  }
+ }
+#endif
+ {
+  // Scalar (or tail) path, four independent partial sums so the adds can overlap
+  float acc[4];
+  while (i<n)
+  {
+   int end=i+SOA_SUM_BLOCK;
+   if (end>n) end=n;
+   acc[0]=acc[1]=acc[2]=acc[3]=0;
+   for (; i+4<=end; i+=4)
+    for (int k=0; k<4; k++)
+    {
+     b[i+k]*=like[cnt[i+k]];
+     acc[k]+=b[i+k];
+    }
+   for (; i<end; i++)
+   {
+    b[i]*=like[cnt[i]];
+    acc[0]+=b[i];
+   }
+   sum+=(double)acc[0]+acc[1]+acc[2]+acc[3];
+  }
+ }
+ return(sum);
+}
+
+#if defined(__AVX2__)
+static inline __m256 log2_ps(__m256 x)
+{
+ // log2(x) for x>0: exponent from the float bits, plus log2 of the mantissa (in
+ // [sqrt(1/2),sqrt(2)]) from the atanh series 2/ln2*(t+t^3/3+t^5/5+t^7/7), t=(m-1)/(m+1)
+ const __m256 one=_mm256_set1_ps(1.0f);
+ __m256i bits=_mm256_castps_si256(x);
+ __m256 e=_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits,23),_mm256_set1_epi32(127)));
+ __m256 m=_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits,_mm256_set1_epi32(0x007FFFFF)),_mm256_set1_epi32(0x3F800000)));
+ __m256 big=_mm256_cmp_ps(m,_mm256_set1_ps(1.41421356f),_CMP_GT_OQ);
+ m=_mm256_blendv_ps(m,_mm256_mul_ps(m,_mm256_set1_ps(0.5f)),big);
+ e=_mm256_add_ps(e,_mm256_and_ps(big,one));
+ __m256 t=_mm256_div_ps(_mm256_sub_ps(m,one),_mm256_add_ps(m,one));
+ __m256 t2=_mm256_mul_ps(t,t);
+ __m256 poly=_mm256_add_ps(_mm256_mul_ps(t2,_mm256_set1_ps(0.41219858f)),_mm256_set1_ps(0.57707801f));
+ poly=_mm256_add_ps(_mm256_mul_ps(t2,poly),_mm256_set1_ps(0.96179669f));
+ poly=_mm256_add_ps(_mm256_mul_ps(t2,poly),_mm256_set1_ps(2.88539008f));
+ return(_mm256_add_ps(_mm256_mul_ps(t,poly),e));
+}
+#endif
+
+static double fused_multiply_stats(float *b, const unsigned char *cnt, int n, const float like[5], int d,
+                                   double *plogp, double *m1, int *i1, double *m2, int *i2)
+{
+ // fused_multiply_sum() that also accumulates p*log2(p) and keeps the two largest updated
+ // values (as states (i*4)+d) - per lane in the AVX2 loop, merged at the end
+ double sum=0;
+ int i=0;
+
+#if defined(__AVX2__)
+ {
+  __m256 tbl=_mm256_setr_ps(like[0],like[1],like[2],like[3],like[4],0,0,0);
+  __m256 bm1=_mm256_set1_ps(-1.0f), bm2=_mm256_set1_ps(-1.0f);
+  __m256i bi1=_mm256_set1_epi32(-1), bi2=_mm256_set1_epi32(-1);
+  __m256i idx=_mm256_setr_epi32(0,1,2,3,4,5,6,7);
+  float lm1[8], lm2[8];
+  int li1[8], li2[8];
+  while (i+8<=n)
+  {
+   __m256 acc=_mm256_setzero_ps(), accl=_mm256_setzero_ps();
+   float lanes[8], llanes[8];
+   int end=i+SOA_SUM_BLOCK;
+   if (end>n) end=n;
+   for (; i+8<=end; i+=8)
+   {
+    __m256 l0=_mm256_permutevar8x32_ps(tbl,_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(cnt+i))));
+    __m256 p0=_mm256_mul_ps(_mm256_load_ps(b+i),l0);
+    __m256 gt1=_mm256_cmp_ps(p0,bm1,_CMP_GT_OQ), gt2=_mm256_cmp_ps(p0,bm2,_CMP_GT_OQ);
+    _mm256_store_ps(b+i,p0);
+    acc=_mm256_add_ps(acc,p0);
+    accl=_mm256_add_ps(accl,_mm256_mul_ps(p0,log2_ps(p0)));
+    // New runner-up: the old best if p0 beats it, else p0 if it beats the old runner-up
+    bm2=_mm256_blendv_ps(_mm256_blendv_ps(bm2,p0,gt2),bm1,gt1);
+    bi2=_mm256_castps_si256(_mm256_blendv_ps(_mm256_blendv_ps(_mm256_castsi256_ps(bi2),_mm256_castsi256_ps(idx),gt2),_mm256_castsi256_ps(bi1),gt1));
+    bm1=_mm256_blendv_ps(bm1,p0,gt1);
+    bi1=_mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bi1),_mm256_castsi256_ps(idx),gt1));
+    idx=_mm256_add_epi32(idx,_mm256_set1_epi32(8));
+   }
+   _mm256_storeu_ps(&lanes[0],acc);
+   _mm256_storeu_ps(&llanes[0],accl);
+   for (int k=0; k<8; k++)
+   {
+    sum+=lanes[k];
+    *plogp+=llanes[k];
+   }
+  }
+  _mm256_storeu_ps(&lm1[0],bm1);
+  _mm256_storeu_ps(&lm2[0],bm2);
+  _mm256_storeu_si256((__m256i *)&li1[0],bi1);
+  _mm256_storeu_si256((__m256i *)&li2[0],bi2);
+  for (int k=0; k<8; k++)
+  {
+   if (li1[k]>=0) top2_insert(lm1[k],(li1[k]*4)+d,m1,i1,m2,i2);
+   if (li2[k]>=0) top2_insert(lm2[k],(li2[k]*4)+d,m1,i1,m2,i2);
+  }
+ }
+#endif
+ for (; i<n; i++)
+ {
+  b[i]*=like[cnt[i]];
+  sum+=b[i];
+  if (b[i]>0) *plogp+=b[i]*log2f(b[i]);
+  if (b[i]>=*m2) top2_insert(b[i],(i*4)+d,m1,i1,m2,i2);
+ }
+ return(sum);
+}
+
+static void rescale(float *b, int n, float f)
+{
+ // b[i]=max(b[i]*f, SOA_BELIEF_FLOOR). The floor keeps unlikely states from sinking into
+ // float denormals (which are many times slower to multiply) while leaving them able to
+ // recover if later scans support them.
+ int i=0;
+
+#if defined(__AVX2__)
+ {
+  __m256 vf=_mm256_set1_ps(f), fl=_mm256_set1_ps(SOA_BELIEF_FLOOR);
+  for (; i+8<=n; i+=8)
+   _mm256_store_ps(b+i,_mm256_max_ps(_mm256_mul_ps(_mm256_load_ps(b+i),vf),fl));
+ }
+#elif defined(__SSE2__)
+ {
+  __m128 vf=_mm_set1_ps(f), fl=_mm_set1_ps(SOA_BELIEF_FLOOR);
+  for (; i+4<=n; i+=4)
+   _mm_store_ps(b+i,_mm_max_ps(_mm_mul_ps(_mm_load_ps(b+i),vf),fl));
+ }
+#endif
+ for (; i<n; i++)
+ {
+  b[i]*=f;
+  if (b[i]<SOA_BELIEF_FLOOR) b[i]=SOA_BELIEF_FLOOR;
+ }
+}
+
+double update_belief_soa(struct belief_soa *bs, const unsigned char *counts, const float like[5], struct belief_stats *st)
+{
+ // Measurement update on the float SoA beliefs. counts as produced by match_scan_packed_soa(),
+ // like[m] the likelihood of the scan for a state with m agreeing buildings (misread_likelihoods()).
+ // Pass 1 multiplies and sums (and, if st is not NULL, collects the belief statistics), pass 2
+ // normalizes. Returns the normalizer (the probability of the scan under the prior), 0 if the
+ // beliefs had to be reset to uniform.
+ double sum=0, plogp=0, m1=-1, m2=-1;
+ int i1=-1, i2=-1;
+ float inv;
+
+ for (int d=0; d<4; d++)
+  if (st==NULL) sum+=fused_multiply_sum(bs->b[d],counts+((size_t)d*bs->n),bs->n,like);
+  else sum+=fused_multiply_stats(bs->b[d],counts+((size_t)d*bs->n),bs->n,like,d,&plogp,&m1,&i1,&m2,&i2);
+ if (!(sum>0)||(float)(1.0/sum)>3e38f)
+ {
+  init_belief_soa(bs);
+  if (st!=NULL) finish_belief_stats(st,bs->n,0,0,-1,-1,-1,-1);
+  return(0);
+ }
+ if (st!=NULL) finish_belief_stats(st,bs->n,sum,plogp,m1,i1,m2,i2);
+ inv=(float)(1.0/sum);
+ for (int d=0; d<4; d++)
+  rescale(bs->b[d],bs->n,inv);
+ return(sum);
+}
@@ -0,0 +1,106 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Histogram filter kernels operating on a beliefs array laid out like beliefs[][] in
+ EV3_Localization.c - one row per intersection (raster order), one column per facing
+ direction (0 - UP, 1 - RIGHT, 2 - DOWN, 3 - LEFT).
+
+ Measurement updates with the signature index
+
+ The sensor model used here says a scan reads the expected signature with probability
+ p_match, and any one of the other 80 signatures with probability (1-p_match)/80. So
+ after a scan with signature z, every state that does not agree with z is multiplied by
+ the same factor. Instead of touching those states, beliefs are kept with a lazy global
+ scale:
+
+     true belief of state (i,d) = b[i][d] * scale
+
+ and an update only visits the states listed for z in the map's inverted signature index
+ (map_sig_start[], map_sig_states[]), multiplying them by p_match/p_miss, then adjusts
+ scale to renormalize. The update costs O(matches) instead of O(4*sx*sy).
+
+ The stored values drift away from [0,1] as updates pile up, so once scale gets very small
+ fold_belief_scale() multiplies it back into the array (one O(n) pass every few hundred
+ updates). Call fold_belief_scale() before reading b[][] directly - afterwards b[][] is a
+ normalized distribution and scale is 1.
+
+ Packed scan matching
+
+ match_scan_packed() compares a scan against the packed map (map_packed[], one byte per
+ intersection) under all four facing directions at once and writes, for every state, the
+ number of buildings (0-4) that agree with the scan. With SSE2/AVX2 it handles 16/32
+ intersections per instruction, so even a 1M-intersection map is a 1MB streaming read.
+ update_beliefs_counts() turns those counts into a per-building sensor model update, where
+ each building is misread (as one of the two other colours) with probability misread.
+
+ Structure-of-arrays float kernels
+
+ For large maps the measurement update is memory bound, so struct belief_soa keeps one
+ float array per facing direction (b[d][idx], 32-byte aligned). match_scan_packed_soa()
+ writes match counts in the same layout (counts[(d*n)+idx]), and update_belief_soa()
+ does the update in two streaming passes: likelihood x prior with the running sum fused
+ into one vectorized pass, then a rescale pass by 1/sum. Sums are accumulated in float
+ lanes over short blocks and carried in double, so large maps normalize accurately.
+ beliefs_to_soa()/soa_to_beliefs() convert to and from the beliefs[][] layout.
+
+ Belief statistics
+
+ Deciding whether the robot is localized needs the most likely state, the runner-up and
+ the entropy. Rescanning the whole array after each update for these would double the
+ memory traffic, so the full-pass kernels (update_beliefs_table() in EV3_SensorModel.h,
+ update_belief_soa()) take an optional struct belief_stats and fill it in while they
+ multiply: each SIMD lane keeps its own best and runner-up (value and state) and a
+ running sum of p*log2(p), and the lanes are reduced once at the end. The stored values
+ are not yet normalized at that point, but with sum S of the updated values
+
+     p_best = max / S        entropy = log2(S) - (sum of p*log2(p)) / S
+
+ so nothing needs a second pass. Vector log2() is a short polynomial accurate to about
+ 1e-9 (double) / 1e-6 (float) bits. Checks like p_best >= LOCALIZED_PROB are then O(1).
+ Pass NULL to skip the statistics. belief_stats() computes the same from scratch (one
+ pass) for beliefs that were changed some other way, e.g. by a prediction step.
+
+*/
+
+#ifndef __beliefs_header
+#define __beliefs_header
+
+#include "EV3_Map.h"
+
+#define SCAN_MATCH_PROB 0.8         // Default probability that a scan reads the correct signature
+#define BELIEF_FOLD_LIMIT 1e-100    // Fold the lazy scale back into the array below this
+#define BUILDING_MISREAD_PROB 0.1   // Default probability that a single building is misread
+
+struct belief_stats{
+ int best;                  // Most likely state (idx*4)+d
+ int second;                // Runner-up state
+ double p_best;             // Their normalized beliefs
+ double p_second;
+ double entropy;            // Entropy of the beliefs, in bits
+};
+
+struct belief_soa{
+ int n;                     // Number of intersections
+ float *b[4];               // b[d][idx] - belief for intersection idx facing d
+};
+
+void init_beliefs(double (*b)[4], int n, double *scale);
+void update_beliefs_indexed(double (*b)[4], int n, double *scale, int sig, double p_match);
+void fold_belief_scale(double (*b)[4], int n, double *scale);
+void reseed_beliefs(double (*b)[4], int n, double *scale, double floor);
+void belief_stats(double (*b)[4], int n, struct belief_stats *st);
+void top2_insert(double v, int state, double *m1, int *i1, double *m2, int *i2);
+void finish_belief_stats(struct belief_stats *st, int n, double sum, double plogp, double m1, int i1, double m2, int i2);
+void match_scan_packed(int tl, int tr, int br, int bl, unsigned char *counts);
+void update_beliefs_counts(double (*b)[4], int n, double *scale, const unsigned char *counts, double misread);
+int alloc_belief_soa(struct belief_soa *bs, int n);
+void free_belief_soa(struct belief_soa *bs);
+void init_belief_soa(struct belief_soa *bs);
+void beliefs_to_soa(double (*b)[4], double scale, struct belief_soa *bs);
+void soa_to_beliefs(struct belief_soa *bs, double (*b)[4], double *scale);
+void match_scan_packed_soa(int tl, int tr, int br, int bl, unsigned char *counts);
+void misread_likelihoods(double misread, float like[5]);
+double update_belief_soa(struct belief_soa *bs, const unsigned char *counts, const float like[5], struct belief_stats *st);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Batched route query benchmark. For random maps of 50x50 to 200x200 intersections,
+ batches of 5000 queries from random states to 5, 50 or 500 random target
+ intersections are answered three ways:
+
+   astar    - one plan_route() per query
+   batch1   - route_batch() (EV3_RouteBatch.h) on one thread
+   batchN   - route_batch() on default_threads() threads
+
+ Reported are milliseconds per batch, states expanded per query (A* and batch), and
+ mismatches: queries whose batch cost differs from the A* cost, or whose route (from
+ the paths buffer) does not end at the target with the reported cost.
+
+ Usage: bench_batch [max_size] [queries]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "../EV3_Map.h"
+#include "../EV3_RouteBatch.h"
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static void random_map(int size)
+{
+ const int colours[3]={2,3,6};
+
+ alloc_map(size,size);
+ for (int i=0; i<size*size; i++)
+  for (int k=0; k<4; k++)
+   map[i][k]=colours[rand()%3];
+ build_map_tables();
+}
+
+static int check_path(const struct route_costs *c, const struct route_query *q, const struct route_result *r, const unsigned char *paths)
+{
+ // 1 if the route's actions take q->start to q->target at cost r->cost
+ int s=q->start;
+ double cost=0;
+
+ for (int k=0; k<r->len; k++)
+ {
+  int a=paths[r->offset+k];
+  if (a==MOVE_FORWARD&&map_nbr[s]<0) return(0);
+  s=move_state(s,a);
+  cost+=(a==MOVE_FORWARD)?c->forward:((a==MOVE_UTURN)?c->uturn:c->turn);
+ }
+ return(s/4==q->target&&fabs(cost-r->cost)<1e-9);
+}
+
+int main(int argc, char *argv[])
+{
+ const int sizes[3]={50,100,200};
+ const int targets[3]={5,50,500};
+ int max_size=(argc>1)?atoi(argv[1]):200;
+ int n_queries=(argc>2)?atoi(argv[2]):5000;
+ struct route_costs costs;
+ struct route_planner rp;
+ struct route_batch rb1, rbn;
+ struct route_query *q;
+ struct route_result *res;
+ double *alone, t0, t_astar, t_batch1, t_batchn, cost;
+ unsigned char *actions;
+ long exp_astar, bad;
+
+ if (n_queries<1)
+ {
+  fprintf(stderr,"Usage: bench_batch [max_size] [queries]\n");
+  exit(1);
+ }
+ srand(1);
+ default_route_costs(&costs);
+ q=(struct route_query *)malloc((size_t)n_queries*sizeof(struct route_query));
+ res=(struct route_result *)malloc((size_t)n_queries*sizeof(struct route_result));
+ alone=(double *)malloc((size_t)n_queries*sizeof(double));
+ if (q==NULL||res==NULL||alone==NULL)
+ {
+  fprintf(stderr,"Out of memory\n");
+  exit(1);
+ }
+ printf("# %d threads for batchN\n",default_threads());
+ printf("# size queries targets astar_ms batch1_ms batchN_ms astar_expanded_per_query batch_expanded_per_query mismatches\n");
+ for (int z=0; z<3&&sizes[z]<=max_size; z++)
+ {
+  int n=sizes[z]*sizes[z];
+  random_map(sizes[z]);
+  actions=(unsigned char *)malloc((size_t)n*4);
+  if (actions==NULL||alloc_route_planner(&rp,&costs)==0||alloc_route_batch(&rb1,&costs,1)==0||alloc_route_batch(&rbn,&costs,0)==0)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  for (int c=0; c<3; c++)
+  {
+   int nt=(targets[c]<n)?targets[c]:n;
+   for (int k=0; k<n_queries; k++)
+   {
+    q[k].start=rand()%(n*4);
+    q[k].target=rand()%nt;
+   }
+   for (int k=0; k<n_queries; k++)
+    q[k].target=(int)(((long)q[k].target*7919)%n);     // Spread the targets over the map
+
+   t0=now();
+   exp_astar=0;
+   for (int k=0; k<n_queries; k++)
+   {
+    alone[k]=-1;
+    if (plan_route(&rp,q[k].start,q[k].target,actions,n*4,&cost)>=0) alone[k]=cost;
+    exp_astar+=rp.expanded;
+   }
+   t_astar=now()-t0;
+
+   t0=now();
+   if (route_batch(&rb1,q,n_queries,res,1)==0)
+   {
+    fprintf(stderr,"route_batch() failed\n");
+    exit(1);
+   }
+   t_batch1=now()-t0;
+
+   t0=now();
+   if (route_batch(&rbn,q,n_queries,res,1)==0)
+   {
+    fprintf(stderr,"route_batch() failed\n");
+    exit(1);
+   }
+   t_batchn=now()-t0;
+
+   bad=0;
+   for (int k=0; k<n_queries; k++)
+    if (fabs(res[k].cost-alone[k])>1e-9||(res[k].len>=0&&!check_path(&costs,&q[k],&res[k],rbn.paths))) bad++;
+   printf("%d %d %d %.2f %.2f %.2f %.0f %.0f %ld\n",sizes[z],n_queries,nt,t_astar*1e3,t_batch1*1e3,t_batchn*1e3,
+          exp_astar/(double)n_queries,rbn.expanded/(double)n_queries,bad);
+   fflush(stdout);
+  }
+  free(actions);
+  free_route_planner(&rp);
+  free_route_batch(&rb1);
+  free_route_batch(&rbn);
+ }
+ free(q);
+ free(res);
+ free(alone);
+ free_map();
+ return(0);
+}
@@ -0,0 +1,176 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Cooperative routing benchmark. For random maps of 20x20 to 100x100 intersections and
+ 2 to 50 robots with random starts and targets (all different intersections), plans
+ every robot with coop_plan_all() (EV3_Cooperative.h) and reports the planning time for
+ all robots, the time per robot, how many robots got a route, and how much later they
+ arrive (mean, in percent) than they would on an empty map (plan_route() with the same
+ slot costs). Every set of routes is then replayed and checked for two robots holding an
+ intersection in the same slot.
+
+ Usage: bench_coop [max_size] [trials]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../EV3_Map.h"
+#include "../EV3_Cooperative.h"
+
+#define MAX_ROBOTS 50
+
+struct hold{
+ int idx, from, to;         // Intersection held from slot from to slot to
+};
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static void random_map(int size)
+{
+ const int colours[3]={2,3,6};
+
+ alloc_map(size,size);
+ for (int i=0; i<size*size; i++)
+  for (int k=0; k<4; k++)
+   map[i][k]=colours[rand()%3];
+ build_map_tables();
+}
+
+static int replay(const struct coop_planner *cp, int start, const unsigned char *actions, int len, struct hold *h)
+{
+ // The intersections a route holds, in the order driven - the last one is held for good
+ int s=start, t=0, n=0, nt, a;
+
+ h[n++]=(struct hold){s/4,0,0};
+ for (int k=0; k<len; k++)
+ {
+  a=actions[k];
+  nt=t+cp->slots[a];
+  h[n++]=(struct hold){s/4,t,nt};
+  if (a==MOVE_FORWARD)
+  {
+   s=move_state(s,MOVE_FORWARD);
+   h[n++]=(struct hold){s/4,t,nt};
+  }
+  else if (a!=COOP_WAIT) s=move_state(s,a);
+  t=nt;
+ }
+ h[n++]=(struct hold){s/4,t,1<<30};
+ return(n);
+}
+
+static int conflicts(const struct coop_planner *cp, int robots, const int *start, unsigned char **actions, const int *len)
+{
+ // Pairs of robots that hold an intersection at the same time (robots without a route are left out)
+ static struct hold h[MAX_ROBOTS][8192];
+ int n[MAX_ROBOTS], bad=0;
+
+ for (int r=0; r<robots; r++)
+  n[r]=(len[r]>=0&&3*len[r]+2<=8192)?replay(cp,start[r],actions[r],len[r],h[r]):0;
+ for (int r=0; r<robots; r++)
+  for (int q=r+1; q<robots; q++)
+  {
+   int clash=0;
+   for (int i=0; i<n[r]&&!clash; i++)
+    for (int j=0; j<n[q]&&!clash; j++)
+     clash=(h[r][i].idx==h[q][j].idx&&h[r][i].from<=h[q][j].to&&h[q][j].from<=h[r][i].to);
+   bad+=clash;
+  }
+ return(bad);
+}
+
+int main(int argc, char *argv[])
+{
+ const int sizes[3]={20,50,100};
+ const int counts[5]={2,5,10,20,50};
+ int max_size=(argc>1)?atoi(argv[1]):100;
+ int trials=(argc>2)?atoi(argv[2]):20;
+ struct route_costs costs;
+ struct coop_planner cp;
+ struct route_planner rp;
+ unsigned char *actions[MAX_ROBOTS];
+ int start[MAX_ROBOTS], target[MAX_ROBOTS], len[MAX_ROBOTS], arrival[MAX_ROBOTS];
+ double t0, total, delay, alone;
+ long planned, delayed, bad;
+
+ srand(1);
+ default_route_costs(&costs);
+ if (trials<1)
+ {
+  fprintf(stderr,"Usage: bench_coop [max_size] [trials]\n");
+  exit(1);
+ }
+ printf("# size robots plan_ms per_robot_us planned_pct delay_pct conflicts (over %d trials)\n",trials);
+ for (int z=0; z<3&&sizes[z]<=max_size; z++)
+ {
+  int n=sizes[z]*sizes[z];
+  random_map(sizes[z]);
+  if (alloc_coop_planner(&cp,&costs,COOP_MAX_SLOTS,COOP_MAX_NODES)==0||alloc_route_planner(&rp,&cp.slot_cost)==0)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  for (int r=0; r<MAX_ROBOTS; r++)
+  {
+   actions[r]=(unsigned char *)malloc((size_t)n*4);
+   if (actions[r]==NULL)
+   {
+    fprintf(stderr,"Out of memory\n");
+    exit(1);
+   }
+  }
+  for (int c=0; c<5; c++)
+  {
+   int robots=counts[c];
+   total=0;
+   planned=0;
+   delay=0;
+   delayed=0;
+   bad=0;
+   for (int trial=0; trial<trials; trial++)
+   {
+    // Starts and targets on 2*robots different intersections
+    for (int r=0; r<2*robots; r++)
+    {
+     int idx, dup;
+     do
+     {
+      idx=rand()%n;
+      dup=0;
+      for (int q=0; q<r; q++)
+       dup|=((q<robots)?start[q]/4:target[q-robots])==idx;
+     } while (dup);
+     if (r<robots) start[r]=(idx*4)+(rand()%4);
+     else target[r-robots]=idx;
+    }
+    t0=now();
+    planned+=coop_plan_all(&cp,robots,start,target,actions,n*4,len,arrival);
+    total+=now()-t0;
+    bad+=conflicts(&cp,robots,start,actions,len);
+    for (int r=0; r<robots; r++)
+     if (len[r]>=0&&plan_route(&rp,start[r],target[r],actions[r],n*4,&alone)>=0&&alone>0)
+     {
+      delay+=(arrival[r]-alone)/alone;
+      delayed++;
+     }
+   }
+   printf("%d %d %.3f %.1f %.1f %.2f %ld\n",sizes[z],robots,total*1e3/trials,total*1e6/(trials*(double)robots),
+          100.0*planned/(trials*(double)robots),(delayed>0)?100.0*delay/delayed:0.0,bad);
+   fflush(stdout);
+  }
+  for (int r=0; r<MAX_ROBOTS; r++)
+   free(actions[r]);
+  free_coop_planner(&cp);
+  free_route_planner(&rp);
+ }
+ free_map();
+ return(0);
+}
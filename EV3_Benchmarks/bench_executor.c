@@ -0,0 +1,272 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Pipelined execution benchmark. Runs random routes through execute_route()
+ (EV3_Executor.h) against a simulated brick - a thread that takes the packets in order,
+ waits out the run time each one encodes (opTIMER_WAIT) and sends back a reply - with a
+ one way bluetooth latency on every command and reply. The host's work for each
+ completed action is a prediction step (apply_motion()) over the beliefs of a random map.
+
+ All brick times (run times and latency) are scaled by the same factor so a run takes
+ seconds, not minutes; the host's work is not. For windows of 1 (sequential - send, wait
+ for the reply, update, send the next), 2 and 3 actions in flight it reports the time
+ per route, the motion time the packets encode, and the time per action the robot
+ stands still between motions (all in ms of wall clock).
+
+ Usage: bench_executor [map_size] [scale] [latency_ms] [routes]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../EV3_Map.h"
+#include "../EV3_Executor.h"
+#include "../EV3_RobotControl/bytecodes.h"
+
+#define QUEUE 64
+#define ROUTE_LEN 40
+
+struct sim_brick{
+ pthread_mutex_t lock;
+ pthread_cond_t wake;
+ unsigned char cmd[QUEUE][EXEC_PACKET_BYTES];
+ double cmd_at[QUEUE];      // Time the command reaches the brick
+ unsigned char reply[QUEUE][8];
+ double reply_at[QUEUE];    // Time the reply reaches the host
+ long cmd_in, cmd_out, reply_in, reply_out;
+ double scale, latency;     // Time scale, one way latency in seconds (scaled)
+ int quit;
+};
+
+struct host_work{
+ struct motion_model mm;
+ double (*beliefs)[4];
+};
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static void sleep_until(double t)
+{
+ double d=t-now();
+ struct timespec s;
+
+ if (d<=0) return;
+ s.tv_sec=(time_t)d;
+ s.tv_nsec=(long)((d-s.tv_sec)*1e9);
+ nanosleep(&s,NULL);
+}
+
+static void random_map(int size)
+{
+ const int colours[3]={2,3,6};
+
+ alloc_map(size,size);
+ for (int i=0; i<size*size; i++)
+  for (int k=0; k<4; k++)
+   map[i][k]=colours[rand()%3];
+ build_map_tables();
+}
+
+static int packet_ms(const unsigned char *cmd)
+{
+ // Run time of a packet from encode_action() - the 2-byte constant after opTIMER_WAIT
+ int len=cmd[0]|(cmd[1]<<8);
+
+ for (int k=7; k+3<len+2; k++)
+  if (cmd[k]==opTIMER_WAIT&&cmd[k+1]==0x82) return(cmd[k+2]|(cmd[k+3]<<8));
+ return(0);
+}
+
+static void *brick_thread(void *arg)
+{
+ struct sim_brick *b=(struct sim_brick *)arg;
+ unsigned char cmd[EXEC_PACKET_BYTES];
+ double at;
+ long k;
+
+ for (;;)
+ {
+  pthread_mutex_lock(&b->lock);
+  while (!b->quit&&b->cmd_out==b->cmd_in) pthread_cond_wait(&b->wake,&b->lock);
+  if (b->quit)
+  {
+   pthread_mutex_unlock(&b->lock);
+   return(NULL);
+  }
+  k=b->cmd_out%QUEUE;
+  memcpy(cmd,b->cmd[k],EXEC_PACKET_BYTES);
+  at=b->cmd_at[k];
+  pthread_mutex_unlock(&b->lock);
+
+  sleep_until(at);
+  sleep_until(now()+(packet_ms(cmd)*1e-3*b->scale));
+
+  pthread_mutex_lock(&b->lock);
+  b->cmd_out++;
+  k=b->reply_in%QUEUE;
+  b->reply[k][0]=4;         // Length-2: id, type, one global byte
+  b->reply[k][1]=0;
+  b->reply[k][2]=cmd[2];
+  b->reply[k][3]=cmd[3];
+  b->reply[k][4]=0x02;
+  b->reply[k][5]=EXEC_INTERSECTION_COLOUR;
+  b->reply_at[k]=now()+b->latency;
+  b->reply_in++;
+  pthread_cond_broadcast(&b->wake);
+  pthread_mutex_unlock(&b->lock);
+ }
+}
+
+static int sim_send(const unsigned char *cmd, int len, void *arg)
+{
+ struct sim_brick *b=(struct sim_brick *)arg;
+
+ if (len>EXEC_PACKET_BYTES) return(0);
+ pthread_mutex_lock(&b->lock);
+ if (b->cmd_in-b->cmd_out>=QUEUE)
+ {
+  pthread_mutex_unlock(&b->lock);
+  return(0);
+ }
+ memcpy(b->cmd[b->cmd_in%QUEUE],cmd,len);
+ b->cmd_at[b->cmd_in%QUEUE]=now()+b->latency;
+ b->cmd_in++;
+ pthread_cond_broadcast(&b->wake);
+ pthread_mutex_unlock(&b->lock);
+ return(1);
+}
+
+static int sim_receive(unsigned char *reply, int max_len, void *arg)
+{
+ struct sim_brick *b=(struct sim_brick *)arg;
+ double at;
+ long k;
+
+ if (max_len<6) return(-1);
+ pthread_mutex_lock(&b->lock);
+ while (b->reply_out==b->reply_in) pthread_cond_wait(&b->wake,&b->lock);
+ k=b->reply_out%QUEUE;
+ memcpy(reply,b->reply[k],6);
+ at=b->reply_at[k];
+ b->reply_out++;
+ pthread_mutex_unlock(&b->lock);
+ sleep_until(at);
+ return(6);
+}
+
+static int host_done(int k, int action, int colour, void *arg)
+{
+ struct host_work *h=(struct host_work *)arg;
+
+ (void)k;
+ (void)colour;
+ apply_motion(&h->mm,action,&h->beliefs);
+ return(1);
+}
+
+int main(int argc, char *argv[])
+{
+ int size=(argc>1)?atoi(argv[1]):100;
+ double scale=(argc>2)?atof(argv[2]):0.01;
+ double latency_ms=(argc>3)?atof(argv[3]):20.0;
+ int n_routes=(argc>4)?atoi(argv[4]):5;
+ struct sim_brick brick;
+ struct host_work host;
+ struct motion_noise nz;
+ struct route_costs costs;
+ struct executor ex;
+ struct exec_link link;
+ pthread_t th;
+ unsigned char route[ROUTE_LEN];
+ double t0, host_s, motion_ms, total, len;
+ int n;
+
+ if (size<2||scale<=0||latency_ms<0||n_routes<1)
+ {
+  fprintf(stderr,"Usage: bench_executor [map_size] [scale] [latency_ms] [routes]\n");
+  exit(1);
+ }
+ srand(1);
+ random_map(size);
+ n=size*size;
+ default_motion_noise(&nz);
+ host.beliefs=(double (*)[4])malloc((size_t)n*sizeof(double[4]));
+ if (host.beliefs==NULL||build_motion_model(&host.mm,&nz)==0)
+ {
+  fprintf(stderr,"Out of memory\n");
+  exit(1);
+ }
+ for (int i=0; i<n; i++)
+  for (int d=0; d<4; d++)
+   host.beliefs[i][d]=1.0/(4.0*n);
+
+ memset(&brick,0,sizeof(brick));
+ pthread_mutex_init(&brick.lock,NULL);
+ pthread_cond_init(&brick.wake,NULL);
+ brick.scale=scale;
+ brick.latency=latency_ms*1e-3*scale;
+ pthread_create(&th,NULL,brick_thread,&brick);
+
+ default_route_costs(&costs);
+ link.send=sim_send;
+ link.receive=sim_receive;
+ link.arg=&brick;
+ init_executor(&ex,&link,0x01,0x08,0x02,&costs);
+
+ // Host work for one action on its own
+ t0=now();
+ for (int k=0; k<20; k++)
+  host_done(k,k%2,-1,&host);
+ host_s=(now()-t0)/20;
+
+ printf("# %dx%d map, host work %.3f ms per action, time scale %.3f, one way latency %.3f ms (scaled), %d routes of %d actions\n",
+        size,size,host_s*1e3,scale,brick.latency*1e3,n_routes,ROUTE_LEN);
+ printf("# window route_ms motion_ms stall_ms_per_action\n");
+ for (int w=1; w<=3; w++)
+ {
+  ex.window=w;
+  srand(2);
+  total=0;
+  motion_ms=0;
+  len=0;
+  for (int r=0; r<n_routes; r++)
+  {
+   // Mostly drives, as in planned routes
+   for (int k=0; k<ROUTE_LEN; k++)
+   {
+    route[k]=(rand()%3==0)?1+(rand()%3):MOVE_FORWARD;
+    motion_ms+=ex.run_ms[route[k]]*scale;
+   }
+   t0=now();
+   if (execute_route(&ex,route,ROUTE_LEN,host_done,&host)!=ROUTE_LEN)
+   {
+    fprintf(stderr,"Route %d failed\n",r);
+    exit(1);
+   }
+   total+=now()-t0;
+   len+=ROUTE_LEN;
+  }
+  printf("%d %.2f %.2f %.3f\n",w,total*1e3/n_routes,motion_ms/n_routes,((total*1e3)-motion_ms)/len);
+  fflush(stdout);
+ }
+
+ pthread_mutex_lock(&brick.lock);
+ brick.quit=1;
+ pthread_cond_broadcast(&brick.wake);
+ pthread_mutex_unlock(&brick.lock);
+ pthread_join(th,NULL);
+ free_executor(&ex);
+ free_motion_model(&host.mm);
+ free(host.beliefs);
+ free_map();
+ return(0);
+}
@@ -0,0 +1,147 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Prediction step microbenchmark. For random maps from 20x20 up to 1000x1000 intersections
+ times one forward move and one left turn, and reports nanoseconds per state:
+
+   naive    - per-state scatter that works out each noisy outcome as it goes (border
+              tests, overshoot, turned-around states), the textbook implementation
+   table    - predict_beliefs() with the tables from build_motion_model(), a branch-free
+              gather for forward moves and a 4x4 direction mix for turns
+
+ The time to build the tables is reported as well, it is paid once per map.
+
+ Usage: bench_motion [max_size]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../EV3_Map.h"
+#include "../EV3_Motion.h"
+
+#define MIN_SECONDS 0.2
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static void random_map(int size)
+{
+ const int colours[3]={2,3,6};
+
+ alloc_map(size,size);
+ for (int i=0; i<size*size; i++)
+  for (int k=0; k<4; k++)
+   map[i][k]=colours[rand()%3];
+ build_map_tables();
+}
+
+static void naive_predict(const struct motion_noise *nz, int action, double (*in)[4], double (*out)[4], int n)
+{
+ // Scatter from every state, with the border and turn logic written out per cell
+ memset(out,0,(size_t)n*sizeof(double[4]));
+ for (int i=0; i<n; i++)
+  for (int d=0; d<4; d++)
+  {
+   double p=in[i][d];
+   if (action==MOVE_FORWARD)
+   {
+    int j=map_nbr[(i*4)+d], e=d;
+    if (j<0)
+    {
+     j=i;
+     e=(d+2)%4;
+    }
+    out[j][e]+=p*(1.0-nz->slip-nz->overshoot);
+    out[i][d]+=p*nz->slip;
+    int k=map_nbr[(j*4)+e], f=e;
+    if (k<0)
+    {
+     k=j;
+     f=(e+2)%4;
+    }
+    out[k][f]+=p*nz->overshoot;
+   }
+   else
+   {
+    out[i][(d+3)%4]+=p*(1.0-nz->turn_fail-nz->over_turn);
+    out[i][d]+=p*nz->turn_fail;
+    out[i][(d+2)%4]+=p*nz->over_turn;
+   }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+ const int sizes[7]={20,50,100,200,300,500,1000};
+ int max_size=(argc>1)?atoi(argv[1]):1000;
+ struct motion_noise nz;
+ struct motion_model mm;
+ double (*a)[4], (*b)[4];
+ double t0, t, tb;
+ long reps;
+
+ srand(1);
+ default_motion_noise(&nz);
+ printf("# size states build_ms naive_fwd_ns table_fwd_ns naive_turn_ns table_turn_ns (per state per step)\n");
+ for (int z=0; z<7&&sizes[z]<=max_size; z++)
+ {
+  int n=sizes[z]*sizes[z];
+  random_map(sizes[z]);
+  t0=now();
+  if (build_motion_model(&mm,&nz)==0)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  tb=now()-t0;
+  a=(double (*)[4])malloc((size_t)n*sizeof(double[4]));
+  b=(double (*)[4])malloc((size_t)n*sizeof(double[4]));
+  if (a==NULL||b==NULL)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  for (int i=0; i<n; i++)
+   for (int d=0; d<4; d++)
+    a[i][d]=1.0/(n*4.0);
+  printf("%d %d %.2f",sizes[z],n*4,tb*1e3);
+
+  for (int pass=0; pass<2; pass++)
+  {
+   int action=(pass==0)?MOVE_FORWARD:MOVE_LEFT;
+   reps=0;
+   t0=now();
+   do
+   {
+    naive_predict(&nz,action,a,b,n);
+    reps++;
+   } while ((t=now()-t0)<MIN_SECONDS);
+   printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+   reps=0;
+   t0=now();
+   do
+   {
+    predict_beliefs(&mm,action,a,b);
+    reps++;
+   } while ((t=now()-t0)<MIN_SECONDS);
+   printf(" %.3f",(t*1e9)/((double)reps*n*4));
+  }
+  printf("\n");
+  fflush(stdout);
+
+  free(a);
+  free(b);
+  free_motion_model(&mm);
+ }
+ free_map();
+ return(0);
+}
@@ -0,0 +1,111 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Map parsing benchmark. For each map given, times parse_map() and parse_map_parallel()
+ over 1, 2, 4, ... threads up to the number of cores, checks that every parallel result
+ matches the serial one, and prints one line per configuration:
+
+   map  size_x  size_y  megapixels  threads  seconds  speedup
+
+ Usage: bench_parse [-t max_threads] [-n repeats] map.ppm [map.ppm ...]
+
+ Generate inputs with map_gen, or the standard set with make_corpus.sh.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../EV3_Map.h"
+#include "../EV3_Threads.h"
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+int main(int argc, char *argv[])
+{
+ unsigned char *img;
+ int rx, ry, max_threads, repeats, opt, n;
+ int (*reference)[4];
+ double t0, serial, best;
+
+ max_threads=default_threads();
+ repeats=3;
+ while ((opt=getopt(argc,argv,"t:n:"))!=-1)
+ {
+  switch (opt)
+  {
+   case 't': max_threads=atoi(optarg); break;
+   case 'n': repeats=atoi(optarg); break;
+   default:
+    fprintf(stderr,"Usage: bench_parse [-t max_threads] [-n repeats] map.ppm [map.ppm ...]\n");
+    exit(1);
+  }
+ }
+ if (optind>=argc||max_threads<1||repeats<1)
+ {
+  fprintf(stderr,"Usage: bench_parse [-t max_threads] [-n repeats] map.ppm [map.ppm ...]\n");
+  exit(1);
+ }
+ parse_verbose=0;
+
+ printf("# map size_x size_y megapixels threads seconds speedup\n");
+ for (int a=optind; a<argc; a++)
+ {
+  img=readPPMimage(argv[a],&rx,&ry);
+  if (img==NULL) continue;
+
+  serial=1e30;
+  for (int r=0; r<repeats; r++)
+  {
+   t0=now();
+   if (parse_map(img,rx,ry)==0)
+   {
+    fprintf(stderr,"Unable to parse %s\n",argv[a]);
+    break;
+   }
+   t0=now()-t0;
+   if (t0<serial) serial=t0;
+  }
+  if (map==NULL)
+  {
+   free(img);
+   continue;
+  }
+  n=sx*sy;
+  reference=(int (*)[4])malloc((size_t)n*sizeof(int[4]));
+  if (reference==NULL)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  memcpy(reference,map,(size_t)n*sizeof(int[4]));
+  printf("%s %d %d %.1f serial %.6f 1.00\n",argv[a],sx,sy,(rx*(double)ry)/1e6,serial);
+
+  for (int t=1; t<=max_threads; t=(t<max_threads&&t*2>max_threads)?max_threads:t*2)    // Always finish with max_threads
+  {
+   best=1e30;
+   for (int r=0; r<repeats; r++)
+   {
+    t0=now();
+    parse_map_parallel(img,rx,ry,t);
+    t0=now()-t0;
+    if (t0<best) best=t0;
+   }
+   if (sx*sy!=n||memcmp(reference,map,(size_t)n*sizeof(int[4]))!=0)
+    fprintf(stderr,"MISMATCH: parallel parse of %s with %d threads differs from parse_map()\n",argv[a],t);
+   printf("%s %d %d %.1f %d %.6f %.2f\n",argv[a],sx,sy,(rx*(double)ry)/1e6,t,best,serial/best);
+  }
+  free(reference);
+  free(img);
+  free_map();
+ }
+ return(0);
+}
@@ -0,0 +1,124 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Particle filter benchmark. Simulates the robot driving back and forth along the first
+ street of a map, with the colour sensor reading the map image under the true sensor
+ position (misread with probability 0.1), and runs the particle filter of EV3_Particles.c
+ on it from a uniform start (or, with -k, from a cloud around the true start pose). For
+ 1, 2, 4, ... threads up to the number of cores prints
+
+   particles  threads  ms_per_step  steps_per_second  final_error_px
+
+ The target is 100000 particles at 50 steps per second. Street colours repeat all over
+ the map, so from a uniform start the error only comes down once the robot has seen
+ enough buildings; with -k it measures tracking.
+
+ Usage: bench_particles [-n particles] [-s steps] [-t max_threads] [-k] [map.ppm]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "../EV3_Map.h"
+#include "../EV3_Particles.h"
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+int main(int argc, char *argv[])
+{
+ const char *mapname="../Map1.ppm";
+ struct particle_filter pf;
+ unsigned char *img;
+ int rx, ry, opt, n, steps, max_threads, colour, dir, known;
+ float x, y, th, ex, ey, et, speed, end_x;
+ double t0, t;
+
+ n=100000;
+ steps=500;
+ max_threads=default_threads();
+ known=0;
+ while ((opt=getopt(argc,argv,"n:s:t:k"))!=-1)
+ {
+  switch (opt)
+  {
+   case 'n': n=atoi(optarg); break;
+   case 's': steps=atoi(optarg); break;
+   case 't': max_threads=atoi(optarg); break;
+   case 'k': known=1; break;
+   default:
+    fprintf(stderr,"Usage: bench_particles [-n particles] [-s steps] [-t max_threads] [-k] [map.ppm]\n");
+    exit(1);
+  }
+ }
+ if (optind<argc) mapname=argv[optind];
+ parse_verbose=0;
+ img=readPPMimage(mapname,&rx,&ry);
+ if (img==NULL||parse_map(img,rx,ry)==0)
+ {
+  fprintf(stderr,"Unable to read map %s\n",mapname);
+  exit(1);
+ }
+
+ printf("# particles threads ms_per_step steps_per_second final_error_px\n");
+ for (int threads=1; threads<=max_threads; threads*=2)
+ {
+  if (alloc_particle_filter(&pf,n,img,rx,ry)==0)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  pf.n_threads=threads;
+  if (known) pf_init_state(&pf,1,3.0f,0.05f);     // Intersection 0 facing RIGHT
+  srand(1);
+
+  // True pose - centre of the first intersection, facing right
+  x=map_geom.bx+(map_geom.wx/2.0f);
+  y=map_geom.by+(map_geom.wy/2.0f);
+  th=0;
+  dir=1;
+  speed=map_geom.dx/10.0f;
+  end_x=map_geom.bx+((sx-1)*map_geom.dx)+(map_geom.wx/2.0f);
+
+  t=0;
+  for (int k=0; k<steps; k++)
+  {
+   x+=dir*speed;
+   if (x>end_x||x<map_geom.bx+(map_geom.wx/2.0f))
+   {
+    // Turn around on the spot - the filter sees it as one step of opposite wheel motion
+    x-=dir*speed;
+    dir=-dir;
+    th=(dir>0)?0:(float)M_PI;
+    t0=now();
+    pf_step(&pf,(float)M_PI*pf.wheel_base/2.0f,-(float)M_PI*pf.wheel_base/2.0f,0);
+    t+=now()-t0;
+    continue;
+   }
+   {
+    int px=(int)(x+(pf.sensor_offset*cosf(th)));
+    int py=(int)(y+(pf.sensor_offset*sinf(th)));
+    colour=pf.colour[px+(py*rx)];
+    if (rand()%10==0) colour=1+(rand()%6);
+   }
+   t0=now();
+   pf_step(&pf,speed,speed,colour);
+   t+=now()-t0;
+  }
+  pf_estimate(&pf,&ex,&ey,&et);
+  printf("%d %d %.3f %.1f %.1f\n",n,threads,(t*1e3)/steps,steps/t,sqrtf(((ex-x)*(ex-x))+((ey-y)*(ey-y))));
+  fflush(stdout);
+  free_particle_filter(&pf);
+ }
+ free(img);
+ free_map();
+ return(0);
+}
@@ -0,0 +1,127 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Incremental replanning benchmark. For random maps from 20x20 up to 1000x1000
+ intersections, plans a route with D* Lite (EV3_DStar.h), then drives it a few actions at
+ a time and blocks the next street on the route every time, the way go_to_target() finds
+ blocked streets. Reports the first (full) search, the replans after each block (mean,
+ median and 90th percentile), and plan_route() from scratch with no streets blocked
+ for comparison, in microseconds.
+
+ Usage: bench_replan [max_size] [routes] [blocks_per_route]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../EV3_Map.h"
+#include "../EV3_DStar.h"
+
+#define DRIVE_BLOCKS 3              // Blocks driven between blocked streets
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static void random_map(int size)
+{
+ const int colours[3]={2,3,6};
+
+ alloc_map(size,size);
+ for (int i=0; i<size*size; i++)
+  for (int k=0; k<4; k++)
+   map[i][k]=colours[rand()%3];
+ build_map_tables();
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+ double x=*(const double *)a, y=*(const double *)b;
+ return((x>y)-(x<y));
+}
+
+int main(int argc, char *argv[])
+{
+ const int sizes[7]={20,50,100,200,300,500,1000};
+ int max_size=(argc>1)?atoi(argv[1]):1000;
+ int routes=(argc>2)?atoi(argv[2]):20;
+ int blocks=(argc>3)?atoi(argv[3]):20;
+ struct route_costs costs;
+ struct route_planner rp;
+ struct dstar_planner ds;
+ unsigned char *actions;
+ double *replan, t0, full, astar, mean;
+ int start, target, len, k, f, b, n_replan;
+
+ srand(1);
+ default_route_costs(&costs);
+ replan=(double *)calloc((size_t)((routes>0)?routes:1)*((blocks>0)?blocks:1),sizeof(double));
+ if (routes<1||blocks<1||replan==NULL)
+ {
+  fprintf(stderr,"Usage: bench_replan [max_size] [routes] [blocks_per_route]\n");
+  exit(1);
+ }
+ printf("# size states full_us astar_us replan_mean_us replan_median_us replan_p90_us replans\n");
+ for (int z=0; z<7&&sizes[z]<=max_size; z++)
+ {
+  int n=sizes[z]*sizes[z];
+  random_map(sizes[z]);
+  actions=(unsigned char *)malloc((size_t)n*4);
+  if (actions==NULL||alloc_route_planner(&rp,&costs)==0||alloc_dstar(&ds,&costs)==0)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  full=0;
+  astar=0;
+  n_replan=0;
+  for (int r=0; r<routes; r++)
+  {
+   start=rand()%(n*4);
+   target=rand()%n;
+   t0=now();
+   plan_route(&rp,start,target,actions,n*4,NULL);
+   astar+=now()-t0;
+
+   dstar_clear_streets(&ds);
+   dstar_set_target(&ds,target);
+   t0=now();
+   len=dstar_plan(&ds,start,actions,n*4,NULL);
+   full+=now()-t0;
+   for (b=0; b<blocks&&len>0; b++)
+   {
+    // Drive a few blocks along the route, find the next street on it blocked, replan from there
+    for (k=0, f=0; k<len&&(actions[k]!=MOVE_FORWARD||f<DRIVE_BLOCKS); k++)
+    {
+     f+=(actions[k]==MOVE_FORWARD);
+     start=move_state(start,actions[k]);
+    }
+    if (k==len) break;
+    dstar_set_street(&ds,start,1);
+    t0=now();
+    len=dstar_plan(&ds,start,actions,n*4,NULL);
+    replan[n_replan++]=now()-t0;
+   }
+  }
+  mean=0;
+  for (k=0; k<n_replan; k++)
+   mean+=replan[k];
+  qsort(replan,n_replan,sizeof(double),compare_doubles);
+  printf("%d %d %.1f %.1f",sizes[z],n*4,full*1e6/routes,astar*1e6/routes);
+  if (n_replan>0) printf(" %.1f %.1f %.1f %d\n",mean*1e6/n_replan,replan[n_replan/2]*1e6,replan[(n_replan*9)/10]*1e6,n_replan);
+  else printf(" - - - 0\n");
+  fflush(stdout);
+
+  free(actions);
+  free_route_planner(&rp);
+  free_dstar(&ds);
+ }
+ free(replan);
+ free_map();
+ return(0);
+}
@@ -0,0 +1,135 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Route planning benchmark. For random maps from 20x20 up to 1000x1000 intersections,
+ runs plan_route() (A* with the Manhattan + turn heuristic) between random start states
+ and target intersections, and reports microseconds and states expanded per query. For
+ maps small enough for the all-pairs route table (EV3_RouteTable.h) it also reports the
+ time to build the table (all available cores) and the time per route_table_walk() query,
+ and checks that the table routes cost the same as the A* routes.
+
+ Usage: bench_route [max_size] [queries]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include "../EV3_Map.h"
+#include "../EV3_RouteTable.h"
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static void random_map(int size)
+{
+ const int colours[3]={2,3,6};
+
+ alloc_map(size,size);
+ for (int i=0; i<size*size; i++)
+  for (int k=0; k<4; k++)
+   map[i][k]=colours[rand()%3];
+ build_map_tables();
+}
+
+static double time_queries(struct route_planner *rp, const int *start, const int *target, int queries, unsigned char *actions, double *expanded, double *total_cost)
+{
+ double t0=now();
+
+ *expanded=0;
+ *total_cost=0;
+ for (int q=0; q<queries; q++)
+ {
+  double c=0;
+  plan_route(rp,start[q],target[q],actions,rp->n*4,&c);
+  *expanded+=rp->expanded;
+  *total_cost+=c;
+ }
+ *expanded/=queries;
+ return((now()-t0)*1e6/queries);
+}
+
+static double time_walks(struct route_table *rt, const int *start, const int *target, int queries, unsigned char *actions, double *total_cost)
+{
+ double t0=now();
+
+ *total_cost=0;
+ for (int q=0; q<queries; q++)
+ {
+  double c=0;
+  route_table_walk(rt,start[q],target[q],actions,rt->n*4,&c);
+  *total_cost+=c;
+ }
+ return((now()-t0)*1e6/queries);
+}
+
+int main(int argc, char *argv[])
+{
+ const int sizes[7]={20,50,100,200,300,500,1000};
+ int max_size=(argc>1)?atoi(argv[1]):1000;
+ int queries=(argc>2)?atoi(argv[2]):200;
+ struct route_costs costs;
+ struct route_planner rp;
+ struct route_table rt;
+ unsigned char *actions;
+ int *start, *target;
+ double us, ex, total, t0, build, walk_total;
+
+ srand(1);
+ default_route_costs(&costs);
+ start=(int *)calloc(queries,sizeof(int));
+ target=(int *)calloc(queries,sizeof(int));
+ if (queries<1||start==NULL||target==NULL)
+ {
+  fprintf(stderr,"Usage: bench_route [max_size] [queries]\n");
+  exit(1);
+ }
+ printf("# size states astar_us astar_expanded table_build_s table_us (per query, table only up to %d intersections)\n",ROUTE_TABLE_MAX_INTERSECTIONS);
+ for (int z=0; z<7&&sizes[z]<=max_size; z++)
+ {
+  int n=sizes[z]*sizes[z];
+  random_map(sizes[z]);
+  actions=(unsigned char *)malloc((size_t)n*4);
+  if (actions==NULL||alloc_route_planner(&rp,&costs)==0)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  for (int q=0; q<queries; q++)
+  {
+   start[q]=rand()%(n*4);
+   target[q]=rand()%n;
+  }
+  printf("%d %d",sizes[z],n*4);
+  us=time_queries(&rp,start,target,queries,actions,&ex,&total);
+  printf(" %.2f %.0f",us,ex);
+  if (n<=ROUTE_TABLE_MAX_INTERSECTIONS)
+  {
+   t0=now();
+   if (build_route_table(&rt,&costs,0)==0)
+   {
+    fprintf(stderr,"Out of memory\n");
+    exit(1);
+   }
+   build=now()-t0;
+   printf(" %.3f %.2f",build,time_walks(&rt,start,target,queries,actions,&walk_total));
+   if (fabs(walk_total-total)>1e-6*total) printf(" # cost mismatch %f vs %f",walk_total,total);
+   free_route_table(&rt);
+  }
+  printf("\n");
+  fflush(stdout);
+
+  free(actions);
+  free_route_planner(&rp);
+ }
+ free(start);
+ free(target);
+ free_map();
+ return(0);
+}
@@ -0,0 +1,253 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Belief measurement update microbenchmark. For random maps from 20x20 up to 1000x1000
+ intersections, times one scan update with each of the kernels in EV3_Beliefs.c and
+ reports nanoseconds per (intersection, direction) state:
+
+   naive    - double beliefs[][], per-building comparison against map[][] for every state,
+              then a separate normalization pass (the textbook implementation)
+   counts   - match_scan_packed() + update_beliefs_counts() (double, AoS)
+   soa      - match_scan_packed_soa() + update_belief_soa() (float SoA, fused multiply/sum)
+   indexed  - update_beliefs_indexed() through the signature index (O(matches))
+   table    - update_beliefs_table() with the precomputed 81x81 likelihood table of
+              EV3_SensorModel.c (one lookup per state)
+   stats    - the same, also collecting the belief statistics (best, runner-up, entropy)
+              in the update pass
+   rescan   - the table update followed by a separate belief_stats() pass, what stats
+              replaces
+   log      - match_scan_packed_soa() + update_belief_log() (float log-domain, no normalization)
+   fix      - match_scan_packed_soa() + update_belief_fix() (fixed-point log-domain, build with
+              -DBELIEF_FIXED_BITS=32 to time the 32-bit variant)
+   sparse   - update_adaptive_belief() once it has switched to sparse top-K mode. Random
+              scans never converge, so this one repeats the scan of a fixed state, with K
+              large enough for every state sharing its signature (the time is still
+              divided by all 4n states, for comparison with the others)
+
+ Usage: bench_update [max_size]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include "../EV3_Map.h"
+#include "../EV3_Beliefs.h"
+#include "../EV3_SensorModel.h"
+#include "../EV3_LogBeliefs.h"
+#include "../EV3_SparseBeliefs.h"
+
+#define MIN_SECONDS 0.2
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static void random_map(int size)
+{
+ const int colours[3]={2,3,6};
+
+ alloc_map(size,size);
+ for (int i=0; i<size*size; i++)
+  for (int k=0; k<4; k++)
+   map[i][k]=colours[rand()%3];
+ build_map_tables();
+}
+
+static void naive_update(double (*b)[4], int n, const int scan[4], double misread)
+{
+ double sum=0;
+
+ for (int i=0; i<n; i++)
+  for (int d=0; d<4; d++)
+  {
+   double l=1.0;
+   for (int k=0; k<4; k++)
+    l*=(map[i][(k+d)&3]==scan[k])?(1.0-misread):(misread/2.0);
+   b[i][d]*=l;
+   sum+=b[i][d];
+  }
+ for (int i=0; i<n; i++)
+  for (int d=0; d<4; d++)
+   b[i][d]/=sum;
+}
+
+int main(int argc, char *argv[])
+{
+ const int sizes[7]={20,50,100,200,300,500,1000};
+ const int colours[3]={2,3,6};
+ int max_size=(argc>1)?atoi(argv[1]):1000;
+ double (*b)[4];
+ double scale, t0, t;
+ unsigned char *counts;
+ struct belief_soa bs;
+ struct belief_log bl;
+ struct belief_fix bf;
+ struct adaptive_belief ab;
+ struct belief_stats st;
+ static struct sensor_model sm;
+ float like[5], loglike[5];
+ belief_fix_t fixlike[5];
+ int scan[4];
+ long reps;
+
+ srand(1);
+ misread_likelihoods(BUILDING_MISREAD_PROB,like);
+ misread_loglikelihoods(BUILDING_MISREAD_PROB,loglike);
+ fix_loglikelihoods(loglike,fixlike);
+ init_sensor_model(&sm,BUILDING_MISREAD_PROB);
+ printf("# size states naive_ns counts_ns soa_ns indexed_ns table_ns stats_ns rescan_ns log_ns fix%d_ns sparse_ns (per state per update)\n",BELIEF_FIXED_BITS);
+ for (int z=0; z<7&&sizes[z]<=max_size; z++)
+ {
+  int n=sizes[z]*sizes[z];
+  random_map(sizes[z]);
+  b=(double (*)[4])malloc((size_t)n*sizeof(double[4]));
+  counts=(unsigned char *)malloc((size_t)n*4);
+  if (b==NULL||counts==NULL||alloc_belief_soa(&bs,n)==0||alloc_belief_log(&bl,n)==0||alloc_belief_fix(&bf,n)==0)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  printf("%d %d",sizes[z],n*4);
+
+  // Each kernel runs until MIN_SECONDS have passed, with a fresh random scan per update
+  init_beliefs(b,n,&scale);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   naive_update(b,n,scan,BUILDING_MISREAD_PROB);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  init_beliefs(b,n,&scale);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   match_scan_packed(scan[0],scan[1],scan[2],scan[3],counts);
+   update_beliefs_counts(b,n,&scale,counts,BUILDING_MISREAD_PROB);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  init_belief_soa(&bs);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   match_scan_packed_soa(scan[0],scan[1],scan[2],scan[3],counts);
+   update_belief_soa(&bs,counts,like,NULL);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  init_beliefs(b,n,&scale);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   update_beliefs_indexed(b,n,&scale,scan_signature(scan[0],scan[1],scan[2],scan[3]),SCAN_MATCH_PROB);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  init_beliefs(b,n,&scale);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   update_beliefs_table(b,n,&scale,scan_signature(scan[0],scan[1],scan[2],scan[3]),&sm,NULL);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  init_beliefs(b,n,&scale);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   update_beliefs_table(b,n,&scale,scan_signature(scan[0],scan[1],scan[2],scan[3]),&sm,&st);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  init_beliefs(b,n,&scale);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   update_beliefs_table(b,n,&scale,scan_signature(scan[0],scan[1],scan[2],scan[3]),&sm,NULL);
+   belief_stats(b,n,&st);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  init_belief_log(&bl);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   match_scan_packed_soa(scan[0],scan[1],scan[2],scan[3],counts);
+   update_belief_log(&bl,counts,loglike);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  init_belief_fix(&bf);
+  reps=0;
+  t0=now();
+  do
+  {
+   for (int k=0; k<4; k++) scan[k]=colours[rand()%3];
+   match_scan_packed_soa(scan[0],scan[1],scan[2],scan[3],counts);
+   update_belief_fix(&bf,counts,fixlike);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f",(t*1e9)/((double)reps*n*4));
+
+  // Without motion the mass can only concentrate on the states sharing the signature, so
+  // K and the entropy threshold are sized to hold all of them
+  int sig=map_sig[rand()%(n*4)];
+  int matches=map_sig_start[sig+1]-map_sig_start[sig];
+  if (alloc_adaptive_belief(&ab,n,2*matches)==0)
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+  ab.enter_entropy=log2((double)matches)+1.0;
+  for (int k=0; k<4; k++) update_adaptive_belief(&ab,sig,SCAN_MATCH_PROB);
+  reps=0;
+  t0=now();
+  do
+  {
+   update_adaptive_belief(&ab,sig,SCAN_MATCH_PROB);
+   reps++;
+  } while ((t=now()-t0)<MIN_SECONDS);
+  printf(" %.3f%s\n",(t*1e9)/((double)reps*n*4),ab.sparse?"":"(dense)");
+  fflush(stdout);
+
+  free(b);
+  free(counts);
+  free_belief_soa(&bs);
+  free_belief_log(&bl);
+  free_belief_fix(&bf);
+  free_adaptive_belief(&ab);
+ }
+ free_map();
+ return(0);
+}
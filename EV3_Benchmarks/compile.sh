@@ -0,0 +1,12 @@
+g++ -O2 -march=native map_gen.c -o map_gen
+g++ -O2 -march=native bench_parse.c ../EV3_Map.c ../EV3_Threads.c -pthread -o bench_parse
+g++ -O2 -march=native bench_update.c ../EV3_Map.c ../EV3_Beliefs.c ../EV3_SensorModel.c ../EV3_LogBeliefs.c ../EV3_SparseBeliefs.c ../EV3_Threads.c -pthread -o bench_update
+g++ -O2 -march=native bench_motion.c ../EV3_Map.c ../EV3_Beliefs.c ../EV3_SparseBeliefs.c ../EV3_Motion.c ../EV3_Threads.c -pthread -o bench_motion
+g++ -O2 -march=native bench_particles.c ../EV3_Map.c ../EV3_Particles.c ../EV3_Threads.c -pthread -o bench_particles
+g++ -O2 -march=native mc_localize.c ../EV3_Map.c ../EV3_Beliefs.c ../EV3_SensorModel.c ../EV3_SparseBeliefs.c ../EV3_Motion.c ../EV3_Explore.c ../EV3_Planner.c ../EV3_QMDP.c ../EV3_Threads.c -pthread -o mc_localize
+g++ -O2 -march=native bench_route.c ../EV3_Map.c ../EV3_MapCache.c ../EV3_Beliefs.c ../EV3_SparseBeliefs.c ../EV3_Motion.c ../EV3_Planner.c ../EV3_RouteTable.c ../EV3_Threads.c -pthread -o bench_route
+g++ -O2 -march=native bench_replan.c ../EV3_Map.c ../EV3_Beliefs.c ../EV3_SparseBeliefs.c ../EV3_Motion.c ../EV3_Planner.c ../EV3_DStar.c ../EV3_Threads.c -pthread -o bench_replan
+g++ -O2 -march=native bench_coop.c ../EV3_Map.c ../EV3_Beliefs.c ../EV3_SparseBeliefs.c ../EV3_Motion.c ../EV3_Planner.c ../EV3_Cooperative.c ../EV3_Threads.c -pthread -o bench_coop
+g++ -O2 -march=native bench_executor.c ../EV3_Map.c ../EV3_Beliefs.c ../EV3_SparseBeliefs.c ../EV3_Motion.c ../EV3_Planner.c ../EV3_Executor.c ../EV3_Threads.c -pthread -o bench_executor
+g++ -O2 -march=native bench_batch.c ../EV3_Map.c ../EV3_Beliefs.c ../EV3_SparseBeliefs.c ../EV3_Motion.c ../EV3_Planner.c ../EV3_RouteBatch.c ../EV3_Threads.c -pthread -o bench_batch
+g++ -O2 -march=native map_ambiguity.c ../EV3_Map.c ../EV3_MapCache.c ../EV3_Beliefs.c ../EV3_SparseBeliefs.c ../EV3_Motion.c ../EV3_Explore.c ../EV3_Ambiguity.c ../EV3_Threads.c -pthread -o map_ambiguity
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Generates the standard benchmark corpus into ./corpus using fixed seeds, so every
+# machine benchmarks exactly the same maps. Pass --small to skip the maps over 100x100
+# (the 2000x2000 map alone is a 768MB image).
+#
+#   name                        grid        scale  irregularity  ambiguity  seed
+mkdir -p corpus
+gen() {
+ if [ ! -f corpus/$1.ppm ]; then ./map_gen -x $2 -y $3 -s $4 -i $5 -a $6 -r $7 corpus/$1.ppm || exit 1; fi
+}
+gen grid_5x5                    5    5      16     0.0           0.0        1
+gen grid_20x20                  20   20     8      0.0           0.0        2
+gen grid_20x20_irregular        20   20     8      0.8           0.0        3
+gen grid_20x20_ambiguous        20   20     8      0.0           0.6        4
+gen grid_100x100                100  100    4      0.0           0.0        5
+gen grid_100x100_irregular      100  100    6      0.8           0.3        6
+gen grid_100x100_ambiguous      100  100    4      0.0           0.9        7
+if [ "$1" = "--small" ]; then exit 0; fi
+gen grid_500x500                500  500    2      0.0           0.0        8
+gen grid_1000x1000              1000 1000   2      0.0           0.0        9
+gen grid_1000x1000_ambiguous    1000 1000   2      0.0           0.6        10
+gen grid_2000x2000              2000 2000   2      0.0           0.0        11
+gen grid_200x200_highres        200  200    24     0.8           0.0        12
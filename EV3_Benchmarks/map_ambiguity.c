@@ -0,0 +1,153 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Offline map ambiguity analyzer. For each map, runs build_ambiguity() (EV3_Ambiguity.h)
+ and saves the result next to the image (map.ppm.amb), where EV3_Localization picks it
+ up. Maps are read through the compiled map cache, so a map parsed before (by this tool
+ or the robot) is not parsed again.
+
+ For each map it prints the time taken, the refinement rounds, the classes of states the
+ look-ahead can not tell apart (count, states in them, largest), their separating
+ sequences (mean and longest), and the groups of states that no sequence tells apart.
+ Every stored sequence is then checked by driving it (noise free) from every member of
+ its class: the scans along the way must split the class, or it is counted as failed.
+
+ Usage: map_ambiguity [-d horizon] [-t threads] [-n] map.ppm [map.ppm ...]
+
+   -d n     Look-ahead the classes are built for (default EXPLORE_DEPTH)
+   -t n     Threads (default: all cores)
+   -n       Do not save the analysis
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../EV3_Map.h"
+#include "../EV3_Explore.h"
+#include "../EV3_Ambiguity.h"
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static int read_map(const char *name)
+{
+ unsigned char *img;
+ int rx, ry, ok;
+
+ if (load_map_cache(name)) return(1);
+ img=readPPMimage(name,&rx,&ry);
+ if (img==NULL) return(0);
+ ok=(rx*(long)ry>PARALLEL_PARSE_PIXELS)?parse_map_parallel(img,rx,ry,0):parse_map(img,rx,ry);
+ free(img);
+ if (ok) save_map_cache(name);
+ return(ok);
+}
+
+static long failed_sequences(const struct ambiguity *amb)
+{
+ // Classes whose sequence gives every member the same scans
+ unsigned long long *first;
+ long bad=0;
+ char *split;
+
+ first=(unsigned long long *)calloc(amb->n_classes+1,sizeof(unsigned long long));
+ split=(char *)calloc(amb->n_classes+1,1);
+ if (first==NULL||split==NULL)
+ {
+  free(first);
+  free(split);
+  return(-1);
+ }
+ for (int s=0; s<amb->n*4; s++)
+ {
+  int c=amb->class_of[s], t=s;
+  unsigned long long h=0;
+
+  if (c<0) continue;
+  for (int k=0; k<amb->classes[c].level; k++)
+  {
+   t=macro_move(t,amb->actions[amb->classes[c].seq+k]);
+   h=(h*131)+map_sig[t]+1;
+  }
+  h|=1ULL<<63;
+  if (first[c]==0) first[c]=h;
+  else if (first[c]!=h) split[c]=1;
+ }
+ for (int c=0; c<amb->n_classes; c++)
+  bad+=!split[c];
+ free(first);
+ free(split);
+ return(bad);
+}
+
+int main(int argc, char *argv[])
+{
+ struct ambiguity amb;
+ int opt, horizon=EXPLORE_DEPTH, threads=0, save=1;
+ double t0, t;
+
+ while ((opt=getopt(argc,argv,"d:t:n"))!=-1)
+ {
+  switch (opt)
+  {
+   case 'd': horizon=atoi(optarg); break;
+   case 't': threads=atoi(optarg); break;
+   case 'n': save=0; break;
+   default:
+    fprintf(stderr,"Usage: map_ambiguity [-d horizon] [-t threads] [-n] map.ppm [map.ppm ...]\n");
+    exit(1);
+  }
+ }
+ if (optind>=argc||horizon<0||threads<0)
+ {
+  fprintf(stderr,"Usage: map_ambiguity [-d horizon] [-t threads] [-n] map.ppm [map.ppm ...]\n");
+  exit(1);
+ }
+ parse_verbose=0;
+
+ printf("# map size_x size_y threads seconds rounds classes class_states largest_class mean_sequence longest_sequence equiv_groups equiv_states failed\n");
+ for (int m=optind; m<argc; m++)
+ {
+  long in_class=0, in_equiv=0, largest=0, longest=0, bad;
+  double mean=0;
+
+  if (read_map(argv[m])==0)
+  {
+   fprintf(stderr,"Unable to read map %s\n",argv[m]);
+   continue;
+  }
+  t0=now();
+  if (build_ambiguity(&amb,horizon,threads)==0)
+  {
+   fprintf(stderr,"Out of memory analysing %s\n",argv[m]);
+   free_map();
+   continue;
+  }
+  t=now()-t0;
+  for (int c=0; c<amb.n_classes; c++)
+  {
+   in_class+=amb.classes[c].size;
+   if (amb.classes[c].size>largest) largest=amb.classes[c].size;
+   if (amb.classes[c].level>longest) longest=amb.classes[c].level;
+   mean+=amb.classes[c].level;
+  }
+  for (int s=0; s<sx*sy*4; s++)
+   in_equiv+=(amb.equiv[s]>=0);
+  bad=failed_sequences(&amb);
+  printf("%s %d %d %d %.3f %d %d %ld %ld %.2f %ld %d %ld %ld\n",argv[m],sx,sy,(threads>0)?threads:default_threads(),t,
+         amb.levels,amb.n_classes,in_class,largest,(amb.n_classes>0)?mean/amb.n_classes:0.0,longest,amb.n_equiv,in_equiv,bad);
+  fflush(stdout);
+  if (save&&save_ambiguity(&amb,argv[m])==0) fprintf(stderr,"Unable to save the analysis of %s\n",argv[m]);
+  free_ambiguity(&amb);
+  free_map();
+ }
+ return(0);
+}
@@ -0,0 +1,235 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Procedural map generator. Writes .ppm maps that parse_map() accepts, in the same style
+ as Map1.ppm: a red border, black streets with yellow intersections, and up to four
+ blue/green/white buildings in the corners around every intersection.
+
+ Usage: map_gen [options] output.ppm
+
+   -x n     Intersections along x (default 20, 1 - 2000)
+   -y n     Intersections along y (default 20, 1 - 2000)
+   -s n     Pixel scale - street/intersection width in pixels (default 8, minimum 2).
+            Blocks between streets are 3x this width.
+   -i f     Spacing irregularity, 0 - 1 (default 0). Shifts each street line and resizes
+            each building randomly, within the tolerance parse_map() can still read.
+   -a f     Colour ambiguity, 0 - 1 (default 0). The probability that an intersection
+            copies one of a few repeated building patterns instead of getting random
+            colours - high values produce maps with many indistinguishable locations.
+   -r n     Random seed (default 1). The same options and seed always give the same map.
+
+ Images are written one row at a time, so a 2000x2000 map at scale 2 (16000x16000
+ pixels, 768MB as a .ppm) only needs the per-intersection tables in memory.
+
+ Geometry notes - parse_map() measures the spacing from the first intersection to its
+ right and bottom neighbours, and then samples every intersection and building at that
+ fixed spacing. So:
+  * The first two street lines in each direction are never shifted
+  * Street lines shift by at most (scale-2)/2 pixels, so the sampled intersection centre
+    stays on yellow and the building samples (one intersection width out diagonally)
+    stay off the street
+  * Buildings always cover the sampled pixel, irregularity only changes their outer edges
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_SIZE 2000
+#define N_MOTIFS 4              // Distinct repeated patterns used for colour ambiguity
+
+// Building colours in the map, 0 means no building (white)
+static const unsigned char building_rgb[3][3]={{0,0,255},{0,255,0},{255,255,255}};
+
+static unsigned long long rng_state;
+
+static unsigned long long rng_next(void)
+{
+ // splitmix64 - small, fast, and gives the same sequence on every platform
+ unsigned long long z=(rng_state+=0x9E3779B97F4A7C15ULL);
+ z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+ z=(z^(z>>27))*0x94D049BB133111EBULL;
+ return(z^(z>>31));
+}
+
+static double rng_uniform(void)
+{
+ return((rng_next()>>11)*(1.0/9007199254740992.0));
+}
+
+static int rng_range(int lo, int hi)
+{
+ // Uniform integer in [lo, hi]
+ if (hi<=lo) return(lo);
+ return(lo+(int)(rng_next()%(unsigned long long)(hi-lo+1)));
+}
+
+int main(int argc, char *argv[])
+{
+ int gx, gy, w, b, m, jmax, bmin, bmax;
+ double irregularity, ambiguity;
+ unsigned long long seed;
+ int *street_x, *street_y;                // Left/top pixel of each street line
+ unsigned char *colours;                  // 4 building codes per intersection (0 blue, 1 green, 2 white)
+ short *ext;                              // Building extents, (x,y) per corner per intersection
+ unsigned char motifs[N_MOTIFS][4];
+ unsigned char *row;
+ long rx, ry;
+ FILE *f;
+ int opt;
+
+ gx=gy=20;
+ w=8;
+ irregularity=0;
+ ambiguity=0;
+ seed=1;
+ while ((opt=getopt(argc,argv,"x:y:s:i:a:r:"))!=-1)
+ {
+  switch (opt)
+  {
+   case 'x': gx=atoi(optarg); break;
+   case 'y': gy=atoi(optarg); break;
+   case 's': w=atoi(optarg); break;
+   case 'i': irregularity=atof(optarg); break;
+   case 'a': ambiguity=atof(optarg); break;
+   case 'r': seed=strtoull(optarg,NULL,10); break;
+   default:
+    fprintf(stderr,"Usage: map_gen [-x size_x] [-y size_y] [-s scale] [-i irregularity] [-a ambiguity] [-r seed] output.ppm\n");
+    exit(1);
+  }
+ }
+ if (optind>=argc||gx<1||gy<1||gx>MAX_SIZE||gy>MAX_SIZE||w<2||
+     irregularity<0||irregularity>1||ambiguity<0||ambiguity>1)
+ {
+  fprintf(stderr,"Usage: map_gen [-x size_x] [-y size_y] [-s scale] [-i irregularity] [-a ambiguity] [-r seed] output.ppm\n");
+  fprintf(stderr,"    sizes 1-%d, scale >= 2, irregularity and ambiguity in [0,1]\n",MAX_SIZE);
+  exit(1);
+ }
+ rng_state=seed;
+
+ // Layout: red border (w) | half block (m) | street | block (b) | street | ... | half block | red border
+ b=3*w;
+ m=(b+1)/2;
+ jmax=(int)(irregularity*((w-2)/2));
+ bmax=(b/2)-1-jmax;                       // Largest building extent that can not touch its neighbour
+ bmin=(w/2)+jmax+1;                       // Smallest extent that still covers the sampled pixel
+ if (bmin>bmax) bmin=bmax;
+ rx=(2*w)+(2*m)+((long)gx*w)+((long)(gx-1)*b);
+ ry=(2*w)+(2*m)+((long)gy*w)+((long)(gy-1)*b);
+
+ street_x=(int *)calloc(gx,sizeof(int));
+ street_y=(int *)calloc(gy,sizeof(int));
+ colours=(unsigned char *)calloc((size_t)gx*gy*4,sizeof(unsigned char));
+ ext=(short *)calloc((size_t)gx*gy*8,sizeof(short));
+ row=(unsigned char *)calloc(rx*3,sizeof(unsigned char));
+ if (street_x==NULL||street_y==NULL||colours==NULL||ext==NULL||row==NULL)
+ {
+  fprintf(stderr,"Out of memory generating a %d x %d map\n",gx,gy);
+  exit(1);
+ }
+
+ for (int i=0; i<gx; i++)
+  street_x[i]=w+m+(i*(w+b))+((i>1)?rng_range(-jmax,jmax):0);
+ for (int j=0; j<gy; j++)
+  street_y[j]=w+m+(j*(w+b))+((j>1)?rng_range(-jmax,jmax):0);
+
+ for (int k=0; k<N_MOTIFS; k++)
+  for (int q=0; q<4; q++)
+   motifs[k][q]=(unsigned char)rng_range(0,2);
+ for (long idx=0; idx<(long)gx*gy; idx++)
+ {
+  int k=(rng_uniform()<ambiguity)?rng_range(0,N_MOTIFS-1):-1;
+  for (int q=0; q<4; q++)
+  {
+   colours[(idx*4)+q]=(k>=0)?motifs[k][q]:(unsigned char)rng_range(0,2);
+   ext[(idx*8)+(q*2)]=(short)rng_range(bmin,bmax);
+   ext[(idx*8)+(q*2)+1]=(short)rng_range(bmin,bmax);
+  }
+ }
+
+ f=fopen(argv[optind],"wb");
+ if (f==NULL)
+ {
+  fprintf(stderr,"Unable to open %s for writing\n",argv[optind]);
+  exit(1);
+ }
+ fprintf(f,"P6\n# map_gen %dx%d scale=%d irregularity=%.3f ambiguity=%.3f seed=%llu\n%ld %ld\n255\n",
+         gx,gy,w,irregularity,ambiguity,seed,rx,ry);
+
+ for (long y=0; y<ry; y++)
+ {
+  memset(row,255,rx*3);
+  if (y<w||y>=ry-w)
+  {
+   for (long x=0; x<rx; x++) {row[x*3]=255; row[(x*3)+1]=0; row[(x*3)+2]=0;}
+   fwrite(row,rx*3,1,f);
+   continue;
+  }
+
+  // Buildings - only the intersection rows next to this pixel row can reach it
+  int j0=(int)((y-w-m)/(w+b));
+  for (int j=j0-1; j<=j0+1; j++)
+  {
+   if (j<0||j>=gy) continue;
+   for (int i=0; i<gx; i++)
+   {
+    long idx=i+((long)j*gx);
+    for (int q=0; q<4; q++)
+    {
+     int c=colours[(idx*4)+q];
+     int ex=ext[(idx*8)+(q*2)], ey=ext[(idx*8)+(q*2)+1];
+     long x0,x1,y0,y1;
+     if (c==2) continue;                                  // White, nothing to draw
+     // Corner q is 0 - top-left, 1 - top-right, 2 - bottom-right, 3 - bottom-left
+     if (q==0||q==3) {x0=street_x[i]-ex; x1=street_x[i];}
+     else {x0=street_x[i]+w; x1=street_x[i]+w+ex;}
+     if (q<2) {y0=street_y[j]-ey; y1=street_y[j];}
+     else {y0=street_y[j]+w; y1=street_y[j]+w+ey;}
+     if (y<y0||y>=y1) continue;
+     for (long x=x0; x<x1; x++)
+      memcpy(&row[x*3],&building_rgb[c][0],3);
+    }
+   }
+  }
+
+  // Streets (black), and intersections (yellow) where a horizontal street crosses them
+  int hstreet=0;
+  for (int j=j0-1; j<=j0+1; j++)
+   if (j>=0&&j<gy&&y>=street_y[j]&&y<street_y[j]+w) hstreet=1;
+  if (hstreet)
+  {
+   for (long x=w; x<rx-w; x++) {row[x*3]=0; row[(x*3)+1]=0; row[(x*3)+2]=0;}
+   for (int i=0; i<gx; i++)
+    for (long x=street_x[i]; x<street_x[i]+w; x++) {row[x*3]=255; row[(x*3)+1]=255; row[(x*3)+2]=0;}
+  }
+  else
+  {
+   for (int i=0; i<gx; i++)
+    for (long x=street_x[i]; x<street_x[i]+w; x++) {row[x*3]=0; row[(x*3)+1]=0; row[(x*3)+2]=0;}
+  }
+
+  // Red border on the sides
+  for (long x=0; x<w; x++)
+  {
+   row[x*3]=255; row[(x*3)+1]=0; row[(x*3)+2]=0;
+   row[(rx-1-x)*3]=255; row[((rx-1-x)*3)+1]=0; row[((rx-1-x)*3)+2]=0;
+  }
+  fwrite(row,rx*3,1,f);
+ }
+ if (fclose(f)!=0)
+ {
+  fprintf(stderr,"Error writing %s\n",argv[optind]);
+  exit(1);
+ }
+ fprintf(stderr,"Wrote %s: %d x %d intersections, %ld x %ld pixels\n",argv[optind],gx,gy,rx,ry);
+
+ free(street_x);
+ free(street_y);
+ free(colours);
+ free(ext);
+ free(row);
+ return(0);
+}
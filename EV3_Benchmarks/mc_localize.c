@@ -0,0 +1,338 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Headless Monte Carlo localization harness. Runs many simulated localization episodes on
+ a map, in parallel over all cores, and reports how well the localization loop of
+ robot_localization() does:
+
+  * Each episode starts the simulated robot at a random intersection and heading, with
+    uniform beliefs, and repeats: drive to the next intersection, scan, update, check
+    whether one state has LOCALIZED_PROB, pick the next move (information gain, or a
+    fixed turn-right-every-third pattern with -x) - the same steps as robot_localization()
+  * The simulated robot misreads each building with the given probability, and its moves
+    fail (slip, overshoot, turn failure, over-turn) at the given rates. The filter itself
+    uses the default motion model and the sensor model from the calibration file given
+    with -c (the default sensor model without it), as on the real robot.
+  * An episode ends when the robot is localized (right or wrong) or after -k steps.
+  * With -g every episode also has a random target, and reports the cost to reach it: the
+    route costs (EV3_Planner.h) of the drives and turns made while localizing, plus the
+    cost of a cheapest route from where the robot really is when it is localized. With
+    -q the robot hands over from information-gain exploration to QMDP (EV3_QMDP.h) once
+    the entropy of the beliefs is at most the given number of bits, and heads for the
+    target while it finishes localizing - compare against -g alone.
+
+ Output: episodes/second, the fraction localized correctly, wrongly, or not at all, and
+ the distribution (mean, percentiles, histogram) of scans needed for the correct ones,
+and with -g the mean cost to the target over the correct ones.
+
+ Usage: mc_localize [options] map.ppm
+   -n n     Episodes (default 2000)
+   -t n     Threads (default: all cores, or EV3_THREADS)
+   -m f     Per-building colour misread probability (default 0.05)
+   -s f     Slip probability - forward move does not happen (default 0.05)
+   -o f     Overshoot probability - drives past the next intersection (default 0.05)
+   -f f     Turn failure probability (default 0.05)
+   -v f     Over-turn probability (default 0.02)
+   -k n     Max steps per episode (default 100)
+   -d n     Information-gain look-ahead depth (default EXPLORE_DEPTH)
+   -x       Use the fixed exploration pattern instead of information gain
+   -r n     Random seed (default 1)
+   -c file  Sensor calibration file (see EV3_SensorModel.h)
+   -g       Random target per episode, report the cost to reach it
+   -q f     Head for the target with QMDP once the entropy is at most f bits (implies -g)
+
+ Results are reproducible for a given seed, whatever the number of threads.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include "../EV3_Map.h"
+#include "../EV3_Beliefs.h"
+#include "../EV3_SensorModel.h"
+#include "../EV3_Motion.h"
+#include "../EV3_Explore.h"
+#include "../EV3_QMDP.h"
+#include "../EV3_Threads.h"
+
+#define LOCALIZED_PROB 0.9          // Same as EV3_Localization.h
+#define FIXED_TURN_EVERY 3
+
+struct mc_worker{
+ double (*b)[4];
+ double (*tmp)[4];
+ struct explorer ex;
+ struct route_planner rp;   // -g: route costs to the target
+ struct qmdp_policy qp;
+};
+
+struct mc_run{
+ struct motion_model mm;
+ struct motion_noise true_noise;
+ struct sensor_model sensor;
+ double misread;
+ int max_steps;
+ int fixed;
+ unsigned long long seed;
+ struct mc_worker *workers;
+ int goal;                  // -g
+ double qmdp_entropy;       // -q, negative if not set
+ int *steps;                // Per episode - scans taken, negative if localized wrongly, 0 if never
+ double *spent;             // -g: per episode - cost of the moves made while localizing...
+ double *remaining;         // ... and of a cheapest route on from the true state
+};
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+static inline unsigned long long splitmix64(unsigned long long *s)
+{
+ unsigned long long z=(*s+=0x9E3779B97F4A7C15ULL);
+ z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+ z=(z^(z>>27))*0x94D049BB133111EBULL;
+ return(z^(z>>31));
+}
+
+static inline double uniform01(unsigned long long *s)
+{
+ return((double)(splitmix64(s)>>11)*(1.0/9007199254740992.0));
+}
+
+static int simulated_scan(int state, double misread, unsigned long long *rng)
+{
+ // Signature read at state, each building misread as one of the two other colours
+ int idx=state/4, d=state&3, code[4];
+
+ for (int k=0; k<4; k++)
+ {
+  code[k]=colour_code(map[idx][(k+d)&3]);
+  if (uniform01(rng)<misread) code[k]=(code[k]+1+(int)(uniform01(rng)*2.0))%3;
+ }
+ return(code[0]+(3*code[1])+(9*code[2])+(27*code[3]));
+}
+
+static void episode(int task, int worker, void *arg)
+{
+ struct mc_run *run=(struct mc_run *)arg;
+ struct mc_worker *w=&run->workers[worker];
+ unsigned long long rng=run->seed^((unsigned long long)task*0xD1B54A32D192ED03ULL);
+ double (*t)[4];
+ double scale;
+ struct belief_stats stats;
+ const struct route_costs *c=&w->rp.cost;
+ int n=sx*sy, truth, target=0, action;
+ double spent=0;
+
+ splitmix64(&rng);
+ truth=(int)(uniform01(&rng)*n*4);
+ if (run->goal)
+ {
+  target=(int)(uniform01(&rng)*n);
+  build_qmdp(&w->qp,&w->rp,target);  // Also leaves the cost to the target of every state in rp.g[]
+ }
+ init_beliefs(w->b,n,&scale);
+ run->steps[task]=0;
+ stats.entropy=HUGE_VAL;
+ for (int step=0; step<run->max_steps; step++)
+ {
+  truth=sample_move(&run->true_noise,truth,MOVE_FORWARD,uniform01(&rng));
+  spent+=c->forward;
+  predict_beliefs(&run->mm,MOVE_FORWARD,w->b,w->tmp);
+  t=w->b; w->b=w->tmp; w->tmp=t;
+  update_beliefs_table(w->b,n,&scale,simulated_scan(truth,run->misread,&rng),&run->sensor,&stats);
+  if (stats.p_best>=LOCALIZED_PROB)
+  {
+   run->steps[task]=(stats.best==truth)?step+1:-(step+1);
+   if (run->goal)
+   {
+    run->spent[task]=spent;
+    run->remaining[task]=w->rp.g[truth];
+   }
+   return;
+  }
+
+  if (run->qmdp_entropy>=0&&stats.entropy<=run->qmdp_entropy) action=qmdp_action(&w->qp,w->b,NULL);
+  else if (run->fixed) action=(step%FIXED_TURN_EVERY==FIXED_TURN_EVERY-1)?MOVE_RIGHT:MOVE_FORWARD;
+  else action=select_action(&w->ex,w->b,n,scale,NULL);
+  if (action!=MOVE_FORWARD)
+  {
+   spent+=(action==MOVE_UTURN)?c->uturn:c->turn;
+   truth=sample_move(&run->true_noise,truth,action,uniform01(&rng));
+   predict_beliefs(&run->mm,action,w->b,w->tmp);
+   t=w->b; w->b=w->tmp; w->tmp=t;
+  }
+ }
+}
+
+static int by_value(const void *a, const void *b)
+{
+ return(*(const int *)a-*(const int *)b);
+}
+
+int main(int argc, char *argv[])
+{
+ static struct mc_run run;
+ struct motion_noise model;
+ struct route_costs costs;
+ unsigned char *img;
+ int rx, ry, opt, episodes, threads, depth, good, wrong, lost, *sorted, hist_max;
+ double t0, t, mean, spent, remaining;
+
+ memset(&run,0,sizeof(struct mc_run));
+ default_motion_noise(&run.true_noise);
+ run.misread=0.05;
+ run.max_steps=100;
+ run.seed=1;
+ run.qmdp_entropy=-1;
+ episodes=2000;
+ threads=default_threads();
+ depth=EXPLORE_DEPTH;
+ init_sensor_model(&run.sensor,BUILDING_MISREAD_PROB);
+ while ((opt=getopt(argc,argv,"n:t:m:s:o:f:v:k:d:xr:c:gq:"))!=-1)
+ {
+  switch (opt)
+  {
+   case 'n': episodes=atoi(optarg); break;
+   case 't': threads=atoi(optarg); break;
+   case 'm': run.misread=atof(optarg); break;
+   case 's': run.true_noise.slip=atof(optarg); break;
+   case 'o': run.true_noise.overshoot=atof(optarg); break;
+   case 'f': run.true_noise.turn_fail=atof(optarg); break;
+   case 'v': run.true_noise.over_turn=atof(optarg); break;
+   case 'k': run.max_steps=atoi(optarg); break;
+   case 'd': depth=atoi(optarg); break;
+   case 'x': run.fixed=1; break;
+   case 'r': run.seed=strtoull(optarg,NULL,10); break;
+   case 'c':
+    if (load_sensor_model(&run.sensor,optarg)==0)
+    {
+     fprintf(stderr,"Unable to read sensor calibration %s\n",optarg);
+     exit(1);
+    }
+    break;
+   case 'g': run.goal=1; break;
+   case 'q': run.goal=1; run.qmdp_entropy=atof(optarg); break;
+   default:
+    fprintf(stderr,"Usage: mc_localize [-n episodes] [-t threads] [-m misread] [-s slip] [-o overshoot] [-f turn_fail] [-v over_turn] [-k max_steps] [-d depth] [-x] [-r seed] [-c calibration] [-g] [-q entropy] map.ppm\n");
+    exit(1);
+  }
+ }
+ if (optind>=argc||episodes<1||threads<1||run.max_steps<1)
+ {
+  fprintf(stderr,"Usage: mc_localize [-n episodes] [-t threads] [-m misread] [-s slip] [-o overshoot] [-f turn_fail] [-v over_turn] [-k max_steps] [-d depth] [-x] [-r seed] [-c calibration] [-g] [-q entropy] map.ppm\n");
+  exit(1);
+ }
+
+ parse_verbose=0;
+ img=readPPMimage(argv[optind],&rx,&ry);
+ if (img==NULL||(rx*(long)ry>PARALLEL_PARSE_PIXELS?parse_map_parallel(img,rx,ry,0):parse_map(img,rx,ry))==0)
+ {
+  fprintf(stderr,"Unable to read map %s\n",argv[optind]);
+  exit(1);
+ }
+ free(img);
+
+ default_motion_noise(&model);
+ default_route_costs(&costs);
+ run.steps=(int *)calloc(episodes,sizeof(int));
+ run.spent=(double *)calloc(episodes,sizeof(double));
+ run.remaining=(double *)calloc(episodes,sizeof(double));
+ run.workers=(struct mc_worker *)calloc(threads,sizeof(struct mc_worker));
+ if (run.steps==NULL||run.spent==NULL||run.remaining==NULL||run.workers==NULL||build_motion_model(&run.mm,&model)==0)
+ {
+  fprintf(stderr,"Out of memory\n");
+  exit(1);
+ }
+ for (int w=0; w<threads; w++)
+ {
+  run.workers[w].b=(double (*)[4])calloc(sx*sy,sizeof(double[4]));
+  run.workers[w].tmp=(double (*)[4])calloc(sx*sy,sizeof(double[4]));
+  if (run.workers[w].b==NULL||run.workers[w].tmp==NULL||
+      (!run.fixed&&alloc_explorer(&run.workers[w].ex,depth,EXPLORE_SUPPORT,1)==0)||
+      (run.goal&&(alloc_route_planner(&run.workers[w].rp,&costs)==0||alloc_qmdp(&run.workers[w].qp)==0)))
+  {
+   fprintf(stderr,"Out of memory\n");
+   exit(1);
+  }
+ }
+
+ t0=now();
+ run_parallel(episodes,threads,episode,&run);
+ t=now()-t0;
+
+ // Summary
+ sorted=(int *)calloc(episodes,sizeof(int));
+ good=wrong=lost=0;
+ mean=0;
+ spent=0;
+ remaining=0;
+ hist_max=0;
+ for (int e=0; e<episodes; e++)
+ {
+  if (run.steps[e]>0)
+  {
+   sorted[good++]=run.steps[e];
+   mean+=run.steps[e];
+   spent+=run.spent[e];
+   remaining+=run.remaining[e];
+   if (run.steps[e]>hist_max) hist_max=run.steps[e];
+  }
+  else if (run.steps[e]<0) wrong++;
+  else lost++;
+ }
+ qsort(sorted,good,sizeof(int),by_value);
+ printf("map %s (%d x %d), %s exploration, misread %.3f, slip %.3f, overshoot %.3f, turn_fail %.3f, over_turn %.3f\n",
+        argv[optind],sx,sy,run.fixed?"fixed":"information-gain",run.misread,run.true_noise.slip,
+        run.true_noise.overshoot,run.true_noise.turn_fail,run.true_noise.over_turn);
+ printf("episodes %d  threads %d  seconds %.3f  episodes/s %.1f\n",episodes,threads,t,episodes/t);
+ printf("localized correctly %.2f%%  wrongly %.2f%%  not within %d steps %.2f%%\n",
+        100.0*good/episodes,100.0*wrong/episodes,run.max_steps,100.0*lost/episodes);
+ if (good>0)
+ {
+  printf("steps to localize: mean %.2f  p50 %d  p90 %d  p99 %d  max %d\n",mean/good,
+         sorted[good/2],sorted[(int)(good*0.9)],sorted[(int)(good*0.99)],sorted[good-1]);
+  if (run.goal)
+   printf("cost to target (%s): mean %.2f  spent localizing %.2f  route on from there %.2f\n",
+          (run.qmdp_entropy>=0)?"QMDP":"localize first",(spent+remaining)/good,spent/good,remaining/good);
+  printf("# steps episodes\n");
+  for (int s=1, e=0; s<=hist_max; s++)
+  {
+   int c=0;
+   while (e<good&&sorted[e]==s)
+   {
+    c++;
+    e++;
+   }
+   if (c>0) printf("%d %d\n",s,c);
+  }
+ }
+
+ for (int w=0; w<threads; w++)
+ {
+  free(run.workers[w].b);
+  free(run.workers[w].tmp);
+  if (!run.fixed) free_explorer(&run.workers[w].ex);
+  if (run.goal)
+  {
+   free_route_planner(&run.workers[w].rp);
+   free_qmdp(&run.workers[w].qp);
+  }
+ }
+ free(run.workers);
+ free(run.steps);
+ free(run.spent);
+ free(run.remaining);
+ free(sorted);
+ free_motion_model(&run.mm);
+ free_map();
+ return(0);
+}
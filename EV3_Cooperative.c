@@ -0,0 +1,384 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Cooperative route planning for several robots - see EV3_Cooperative.h
+
+*/
+
+#include <math.h>
+#include "EV3_Cooperative.h"
+
+/* Open-addressing hash table with generation stamps */
+
+static void hash_free(struct coop_hash *h)
+{
+ free(h->key);
+ free(h->value);
+ free(h->stamp);
+ memset(h,0,sizeof(struct coop_hash));
+}
+
+static int hash_alloc(struct coop_hash *h, size_t cap)
+{
+ h->key=(unsigned long long *)calloc(cap,sizeof(unsigned long long));
+ h->value=(int *)calloc(cap,sizeof(int));
+ h->stamp=(unsigned int *)calloc(cap,sizeof(unsigned int));
+ h->generation=1;
+ h->cap=cap;
+ h->count=0;
+ if (h->key==NULL||h->value==NULL||h->stamp==NULL)
+ {
+  hash_free(h);
+  return(0);
+ }
+ return(1);
+}
+
+static void hash_clear(struct coop_hash *h)
+{
+ h->generation++;
+ if (h->generation==0)
+ {
+  // Stamps wrapped around, old entries could look current
+  memset(h->stamp,0,h->cap*sizeof(unsigned int));
+  h->generation=1;
+ }
+ h->count=0;
+}
+
+static inline size_t hash_home(const struct coop_hash *h, unsigned long long key)
+{
+ return((size_t)((key*0x9E3779B97F4A7C15ULL)>>32)&(h->cap-1));
+}
+
+static inline int hash_find(const struct coop_hash *h, unsigned long long key)
+{
+ // Value stored under key, -1 if there is none
+ for (size_t i=hash_home(h,key); h->stamp[i]==h->generation; i=(i+1)&(h->cap-1))
+  if (h->key[i]==key) return(h->value[i]);
+ return(-1);
+}
+
+static int hash_grow(struct coop_hash *h)
+{
+ // Doubles the capacity, moving the current entries over. Returns 0 if out of memory.
+ struct coop_hash old=*h;
+ size_t i, j;
+
+ if (hash_alloc(h,old.cap*2)==0)
+ {
+  *h=old;
+  return(0);
+ }
+ for (i=0; i<old.cap; i++)
+  if (old.stamp[i]==old.generation)
+  {
+   for (j=hash_home(h,old.key[i]); h->stamp[j]==h->generation; j=(j+1)&(h->cap-1));
+   h->key[j]=old.key[i];
+   h->value[j]=old.value[i];
+   h->stamp[j]=h->generation;
+   h->count++;
+  }
+ hash_free(&old);
+ return(1);
+}
+
+static int hash_set(struct coop_hash *h, unsigned long long key, int value)
+{
+ // Stores value under key, replacing any earlier value. Keeps the table at most half full.
+ // Returns 0 if out of memory.
+ size_t i;
+
+ if ((h->count+1)*2>h->cap&&hash_grow(h)==0) return(0);
+ for (i=hash_home(h,key); h->stamp[i]==h->generation; i=(i+1)&(h->cap-1))
+  if (h->key[i]==key)
+  {
+   h->value[i]=value;
+   return(1);
+  }
+ h->key[i]=key;
+ h->value[i]=value;
+ h->stamp[i]=h->generation;
+ h->count++;
+ return(1);
+}
+
+static inline unsigned long long pair_key(int a, int slot)
+{
+ return((((unsigned long long)(unsigned int)a)<<32)|(unsigned int)slot);
+}
+
+/* Planner */
+
+int alloc_coop_planner(struct coop_planner *cp, const struct route_costs *c, int max_slots, int max_nodes)
+{
+ // Sizes the planner for the current map, with a horizon of max_slots and at most
+ // max_nodes (state, slot) pairs per search. Returns 1 on success, 0 if out of memory.
+ int ok;
+
+ memset(cp,0,sizeof(struct coop_planner));
+ cp->n=sx*sy;
+ cp->cost=*c;
+ cp->slots[MOVE_FORWARD]=(int)ceil((c->forward/COOP_SLOT_SECONDS)-1e-9);
+ cp->slots[MOVE_LEFT]=(int)ceil((c->turn/COOP_SLOT_SECONDS)-1e-9);
+ cp->slots[MOVE_UTURN]=(int)ceil((c->uturn/COOP_SLOT_SECONDS)-1e-9);
+ for (int a=0; a<N_MOVES; a++)
+  if (cp->slots[a]<1) cp->slots[a]=1;
+ cp->slots[MOVE_RIGHT]=cp->slots[MOVE_LEFT];
+ cp->slots[COOP_WAIT]=1;
+ cp->slot_cost.forward=cp->slots[MOVE_FORWARD];
+ cp->slot_cost.turn=cp->slots[MOVE_LEFT];
+ cp->slot_cost.uturn=cp->slots[MOVE_UTURN];
+ cp->max_slots=max_slots;
+ cp->max_nodes=max_nodes;
+
+ ok=hash_alloc(&cp->reserved,COOP_HASH_START)&&hash_alloc(&cp->visited,COOP_HASH_START);
+ cp->parked_from=(int *)calloc(cp->n,sizeof(int));
+ cp->parked_by=(int *)calloc(cp->n,sizeof(int));
+ cp->last_slot=(int *)calloc(cp->n,sizeof(int));
+ cp->node_state=(int *)calloc(max_nodes,sizeof(int));
+ cp->node_slot=(int *)calloc(max_nodes,sizeof(int));
+ cp->node_parent=(int *)calloc(max_nodes,sizeof(int));
+ cp->node_action=(unsigned char *)calloc(max_nodes,sizeof(unsigned char));
+ cp->heap=(int *)calloc(max_nodes,sizeof(int));
+ cp->key=(int *)calloc(max_nodes,sizeof(int));
+ if (!ok||cp->parked_from==NULL||cp->parked_by==NULL||cp->last_slot==NULL||cp->node_state==NULL||cp->node_slot==NULL||
+     cp->node_parent==NULL||cp->node_action==NULL||cp->heap==NULL||cp->key==NULL)
+ {
+  free_coop_planner(cp);
+  return(0);
+ }
+ coop_clear(cp);
+ return(1);
+}
+
+void free_coop_planner(struct coop_planner *cp)
+{
+ hash_free(&cp->reserved);
+ hash_free(&cp->visited);
+ free(cp->parked_from);
+ free(cp->parked_by);
+ free(cp->last_slot);
+ free(cp->node_state);
+ free(cp->node_slot);
+ free(cp->node_parent);
+ free(cp->node_action);
+ free(cp->heap);
+ free(cp->key);
+ memset(cp,0,sizeof(struct coop_planner));
+}
+
+void coop_clear(struct coop_planner *cp)
+{
+ // Drops every reservation
+ hash_clear(&cp->reserved);
+ for (int i=0; i<cp->n; i++)
+ {
+  cp->parked_from[i]=-1;
+  cp->parked_by[i]=-1;
+  cp->last_slot[i]=-1;
+ }
+}
+
+static inline int slot_free(const struct coop_planner *cp, int idx, int slot, int robot)
+{
+ // True if the intersection is not held by another robot in the given slot
+ int r;
+
+ if (cp->parked_from[idx]>=0&&slot>=cp->parked_from[idx]&&cp->parked_by[idx]!=robot) return(0);
+ if (slot>cp->last_slot[idx]) return(1);
+ r=hash_find(&cp->reserved,pair_key(idx,slot));
+ return(r<0||r==robot);
+}
+
+static inline int span_free(const struct coop_planner *cp, int idx, int from, int to, int robot)
+{
+ for (int t=from; t<=to; t++)
+  if (!slot_free(cp,idx,t,robot)) return(0);
+ return(1);
+}
+
+static int reserve(struct coop_planner *cp, int idx, int from, int to, int robot)
+{
+ for (int t=from; t<=to; t++)
+  if (hash_set(&cp->reserved,pair_key(idx,t),robot)==0) return(0);
+ if (to>cp->last_slot[idx]) cp->last_slot[idx]=to;
+ return(1);
+}
+
+/* Binary heap of search nodes, by key (slot + heuristic), later slots first on ties */
+
+static inline int node_less(const struct coop_planner *cp, int a, int b)
+{
+ return(cp->key[a]<cp->key[b]||(cp->key[a]==cp->key[b]&&cp->node_slot[a]>cp->node_slot[b]));
+}
+
+static void heap_push(struct coop_planner *cp, int node)
+{
+ int i=cp->heap_size++, p;
+
+ while (i>0&&node_less(cp,node,cp->heap[p=(i-1)/2]))
+ {
+  cp->heap[i]=cp->heap[p];
+  i=p;
+ }
+ cp->heap[i]=node;
+}
+
+static int heap_pop(struct coop_planner *cp)
+{
+ int top=cp->heap[0], last=cp->heap[--cp->heap_size], i=0, c;
+
+ while ((c=(2*i)+1)<cp->heap_size)
+ {
+  if (c+1<cp->heap_size&&node_less(cp,cp->heap[c+1],cp->heap[c])) c++;
+  if (!node_less(cp,cp->heap[c],last)) break;
+  cp->heap[i]=cp->heap[c];
+  i=c;
+ }
+ if (cp->heap_size>0) cp->heap[i]=last;
+ return(top);
+}
+
+static int add_node(struct coop_planner *cp, int state, int slot, int parent, int action, int target)
+{
+ // Queues (state, slot) unless the search has seen it. Returns 0 if the node pool is full.
+ unsigned long long k=pair_key(state,slot);
+ int i;
+
+ if (hash_find(&cp->visited,k)>=0) return(1);
+ if (cp->n_nodes>=cp->max_nodes||hash_set(&cp->visited,k,cp->n_nodes)==0) return(0);
+ i=cp->n_nodes++;
+ cp->node_state[i]=state;
+ cp->node_slot[i]=slot;
+ cp->node_parent[i]=parent;
+ cp->node_action[i]=(unsigned char)action;
+ cp->key[i]=slot+(int)route_heuristic(&cp->slot_cost,state,target);
+ if (cp->key[i]<cp->last_slot[target]) cp->key[i]=cp->last_slot[target];
+ heap_push(cp,i);
+ return(1);
+}
+
+int coop_plan(struct coop_planner *cp, int robot, int start, int target, unsigned char *actions, int max_actions, int *arrival)
+{
+ // Plans robot's route from state start to intersection target around the reservations
+ // made so far, and reserves it. actions[] gets MOVE_* and COOP_WAIT actions, and *arrival
+ // (if not NULL) the slot the robot reaches the target in. Returns the number of actions,
+ // or -1 if there is no route within the horizon and node limit, it is longer than
+ // max_actions, or the planner was sized for a different map.
+ int i, s, t, a, ns, nt, idx, len, goal=-1;
+
+ if (cp->n!=sx*sy||start<0||start>=cp->n*4||target<0||target>=cp->n) return(-1);
+ // A table grown by a long search would spread the next one thin over memory, start small again
+ if (cp->visited.cap!=COOP_HASH_START)
+ {
+  hash_free(&cp->visited);
+  if (hash_alloc(&cp->visited,COOP_HASH_START)==0) return(-1);
+ }
+ else hash_clear(&cp->visited);
+ cp->n_nodes=0;
+ cp->heap_size=0;
+ cp->expanded=0;
+ if (!slot_free(cp,start/4,0,robot)) return(-1);
+ add_node(cp,start,0,-1,COOP_WAIT,target);
+
+ while (cp->heap_size>0)
+ {
+  i=heap_pop(cp);
+  cp->expanded++;
+  s=cp->node_state[i];
+  t=cp->node_slot[i];
+  idx=s/4;
+  // Done once at the target with nobody due through it later
+  if (idx==target&&(cp->parked_from[idx]<0||cp->parked_by[idx]==robot)&&span_free(cp,idx,t,cp->last_slot[idx],robot))
+  {
+   goal=i;
+   break;
+  }
+  for (a=0; a<=COOP_WAIT; a++)
+  {
+   nt=t+cp->slots[a];
+   if (nt>=cp->max_slots) continue;
+   if (a==MOVE_FORWARD)
+   {
+    if (map_nbr[s]<0) continue;
+    ns=move_state(s,MOVE_FORWARD);
+    if (!span_free(cp,idx,t+1,nt,robot)||!span_free(cp,ns/4,t,nt,robot)) continue;
+   }
+   else
+   {
+    ns=(a==COOP_WAIT)?s:move_state(s,a);
+    if (!span_free(cp,idx,t+1,nt,robot)) continue;
+   }
+   if (add_node(cp,ns,nt,i,a,target)==0)
+   {
+    cp->heap_size=0;
+    break;
+   }
+  }
+ }
+ if (goal<0) return(-1);
+
+ len=0;
+ for (i=goal; cp->node_parent[i]>=0; i=cp->node_parent[i])
+  len++;
+ if (len>max_actions) return(-1);
+ for (i=goal, a=len-1; cp->node_parent[i]>=0; i=cp->node_parent[i], a--)
+  actions[a]=cp->node_action[i];
+
+ // Reserve the route, and the target from the arrival on
+ s=start;
+ t=0;
+ if (reserve(cp,s/4,0,0,robot)==0) return(-1);
+ for (i=0; i<len; i++)
+ {
+  a=actions[i];
+  nt=t+cp->slots[a];
+  if (a==MOVE_FORWARD)
+  {
+   ns=move_state(s,MOVE_FORWARD);
+   if (reserve(cp,s/4,t,nt,robot)==0||reserve(cp,ns/4,t,nt,robot)==0) return(-1);
+  }
+  else
+  {
+   ns=(a==COOP_WAIT)?s:move_state(s,a);
+   if (reserve(cp,s/4,t,nt,robot)==0) return(-1);
+  }
+  s=ns;
+  t=nt;
+ }
+ cp->parked_from[target]=t;
+ cp->parked_by[target]=robot;
+ if (arrival!=NULL) *arrival=t;
+ return(len);
+}
+
+int coop_plan_all(struct coop_planner *cp, int robots, const int *start, const int *target, unsigned char **actions, int max_actions, int *len, int *arrival)
+{
+ // Plans every robot in index order (robot 0 first) on a clear reservation table. len[r]
+ // and arrival[r] are set as by coop_plan() (-1 if robot r got no route). Every robot's
+ // start is held for it for the length of a drive first, so the robots planned before it
+ // do not run into it before it can get away, and its target is claimed for it from then
+ // on, so they do not pass through after it has parked there. Returns the number of
+ // robots with a route.
+ int planned=0, hold=cp->slots[MOVE_FORWARD];
+
+ coop_clear(cp);
+ for (int r=0; r<robots; r++)
+ {
+  if (start[r]>=0&&start[r]<cp->n*4) reserve(cp,start[r]/4,0,hold,r);
+  if (target[r]>=0&&target[r]<cp->n)
+  {
+   cp->parked_from[target[r]]=hold+1;
+   cp->parked_by[target[r]]=r;
+  }
+ }
+ for (int r=0; r<robots; r++)
+ {
+  arrival[r]=-1;
+  len[r]=coop_plan(cp,r,start[r],target[r],actions[r],max_actions,&arrival[r]);
+  if (len[r]>=0) planned++;
+ }
+ return(planned);
+}
@@ -0,0 +1,96 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Cooperative route planning for several robots on one map.
+
+ Routes from plan_route() (EV3_Planner.h) are planned one robot at a time as if the map
+ were empty, so two robots sent out together can meet at an intersection or head-on on
+ a street. coop_plan_all() uses cooperative A* (Silver, 2005) instead: robots are planned
+ one after another in priority order, and every planned route is written into a shared
+ reservation table of (intersection, time slot) pairs that the routes of the robots
+ after it must stay clear of.
+
+ Time is counted in slots of COOP_SLOT_SECONDS. Every action takes a whole number of
+ slots - the route costs (seconds, see EV3_CostModel.h) rounded up - and a robot can
+ also COOP_WAIT one slot where it is. While turning or waiting a robot holds its own
+ intersection; while driving a block it holds the intersections at both ends for the
+ whole drive, so no other robot can enter the street from either end. Once a robot
+ reaches its target it stays there: its intersection is held from the arrival slot on
+ (parked_from[]), and a robot may only finish at an intersection no later robot's route
+ has been reserved through. coop_plan_all() claims every robot's target for it up front,
+ so the routes planned before it go around the target instead of through it - otherwise
+ the robot would have to wait for the last of them to pass, and its search would wade
+ through every (state, slot) pair up to then.
+
+ Each robot's search is an A* over (state, time slot) pairs - states idx*4+d as in
+ plan_route(), with route_heuristic() in slots as the heuristic, raised to the last slot
+ reserved at the target (the robot can not finish before it). The time taken is the
+ cost, so a pair is always reached at the same cost and the search needs no
+ decrease-key; the pairs already generated are kept in a hash set, and the search gives
+ up after max_nodes of them or beyond max_slots.
+
+ Both the reservation table and the search's pair set are open-addressing hash tables
+ (linear probing, 64-bit keys idx<<32|slot or state<<32|slot), so reservations cost
+ memory per reserved slot rather than per intersection and time step. As with struct
+ route_planner, entries carry the number of the generation that wrote them, so clearing
+ either table is a counter increment.
+
+ Planning is greedy: a robot planned early never gives way, so a later robot can be left
+ with no route (coop_plan() returns -1), for example when an earlier one parks on the
+ only way out of its start. bench_coop in EV3_Benchmarks measures planning time and
+ these failures for 2 to 50 robots on generated maps - 50 robots on a 100x100 map plan
+ in about 10ms with over 99% of them routed; on a crowded 20x20 map about 7% get none.
+
+*/
+
+#ifndef __cooperative_header
+#define __cooperative_header
+
+#include "EV3_Planner.h"
+
+#define COOP_WAIT N_MOVES           // Action - stay at the intersection for one slot
+#define COOP_SLOT_SECONDS 0.5       // Length of a time slot
+#define COOP_MAX_SLOTS 4096         // Default planning horizon in slots
+#define COOP_MAX_NODES (1<<20)      // Default (state, slot) pairs a search may generate
+#define COOP_HASH_START 4096        // Initial capacity of the hash tables (they double as needed)
+
+struct coop_hash{
+ unsigned long long *key;   // idx<<32|slot (reservations) or state<<32|slot (search)
+ int *value;                // Robot holding the slot, or node of the search
+ unsigned int *stamp;       // Generation that wrote the entry, older entries are empty
+ unsigned int generation;
+ size_t cap;                // Power of 2
+ size_t count;
+};
+
+struct coop_planner{
+ int n;                     // Number of intersections the arrays are sized for
+ struct route_costs cost;   // Route costs in seconds...
+ struct route_costs slot_cost;  // ... and in whole slots
+ int slots[N_MOVES+1];      // Slots taken by each action, COOP_WAIT included
+ int max_slots;             // Horizon - routes must arrive before this slot
+ struct coop_hash reserved; // (intersection, slot) -> robot
+ int *parked_from;          // Slot the intersection belongs to robot parked_by[] from, -1 if none
+ int *parked_by;
+ int *last_slot;            // Last reserved slot at the intersection, -1 if none
+ struct coop_hash visited;  // (state, slot) -> search node
+ int max_nodes;
+ int *node_state;           // Search nodes: state, slot, parent node, action from the parent
+ int *node_slot;
+ int *node_parent;
+ unsigned char *node_action;
+ int n_nodes;
+ int *heap;                 // Open list - binary heap of nodes by slot + heuristic
+ int *key;
+ int heap_size;
+ long expanded;             // Nodes expanded by the last coop_plan()
+};
+
+int alloc_coop_planner(struct coop_planner *cp, const struct route_costs *c, int max_slots, int max_nodes);
+void free_coop_planner(struct coop_planner *cp);
+void coop_clear(struct coop_planner *cp);
+int coop_plan(struct coop_planner *cp, int robot, int start, int target, unsigned char *actions, int max_actions, int *arrival);
+int coop_plan_all(struct coop_planner *cp, int robots, const int *start, const int *target, unsigned char **actions, int max_actions, int *len, int *arrival);
+
+#endif
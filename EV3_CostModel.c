@@ -0,0 +1,150 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Learned action durations - see EV3_CostModel.h
+
+*/
+
+#include <math.h>
+#include <time.h>
+#include "EV3_CostModel.h"
+
+void init_cost_model(struct cost_model *cm, const struct route_costs *c)
+{
+ // No measurements yet - the durations start out as the given route costs
+ cm->duration[MOVE_FORWARD]=c->forward;
+ cm->duration[MOVE_LEFT]=c->turn;
+ cm->duration[MOVE_RIGHT]=c->turn;
+ cm->duration[MOVE_UTURN]=c->uturn;
+ for (int a=0; a<N_MOVES; a++)
+  cm->samples[a]=0;
+ cm->published=*c;
+}
+
+double cost_clock(void)
+{
+ // Seconds on a clock that is not affected by changes to the system time
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return(t.tv_sec+(t.tv_nsec*1e-9));
+}
+
+void cost_model_record(struct cost_model *cm, int action, double seconds)
+{
+ // Adds the measured duration of one action to its estimate
+ double w;
+
+ if (action<0||action>=N_MOVES||!(seconds>0)||seconds>COST_MAX_DURATION) return;
+ cm->samples[action]++;
+ w=1.0/cm->samples[action];
+ if (w<COST_DECAY) w=COST_DECAY;
+ cm->duration[action]+=w*(seconds-cm->duration[action]);
+}
+
+static double quantize(double seconds)
+{
+ double q=floor((seconds/COST_QUANTUM)+0.5)*COST_QUANTUM;
+ return((q<COST_QUANTUM)?COST_QUANTUM:q);
+}
+
+static void estimated_costs(const struct cost_model *cm, struct route_costs *c)
+{
+ // Route costs from the current estimates, rounded to COST_QUANTUM
+ c->forward=quantize(cm->duration[MOVE_FORWARD]);
+ c->turn=quantize((cm->duration[MOVE_LEFT]+cm->duration[MOVE_RIGHT])/2.0);
+ c->uturn=quantize(cm->duration[MOVE_UTURN]);
+}
+
+static int moved(double estimate, double published)
+{
+ return(fabs(estimate-published)>COST_CHANGE*published);
+}
+
+int cost_model_update(struct cost_model *cm)
+{
+ // Publishes route costs from the current estimates if any of them has moved more than
+ // COST_CHANGE away from the published one. Returns 1 if the published costs changed.
+ struct route_costs c;
+
+ estimated_costs(cm,&c);
+ if (!moved(c.forward,cm->published.forward)&&!moved(c.turn,cm->published.turn)&&!moved(c.uturn,cm->published.uturn)) return(0);
+ cm->published=c;
+ return(1);
+}
+
+void cost_model_route_costs(const struct cost_model *cm, struct route_costs *c)
+{
+ // The published route costs, see cost_model_update()
+ *c=cm->published;
+}
+
+void cost_model_path(const char *address, char *path, size_t len)
+{
+ // Cost model file for the robot with the given bluetooth address
+ size_t k;
+
+ snprintf(path,len,"%s%s.cal",COST_FILE_PREFIX,address);
+ for (k=strlen(COST_FILE_PREFIX); path[k]!='\0'; k++)
+  if (path[k]==':') path[k]='-';
+}
+
+int load_cost_model(struct cost_model *cm, const char *filename)
+{
+ // Reads durations saved by save_cost_model(). Returns 1 on success, 0 if the file is
+ // missing or not a cost model (cm is left unchanged).
+ struct cost_model tmp;
+ char magic[16];
+ int version;
+ FILE *f;
+
+ f=fopen(filename,"r");
+ if (f==NULL) return(0);
+ if (fscanf(f,"%15s %d",magic,&version)!=2||strcmp(magic,COST_MAGIC)!=0||(version!=1&&version!=COST_VERSION))
+ {
+  fprintf(stderr,"load_cost_model(): %s is not a cost model file\n",filename);
+  fclose(f);
+  return(0);
+ }
+ for (int a=0; a<N_MOVES; a++)
+  if (fscanf(f,"%lf %ld",&tmp.duration[a],&tmp.samples[a])!=2||!(tmp.duration[a]>0)||tmp.samples[a]<0)
+  {
+   fprintf(stderr,"load_cost_model(): %s is truncated or corrupted\n",filename);
+   fclose(f);
+   return(0);
+  }
+ if (version==1) estimated_costs(&tmp,&tmp.published);
+ else if (fscanf(f,"%lf %lf %lf",&tmp.published.forward,&tmp.published.turn,&tmp.published.uturn)!=3||
+          !(tmp.published.forward>0)||!(tmp.published.turn>0)||!(tmp.published.uturn>0))
+ {
+  fprintf(stderr,"load_cost_model(): %s is truncated or corrupted\n",filename);
+  fclose(f);
+  return(0);
+ }
+ fclose(f);
+ *cm=tmp;
+ return(1);
+}
+
+int save_cost_model(const struct cost_model *cm, const char *filename)
+{
+ // Writes the durations. Returns 1 on success, 0 on failure.
+ FILE *f;
+
+ f=fopen(filename,"w");
+ if (f==NULL)
+ {
+  fprintf(stderr,"save_cost_model(): Unable to create %s\n",filename);
+  return(0);
+ }
+ fprintf(f,"%s %d\n",COST_MAGIC,COST_VERSION);
+ for (int a=0; a<N_MOVES; a++)
+  fprintf(f,"%.6f %ld\n",cm->duration[a],cm->samples[a]);
+ fprintf(f,"%.6f %.6f %.6f\n",cm->published.forward,cm->published.turn,cm->published.uturn);
+ if (fclose(f)!=0)
+ {
+  fprintf(stderr,"save_cost_model(): Error writing %s\n",filename);
+  return(0);
+ }
+ return(1);
+}
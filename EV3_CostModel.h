@@ -0,0 +1,74 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Learned action durations for route planning.
+
+ struct route_costs (EV3_Planner.h) prices a drive, a turn and a U-turn for every
+ planner in seconds, but the defaults are guesses, and on a real robot the durations
+ differ from one robot to the next and drift as the battery runs down. struct
+ cost_model measures them instead: go_to_target() and robot_localization() time every
+ drive_along_street() and turn_action() that succeeds (CLOCK_MONOTONIC, read just before
+ and just after the motor commands) and add the duration to a running estimate for that
+ action - an exponentially decaying mean,
+
+     duration += w * (measured - duration),   w = max(1/samples, COST_DECAY)
+
+ which is a plain average over the first 1/COST_DECAY samples and afterwards weights the
+ latest drives most, so the estimate follows the battery. Durations outside
+ (0, COST_MAX_DURATION] seconds (a robot that was picked up, a stalled motor) are not
+ recorded.
+
+ The planners do not follow the estimates step by step, though. Every change of route
+ costs throws work away: the route table (EV3_RouteTable.h) no longer applies for the
+ rest of the run, its file - keyed by the exact costs - is rebuilt at the next start-up,
+ and the D* Lite search (EV3_DStar.h) starts over. Drives take several seconds and vary
+ a lot, so the estimates wander by a few percent all the time. The model therefore keeps
+ the route costs it last published, and cost_model_update() only publishes new ones when
+ an estimate has moved more than COST_CHANGE (relative) away from them: forward from the
+ drives, turn from the mean of the left and right turns (the planners price both alike),
+ uturn from the U-turns, rounded to COST_QUANTUM seconds. cost_model_route_costs() gives
+ the published costs.
+
+ The model is kept per robot, in a file named after its bluetooth address
+ (cost_model_path()), loaded at start-up and saved before exiting, so each run starts
+ from what the previous one learned - and with the same published costs, so the route
+ table file from the last run still matches. Text format:
+
+     EV3COSTS 2
+     <duration> <samples>       one line each for MOVE_FORWARD, MOVE_LEFT, MOVE_RIGHT, MOVE_UTURN
+     <forward> <turn> <uturn>   the published route costs
+
+ (version 1 files, without the last line, are read as well).
+
+*/
+
+#ifndef __cost_model_header
+#define __cost_model_header
+
+#include "EV3_Planner.h"
+
+#define COST_MAGIC "EV3COSTS"
+#define COST_VERSION 2
+#define COST_FILE_PREFIX "EV3_costs_"   // ... followed by the robot's address, ':' replaced by '-', and ".cal"
+#define COST_DECAY 0.1              // Weight of the newest duration once the estimate has warmed up
+#define COST_MAX_DURATION 60.0      // Longer durations (seconds) are not recorded
+#define COST_QUANTUM 0.05           // Route costs are rounded to this many seconds
+#define COST_CHANGE 0.10            // ... and only change when an estimate is this far (relative) from them
+
+struct cost_model{
+ double duration[N_MOVES];  // Estimated seconds for MOVE_FORWARD (one block), MOVE_LEFT, MOVE_RIGHT, MOVE_UTURN
+ long samples[N_MOVES];     // Durations recorded into each estimate
+ struct route_costs published;  // Route costs the planners were last given
+};
+
+void init_cost_model(struct cost_model *cm, const struct route_costs *c);
+double cost_clock(void);
+void cost_model_record(struct cost_model *cm, int action, double seconds);
+int cost_model_update(struct cost_model *cm);
+void cost_model_route_costs(const struct cost_model *cm, struct route_costs *c);
+void cost_model_path(const char *address, char *path, size_t len);
+int load_cost_model(struct cost_model *cm, const char *filename);
+int save_cost_model(const struct cost_model *cm, const char *filename);
+
+#endif
@@ -0,0 +1,405 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Incremental replanning with D* Lite - see EV3_DStar.h
+
+*/
+
+#include <math.h>
+#include "EV3_DStar.h"
+
+int alloc_dstar(struct dstar_planner *ds, const struct route_costs *c)
+{
+ // Sizes the planner for the current map, with no target and no blocked streets. Returns 1
+ // on success, 0 if out of memory.
+ int ns=sx*sy*4;
+
+ memset(ds,0,sizeof(struct dstar_planner));
+ ds->n=sx*sy;
+ ds->cost=*c;
+ ds->target=-1;
+ ds->last=-1;
+ ds->g=(double *)calloc(ns,sizeof(double));
+ ds->rhs=(double *)calloc(ns,sizeof(double));
+ ds->stamp=(unsigned int *)calloc(ns,sizeof(unsigned int));
+ ds->blocked=(unsigned char *)calloc(ns,sizeof(unsigned char));
+ ds->heap=(int *)calloc(ns,sizeof(int));
+ ds->key=(double (*)[2])calloc(ns,sizeof(double[2]));
+ ds->pos=(int *)calloc(ns,sizeof(int));
+ if (ds->g==NULL||ds->rhs==NULL||ds->stamp==NULL||ds->blocked==NULL||ds->heap==NULL||ds->key==NULL||ds->pos==NULL)
+ {
+  free_dstar(ds);
+  return(0);
+ }
+ return(1);
+}
+
+void free_dstar(struct dstar_planner *ds)
+{
+ free(ds->g);
+ free(ds->rhs);
+ free(ds->stamp);
+ free(ds->blocked);
+ free(ds->heap);
+ free(ds->key);
+ free(ds->pos);
+ memset(ds,0,sizeof(struct dstar_planner));
+}
+
+static inline void touch(struct dstar_planner *ds, int s)
+{
+ // Makes the entries for s current - states not reached by this search start out unknown
+ if (ds->stamp[s]!=ds->search)
+ {
+  ds->stamp[s]=ds->search;
+  ds->g[s]=HUGE_VAL;
+  ds->rhs[s]=HUGE_VAL;
+  ds->pos[s]=-1;
+ }
+}
+
+static inline double g_of(const struct dstar_planner *ds, int s)
+{
+ return((ds->stamp[s]==ds->search)?ds->g[s]:HUGE_VAL);
+}
+
+static inline double heuristic(const struct dstar_planner *ds, int a, int b)
+{
+ // Blocks between the intersections of two states, times the forward cost
+ int ia=a/4, ib=b/4;
+
+ return(ds->cost.forward*(double)(abs((ia%sx)-(ib%sx))+abs((ia/sx)-(ib/sx))));
+}
+
+static inline void calc_key(const struct dstar_planner *ds, int s, double k[2])
+{
+ double m=(ds->g[s]<ds->rhs[s])?ds->g[s]:ds->rhs[s];
+
+ k[0]=m+heuristic(ds,ds->last,s)+ds->km;
+ k[1]=m;
+}
+
+static inline int key_less(const double a[2], const double b[2])
+{
+ return(a[0]<b[0]||(a[0]==b[0]&&a[1]<b[1]));
+}
+
+static inline void heap_swap(struct dstar_planner *ds, int i, int j)
+{
+ int s=ds->heap[i];
+ double k0=ds->key[i][0], k1=ds->key[i][1];
+
+ ds->heap[i]=ds->heap[j];
+ ds->key[i][0]=ds->key[j][0];
+ ds->key[i][1]=ds->key[j][1];
+ ds->heap[j]=s;
+ ds->key[j][0]=k0;
+ ds->key[j][1]=k1;
+ ds->pos[ds->heap[i]]=i;
+ ds->pos[ds->heap[j]]=j;
+}
+
+static void heap_up(struct dstar_planner *ds, int i)
+{
+ while (i>0&&key_less(ds->key[i],ds->key[(i-1)/2]))
+ {
+  heap_swap(ds,i,(i-1)/2);
+  i=(i-1)/2;
+ }
+}
+
+static void heap_down(struct dstar_planner *ds, int i)
+{
+ int c;
+
+ while ((c=(2*i)+1)<ds->heap_size)
+ {
+  if (c+1<ds->heap_size&&key_less(ds->key[c+1],ds->key[c])) c++;
+  if (!key_less(ds->key[c],ds->key[i])) break;
+  heap_swap(ds,i,c);
+  i=c;
+ }
+}
+
+static void heap_set(struct dstar_planner *ds, int s, const double k[2])
+{
+ // Inserts s with key k, or changes its key if it is already queued
+ int i=ds->pos[s];
+
+ if (i<0)
+ {
+  i=ds->heap_size++;
+  ds->heap[i]=s;
+  ds->pos[s]=i;
+ }
+ ds->key[i][0]=k[0];
+ ds->key[i][1]=k[1];
+ heap_up(ds,i);
+ heap_down(ds,ds->pos[s]);
+}
+
+static void heap_remove(struct dstar_planner *ds, int s)
+{
+ int i=ds->pos[s], m;
+
+ ds->pos[s]=-1;
+ ds->heap_size--;
+ if (i==ds->heap_size) return;
+ m=ds->heap[ds->heap_size];
+ ds->heap[i]=m;
+ ds->key[i][0]=ds->key[ds->heap_size][0];
+ ds->key[i][1]=ds->key[ds->heap_size][1];
+ ds->pos[m]=i;
+ heap_up(ds,i);
+ heap_down(ds,ds->pos[m]);
+}
+
+static double lookahead(const struct dstar_planner *ds, int s)
+{
+ // rhs for a state that is not at the target - the cheapest action followed by the
+ // cheapest known way on from where it leads
+ const struct route_costs *c=&ds->cost;
+ int base=s&~3, d=s&3;
+ double best=HUGE_VAL, v;
+
+ if (map_nbr[s]>=0&&!ds->blocked[s]) best=c->forward+g_of(ds,(map_nbr[s]*4)+d);
+ v=c->turn+g_of(ds,base|((d+3)&3));
+ if (v<best) best=v;
+ v=c->turn+g_of(ds,base|((d+1)&3));
+ if (v<best) best=v;
+ v=c->uturn+g_of(ds,base|((d+2)&3));
+ if (v<best) best=v;
+ return(best);
+}
+
+static void update_vertex(struct dstar_planner *ds, int s)
+{
+ // Queues s if it is inconsistent (g != rhs), takes it off the queue otherwise
+ double k[2];
+
+ if (ds->g[s]!=ds->rhs[s])
+ {
+  calc_key(ds,s,k);
+  heap_set(ds,s,k);
+ }
+ else if (ds->pos[s]>=0) heap_remove(ds,s);
+}
+
+static inline int predecessors(const struct dstar_planner *ds, int s, int p[4], double w[4])
+{
+ // The states with an action leading to s, and what that action costs. Returns how many.
+ const struct route_costs *c=&ds->cost;
+ int base=s&~3, d=s&3, k=0, q;
+
+ q=map_nbr[base+((d+2)&3)];
+ if (q>=0&&!ds->blocked[(q*4)+d])
+ {
+  p[k]=(q*4)+d;
+  w[k++]=c->forward;
+ }
+ p[k]=base|((d+1)&3);           // Turns left into s
+ w[k++]=c->turn;
+ p[k]=base|((d+3)&3);           // Turns right into s
+ w[k++]=c->turn;
+ p[k]=base|((d+2)&3);
+ w[k++]=c->uturn;
+ return(k);
+}
+
+static void compute_shortest_path(struct dstar_planner *ds, int start, double slack)
+{
+ // Expands inconsistent states in key order until the start state is consistent and no
+ // queued state could still lower its cost - or, with slack > 0, until none is within
+ // slack of the start's cost either
+ int u, p[4], k, np;
+ double kstart[2], knew[2], w[4], gold;
+
+ touch(ds,start);
+ while (ds->heap_size>0)
+ {
+  calc_key(ds,start,kstart);
+  kstart[0]+=slack;
+  if (!key_less(ds->key[0],kstart)&&ds->rhs[start]==ds->g[start]) break;
+  u=ds->heap[0];
+  calc_key(ds,u,knew);
+  if (key_less(ds->key[0],knew))
+  {
+   // Stale key from before the robot moved
+   heap_set(ds,u,knew);
+   continue;
+  }
+  ds->expanded++;
+  np=predecessors(ds,u,p,w);
+  if (ds->g[u]>ds->rhs[u])
+  {
+   // Cost to the target went down - settle it and pass it on
+   ds->g[u]=ds->rhs[u];
+   heap_remove(ds,u);
+   for (k=0; k<np; k++)
+   {
+    touch(ds,p[k]);
+    if (p[k]/4!=ds->target&&w[k]+ds->g[u]<ds->rhs[p[k]])
+    {
+     ds->rhs[p[k]]=w[k]+ds->g[u];
+     update_vertex(ds,p[k]);
+    }
+   }
+  }
+  else
+  {
+   // Cost to the target went up - forget it, and recompute everything that relied on it
+   gold=ds->g[u];
+   ds->g[u]=HUGE_VAL;
+   update_vertex(ds,u);
+   for (k=0; k<np; k++)
+   {
+    touch(ds,p[k]);
+    if (p[k]/4!=ds->target&&ds->rhs[p[k]]==w[k]+gold)
+    {
+     ds->rhs[p[k]]=lookahead(ds,p[k]);
+     update_vertex(ds,p[k]);
+    }
+   }
+  }
+ }
+}
+
+int dstar_set_target(struct dstar_planner *ds, int target)
+{
+ // Starts a new search toward intersection target. The search itself happens in the next
+ // dstar_plan(), once the robot's state is known. Returns 1, or 0 if target is not on the map
+ // or the planner was sized for a different map.
+ if (ds->n!=sx*sy||target<0||target>=ds->n) return(0);
+ ds->search++;
+ if (ds->search==0)
+ {
+  // Stamps wrapped around, old entries could look current
+  memset(ds->stamp,0,(size_t)ds->n*4*sizeof(unsigned int));
+  ds->search=1;
+ }
+ ds->target=target;
+ ds->last=-1;
+ ds->km=0;
+ ds->heap_size=0;
+ return(1);
+}
+
+static void forward_edge_changed(struct dstar_planner *ds, int s)
+{
+ // The forward edge out of s was just blocked or re-opened
+ double via;
+
+ if (ds->last<0||s/4==ds->target) return;
+ touch(ds,s);
+ via=ds->cost.forward+g_of(ds,(map_nbr[s]*4)+(s&3));
+ if (ds->blocked[s])
+ {
+  if (ds->rhs[s]!=via) return;
+  ds->rhs[s]=lookahead(ds,s);
+ }
+ else if (via<ds->rhs[s]) ds->rhs[s]=via;
+ else return;
+ update_vertex(ds,s);
+}
+
+int dstar_set_street(struct dstar_planner *ds, int state, int blocked)
+{
+ // Marks the street ahead of state (both ways) as blocked, or open again if blocked is 0.
+ // An active search is repaired by the next dstar_plan(). Returns 1, or 0 if there is no
+ // street ahead of state.
+ int back;
+
+ if (ds->n!=sx*sy||state<0||state>=ds->n*4||map_nbr[state]<0) return(0);
+ back=(map_nbr[state]*4)+((state+2)&3);
+ blocked=(blocked!=0);
+ if (ds->blocked[state]!=blocked)
+ {
+  ds->blocked[state]=(unsigned char)blocked;
+  forward_edge_changed(ds,state);
+ }
+ if (ds->blocked[back]!=blocked)
+ {
+  ds->blocked[back]=(unsigned char)blocked;
+  forward_edge_changed(ds,back);
+ }
+ return(1);
+}
+
+void dstar_set_costs(struct dstar_planner *ds, const struct route_costs *c)
+{
+ // New route costs change every edge, so an active search starts over (blocked streets stay)
+ ds->cost=*c;
+ if (ds->target>=0) dstar_set_target(ds,ds->target);
+}
+
+void dstar_clear_streets(struct dstar_planner *ds)
+{
+ // Re-opens every street. This changes too much to repair, so the search starts over.
+ memset(ds->blocked,0,(size_t)ds->n*4);
+ if (ds->target>=0) dstar_set_target(ds,ds->target);
+}
+
+int dstar_plan(struct dstar_planner *ds, int start, unsigned char *actions, int max_actions, double *cost)
+{
+ // Cheapest action sequence from state start to the target, avoiding blocked streets, like
+ // plan_route(). The first call after dstar_set_target() searches from scratch, later calls
+ // only repair what changed since. Returns the number of actions, or -1 if there is no
+ // route (every way to the target is blocked), it is longer than max_actions, or no target
+ // is set. The search from scratch runs on past the robot's cost, see DSTAR_SLACK_TURNS.
+ int s, t, a, best_a, len, d;
+ double best, v;
+ double k[2];
+
+ if (ds->n!=sx*sy||ds->target<0||start<0||start>=ds->n*4) return(-1);
+ ds->expanded=0;
+ if (ds->last<0)
+ {
+  ds->last=start;
+  for (d=0; d<4; d++)
+  {
+   s=(ds->target*4)+d;
+   touch(ds,s);
+   ds->rhs[s]=0;
+   calc_key(ds,s,k);
+   heap_set(ds,s,k);
+  }
+  compute_shortest_path(ds,start,DSTAR_SLACK_TURNS*ds->cost.turn);
+ }
+ else
+ {
+  ds->km+=heuristic(ds,ds->last,start);
+  ds->last=start;
+  compute_shortest_path(ds,start,0);
+ }
+ if (ds->g[start]==HUGE_VAL) return(-1);
+
+ // Follow the cheapest action out of every state - with g settled along the way, this
+ // is a cheapest route
+ len=0;
+ for (s=start; s/4!=ds->target; s=t)
+ {
+  best=HUGE_VAL;
+  best_a=-1;
+  t=s;
+  for (a=0; a<N_MOVES; a++)
+  {
+   if (a==MOVE_FORWARD)
+   {
+    if (map_nbr[s]<0||ds->blocked[s]) continue;
+    v=ds->cost.forward+g_of(ds,move_state(s,a));
+   }
+   else v=((a==MOVE_UTURN)?ds->cost.uturn:ds->cost.turn)+g_of(ds,move_state(s,a));
+   if (v<best)
+   {
+    best=v;
+    best_a=a;
+   }
+  }
+  if (best_a<0||best==HUGE_VAL||len>=max_actions) return(-1);
+  actions[len++]=(unsigned char)best_a;
+  t=move_state(s,best_a);
+ }
+ if (cost!=NULL) *cost=ds->g[start];
+ return(len);
+}
@@ -0,0 +1,88 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Incremental replanning with D* Lite.
+
+ plan_route() (EV3_Planner.h) and the route table (EV3_RouteTable.h) assume every street
+ on the map can be driven. When the robot finds one it can not get through (an obstacle,
+ a torn map, drive_along_street() failing again and again), the route has to change, and
+ searching from scratch after every such discovery repeats almost all of the previous
+ search. D* Lite (Koenig and Likhachev, 2002) keeps its search between calls instead.
+
+ The search runs backward from the target over the same state graph as plan_route() -
+ states idx*4+d, MOVE_FORWARD along a street, turns in place, with struct route_costs.
+ Every state has
+
+   g   - its cost to reach the target, as of the last time the state was expanded
+   rhs - the one-step lookahead min over successors t of (cost of s -> t) + g[t]
+
+ and the states where the two disagree sit in a priority queue. A blocked street changes
+ the cost of two forward edges (one each way), which changes rhs for only the two states
+ that drive into it; compute_shortest_path() then re-expands the states whose cost to the
+ target really changed, and only as far as needed to settle the robot's own state. Most
+ of the search from the previous plan stays valid and is not touched again.
+
+ The robot moves between replans, and the queue keys use a heuristic toward the robot's
+ state. Rather than re-keying the queue after every move, D* Lite adds the heuristic
+ distance the robot has moved to a running offset km, which keeps old keys valid lower
+ bounds (they are fixed up lazily when they reach the top of the queue). The heuristic
+ is the Manhattan distance times the forward cost - unlike route_heuristic() it ignores
+ turns, which keeps it consistent in both directions, as D* Lite needs.
+
+ Usage:
+
+   dstar_set_target(ds,target)      - new target, clears the search (blocked streets stay)
+   dstar_plan(ds,state,...)         - route from the robot's current state, like plan_route()
+   dstar_set_street(ds,state,1)     - the street ahead of state is blocked (0 re-opens it),
+                                      repaired by the next dstar_plan()
+   dstar_set_costs(ds,c)            - new route costs (EV3_CostModel.h), the search starts over
+
+ Per-state arrays carry the number of the search that last touched them, as in struct
+ route_planner, so a new target costs nothing up front.
+
+ With that heuristic a plain D* Lite search stops with much of the rectangle between the
+ robot and the target still queued, all of it within a couple of turns of the cheapest
+ cost. The detour around the first blocked street then has to expand all of it, which
+ makes the first repair about as slow as a new search. So the search from scratch runs
+ on until nothing within DSTAR_SLACK_TURNS turns of the robot's cost is left queued. That
+ is done once, before the robot sets off (go_to_target() starts the search with its
+ first route), and the repairs after it stay small: on a 1000x1000 map the first search
+ takes about 0.24 s, and a replan after a block 44 us on average (bench_replan).
+
+*/
+
+#ifndef __dstar_header
+#define __dstar_header
+
+#include "EV3_Planner.h"
+
+#define DSTAR_SLACK_TURNS 2.0       // The search from scratch settles everything within this many turns of the robot's cost
+
+struct dstar_planner{
+ int n;                     // Number of intersections the arrays are sized for
+ struct route_costs cost;
+ int target;                // Target intersection, -1 if none set
+ int last;                  // Robot state at the last dstar_plan() (for km)
+ double km;                 // Heuristic offset accumulated as the robot moves
+ double *g;                 // Cost to the target as of the last expansion
+ double *rhs;               // One-step lookahead cost to the target
+ unsigned int *stamp;       // Search that last touched the state (g, rhs valid only if current)
+ unsigned int search;
+ unsigned char *blocked;    // blocked[s] - the street ahead of state s can not be driven
+ int *heap;                 // Priority queue of inconsistent states
+ double (*key)[2];          // Heap keys [k1, k2] by heap position, compared lexicographically
+ int *pos;                  // Heap position of each state, -1 if not queued
+ int heap_size;
+ long expanded;             // States expanded by the last dstar_plan()
+};
+
+int alloc_dstar(struct dstar_planner *ds, const struct route_costs *c);
+void free_dstar(struct dstar_planner *ds);
+int dstar_set_target(struct dstar_planner *ds, int target);
+int dstar_set_street(struct dstar_planner *ds, int state, int blocked);
+void dstar_set_costs(struct dstar_planner *ds, const struct route_costs *c);
+void dstar_clear_streets(struct dstar_planner *ds);
+int dstar_plan(struct dstar_planner *ds, int start, unsigned char *actions, int max_actions, double *cost);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Pipelined route execution - see EV3_Executor.h
+
+*/
+
+#include "EV3_Executor.h"
+#include "./EV3_RobotControl/bytecodes.h"
+
+void init_executor(struct executor *ex, const struct exec_link *link, char left_port, char right_port, char sensor_port, const struct route_costs *c)
+{
+ // Default wheel powers (left turns spin counter-clockwise), run times from the route costs
+ memset(ex,0,sizeof(struct executor));
+ ex->link=*link;
+ ex->left_port=left_port;
+ ex->right_port=right_port;
+ ex->sensor_port=sensor_port;
+ ex->power[MOVE_FORWARD][0]=EXEC_DRIVE_POWER;
+ ex->power[MOVE_FORWARD][1]=EXEC_DRIVE_POWER;
+ ex->power[MOVE_LEFT][0]=-EXEC_SPIN_POWER;
+ ex->power[MOVE_LEFT][1]=EXEC_SPIN_POWER;
+ ex->power[MOVE_RIGHT][0]=EXEC_SPIN_POWER;
+ ex->power[MOVE_RIGHT][1]=-EXEC_SPIN_POWER;
+ ex->power[MOVE_UTURN][0]=EXEC_SPIN_POWER;
+ ex->power[MOVE_UTURN][1]=-EXEC_SPIN_POWER;
+ ex->window=EXEC_WINDOW;
+ ex->message_id=1;
+ exec_set_timing(ex,c);
+}
+
+void exec_set_timing(struct executor *ex, const struct route_costs *c)
+{
+ // Run times from route costs in seconds
+ const double seconds[N_MOVES]={c->forward,c->turn,c->turn,c->uturn};
+
+ for (int a=0; a<N_MOVES; a++)
+ {
+  ex->run_ms[a]=(int)((seconds[a]*1000.0)+0.5);
+  if (ex->run_ms[a]<1) ex->run_ms[a]=1;
+  if (ex->run_ms[a]>EXEC_MAX_RUN_MS) ex->run_ms[a]=EXEC_MAX_RUN_MS;
+ }
+}
+
+void free_executor(struct executor *ex)
+{
+ free(ex->packet);
+ free(ex->packet_len);
+ ex->packet=NULL;
+ ex->packet_len=NULL;
+ ex->capacity=0;
+}
+
+int encode_action(const struct executor *ex, int action, unsigned short message_id, unsigned char *packet)
+{
+ // Encodes one action as a direct command with reply into packet[] (EXEC_PACKET_BYTES).
+ // Returns its length in bytes, or 0 for an unknown action.
+ //
+ //   |length-2| |cnt_id| |type| |header|  power left, power right, start both, wait on a
+ //   timer, stop both (brake) [, read the colour sensor into global byte 0 - drives only]
+ char ports=ex->left_port|ex->right_port;
+ int ms, n=0;
+
+ if (action<0||action>=N_MOVES) return(0);
+ ms=ex->run_ms[action];
+ packet[n++]=0x00;                      // Length, filled in below
+ packet[n++]=0x00;
+ packet[n++]=message_id&0xFF;
+ packet[n++]=(message_id>>8)&0xFF;
+ packet[n++]=0x00;                      // Direct command with reply
+ packet[n++]=0x01;                      // 1 global byte (the colour), 4 local bytes (the timer)
+ packet[n++]=4<<2;
+
+ packet[n++]=opOUTPUT_POWER;
+ packet[n++]=LC0(0);
+ packet[n++]=ex->left_port;
+ packet[n++]=0x81;
+ packet[n++]=(unsigned char)ex->power[action][0];
+ packet[n++]=opOUTPUT_POWER;
+ packet[n++]=LC0(0);
+ packet[n++]=ex->right_port;
+ packet[n++]=0x81;
+ packet[n++]=(unsigned char)ex->power[action][1];
+ packet[n++]=opOUTPUT_START;
+ packet[n++]=LC0(0);
+ packet[n++]=ports;
+
+ packet[n++]=opTIMER_WAIT;
+ packet[n++]=0x82;
+ packet[n++]=ms&0xFF;
+ packet[n++]=(ms>>8)&0xFF;
+ packet[n++]=LV0(0);
+ packet[n++]=opTIMER_READY;
+ packet[n++]=LV0(0);
+
+ packet[n++]=opOUTPUT_STOP;
+ packet[n++]=LC0(0);
+ packet[n++]=ports;
+ packet[n++]=LC0(1);
+
+ if (action==MOVE_FORWARD)
+ {
+  // Same command as BT_read_colour_sensor()
+  packet[n++]=opINPUT_DEVICE;
+  packet[n++]=LC0(READY_RAW);
+  packet[n++]=LC0(0);
+  packet[n++]=ex->sensor_port;
+  packet[n++]=LC0(29);
+  packet[n++]=LC0(0x02);
+  packet[n++]=LC0(0x01);
+  packet[n++]=GV0(0x00);
+ }
+ packet[0]=(n-2)&0xFF;
+ packet[1]=((n-2)>>8)&0xFF;
+ return(n);
+}
+
+static int encode_route(struct executor *ex, const unsigned char *route, int len)
+{
+ // All packets for the route, with consecutive message ids. Returns 0 if out of memory or
+ // the route has an unknown action.
+ if (len>ex->capacity)
+ {
+  unsigned char (*p)[EXEC_PACKET_BYTES]=(unsigned char (*)[EXEC_PACKET_BYTES])realloc(ex->packet,(size_t)len*EXEC_PACKET_BYTES);
+  int *l=(int *)realloc(ex->packet_len,(size_t)len*sizeof(int));
+  if (p!=NULL) ex->packet=p;
+  if (l!=NULL) ex->packet_len=l;
+  if (p==NULL||l==NULL) return(0);
+  ex->capacity=len;
+ }
+ for (int k=0; k<len; k++)
+ {
+  ex->packet_len[k]=encode_action(ex,route[k],(unsigned short)(ex->message_id+k),ex->packet[k]);
+  if (ex->packet_len[k]==0) return(0);
+ }
+ return(1);
+}
+
+int execute_route(struct executor *ex, const unsigned char *route, int len, exec_done done, void *arg)
+{
+ // Runs the route with up to ex->window actions in flight, calling done() for each one as
+ // its reply comes back. Returns the number of actions completed (less than len if done()
+ // stopped the route), or -1 if the route could not be encoded or the link failed.
+ unsigned char reply[1024];
+ int next=0, k, n, go=1, colour;
+ unsigned short id;
+
+ ex->sent=0;
+ ex->completed=0;
+ if (len<=0) return(0);
+ if (encode_route(ex,route,len)==0)
+ {
+  fprintf(stderr,"execute_route(): Unable to encode the route\n");
+  return(-1);
+ }
+ for (k=0; k<len; k++)
+ {
+  // Keep the brick's queue topped up, unless the caller has asked to stop
+  while (go&&next<len&&next-k<ex->window)
+  {
+   if (ex->link.send(ex->packet[next],ex->packet_len[next],ex->link.arg)==0)
+   {
+    fprintf(stderr,"execute_route(): Unable to send action %d\n",next);
+    ex->message_id+=next;
+    return(-1);
+   }
+   ex->sent++;
+   next++;
+  }
+  if (k==next) break;                   // Stopped, and everything sent has come back
+
+  n=ex->link.receive(&reply[0],1024,ex->link.arg);
+  id=(unsigned short)(ex->message_id+k);
+  if (n<5||reply[2]!=(id&0xFF)||reply[3]!=((id>>8)&0xFF))
+  {
+   fprintf(stderr,"execute_route(): Missing or out of order reply for action %d\n",k);
+   ex->message_id+=next;
+   return(-1);
+  }
+  if (reply[4]!=0x02) fprintf(stderr,"execute_route(): The EV3 reported an error for action %d\n",k);
+  ex->completed++;
+  colour=(route[k]==MOVE_FORWARD&&n>5&&reply[4]==0x02)?reply[5]:-1;
+  if (done!=NULL&&done(k,route[k],colour,arg)==0) go=0;
+ }
+ ex->message_id+=next;
+ return(k);
+}
@@ -0,0 +1,82 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Pipelined route execution.
+
+ follow_route() runs a route one action at a time: send the commands for a drive or
+ turn, wait for it to finish, update the beliefs, and only then send the next one. Each
+ step pays a bluetooth round trip and the host's own work (prediction, monitor checks)
+ while the robot stands still. execute_route() overlaps the two instead.
+
+ Every action is encoded up front into a single EV3 direct command (a "packet", laid
+ out like the command strings in EV3_RobotControl/btcomm.c) that runs the whole motion
+ on the brick: set the wheel powers, start both motors, wait on a brick timer for the
+ action's run time, stop with the brakes on, and - after a drive - read the colour
+ sensor into the reply. The brick executes direct commands one after another, and one
+ waiting on its timer holds back the commands queued behind it, so the host can send
+ the packet for the next action while the current one is still moving. execute_route()
+ keeps up to window actions in flight, and every reply (in order, matched by message
+ id) marks one action as done: the caller's done() runs for it - belief prediction,
+ the intersection check, anything else - while the brick is already driving the next.
+
+ Motions are open loop: the run time of each action comes from struct route_costs
+ (seconds, e.g. learned by EV3_CostModel.h), the wheel powers from power[][]. A drive
+ is taken to have reached an intersection if the colour sensor reads yellow at the end.
+ When done() asks to stop, nothing more is sent, but the actions already queued on the
+ brick still run - done() is called for them too, so the caller's idea of where the
+ robot is stays right. With window 1 this is the sequential behaviour.
+
+ Packets go through struct exec_link - a pair of functions that write one command and
+ read one whole reply - so the same code runs over bluetooth (BT_send_command() and
+ BT_read_reply() in btcomm.c) or against the simulated brick of bench_executor.
+
+ In bench_executor, with a prediction step on a 300x300 map as the host's work (about
+ 1ms), the robot stands still about 5ms between actions with window 1 and under 1ms
+ (the simulation's own timer overhead) with window 2 or 3.
+
+*/
+
+#ifndef __executor_header
+#define __executor_header
+
+#include "EV3_Planner.h"
+
+#define EXEC_PACKET_BYTES 64
+#define EXEC_WINDOW 2               // Actions in flight - the one running and the one queued behind it
+#define EXEC_DRIVE_POWER 40         // Wheel power for MOVE_FORWARD...
+#define EXEC_SPIN_POWER 30          // ... and for turns in place (wheels in opposite directions)
+#define EXEC_INTERSECTION_COLOUR 4  // Indexed colour (yellow) the sensor sees at an intersection
+#define EXEC_MAX_RUN_MS 30000       // Longest run time one packet can encode
+
+struct exec_link{
+ int (*send)(const unsigned char *cmd, int len, void *arg);     // Writes one command, returns 1 on success
+ int (*receive)(unsigned char *reply, int max_len, void *arg);  // Reads one whole reply, returns its length (<=0 on failure)
+ void *arg;
+};
+
+// Called in route order as each action completes, with the colour read at the end of a
+// drive (-1 after turns). Return 1 to carry on, 0 to stop sending.
+typedef int (*exec_done)(int k, int action, int colour, void *arg);
+
+struct executor{
+ struct exec_link link;
+ char left_port, right_port;        // Motor ports (MOTOR_A ...) of the left and right wheels
+ char sensor_port;                  // Colour sensor port (PORT_1 ...)
+ signed char power[N_MOVES][2];     // Left and right wheel power for each action
+ int run_ms[N_MOVES];               // Run time of each action
+ int window;                        // Actions in flight at most
+ unsigned short message_id;         // Message id of the next packet
+ unsigned char (*packet)[EXEC_PACKET_BYTES];    // The route, encoded
+ int *packet_len;
+ int capacity;
+ long sent, completed;              // Packets sent and replies received by the last execute_route()
+};
+
+void init_executor(struct executor *ex, const struct exec_link *link, char left_port, char right_port, char sensor_port, const struct route_costs *c);
+void exec_set_timing(struct executor *ex, const struct route_costs *c);
+void free_executor(struct executor *ex);
+int encode_action(const struct executor *ex, int action, unsigned short message_id, unsigned char *packet);
+int execute_route(struct executor *ex, const unsigned char *route, int len, exec_done done, void *arg);
+
+#endif
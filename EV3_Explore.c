@@ -0,0 +1,263 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Information-gain exploration - see EV3_Explore.h
+
+*/
+
+#include <math.h>
+#include "EV3_Explore.h"
+
+int alloc_explorer(struct explorer *ex, int depth, int max_support, int n_threads)
+{
+ // Returns 1 on success, 0 if out of memory or depth is out of range
+ memset(ex,0,sizeof(struct explorer));
+ if (depth<0||depth>EXPLORE_MAX_DEPTH||max_support<1) return(0);
+ ex->depth=depth;
+ ex->max_support=max_support;
+ ex->prune=EXPLORE_PRUNE;
+ ex->n_threads=(n_threads>0)?n_threads:default_threads();
+ ex->n_workers=ex->n_threads;
+ ex->workers=(struct explore_worker *)calloc(ex->n_workers,sizeof(struct explore_worker));
+ ex->root=(struct sparse_entry *)calloc(max_support,sizeof(struct sparse_entry));
+ ex->tmp_state=(int *)calloc(max_support,sizeof(int));
+ ex->tmp_p=(double *)calloc(max_support,sizeof(double));
+ if (ex->workers==NULL||ex->root==NULL||ex->tmp_state==NULL||ex->tmp_p==NULL)
+ {
+  free_explorer(ex);
+  return(0);
+ }
+ for (int w=0; w<ex->n_workers; w++)
+ {
+  struct explore_worker *wk=&ex->workers[w];
+  for (int r=0; r<=depth; r++)
+  {
+   wk->pred[r]=(struct sparse_entry *)calloc(max_support,sizeof(struct sparse_entry));
+   wk->post[r]=(struct sparse_entry *)calloc(max_support,sizeof(struct sparse_entry));
+   if (wk->pred[r]==NULL||wk->post[r]==NULL)
+   {
+    free_explorer(ex);
+    return(0);
+   }
+  }
+  wk->memo=(struct explore_memo *)calloc((size_t)1<<EXPLORE_MEMO_BITS,sizeof(struct explore_memo));
+  if (wk->memo==NULL)
+  {
+   free_explorer(ex);
+   return(0);
+  }
+ }
+ return(1);
+}
+
+void free_explorer(struct explorer *ex)
+{
+ if (ex->workers!=NULL)
+  for (int w=0; w<ex->n_workers; w++)
+  {
+   for (int r=0; r<=EXPLORE_MAX_DEPTH; r++)
+   {
+    free(ex->workers[w].pred[r]);
+    free(ex->workers[w].post[r]);
+   }
+   free(ex->workers[w].memo);
+  }
+ free(ex->workers);
+ free(ex->root);
+ free(ex->tmp_state);
+ free(ex->tmp_p);
+ memset(ex,0,sizeof(struct explorer));
+}
+
+static inline unsigned long long mix64(unsigned long long z)
+{
+ z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+ z=(z^(z>>27))*0x94D049BB133111EBULL;
+ return(z^(z>>31));
+}
+
+static unsigned long long list_key(const struct sparse_entry *l, int cnt, int r)
+{
+ // Order-independent hash of the list (sum of per-entry hashes), probabilities rounded
+ // to 2^-24 so tiny differences in summation order still hit
+ unsigned long long h=0;
+
+ for (int e=0; e<cnt; e++)
+  h+=mix64(((unsigned long long)l[e].state<<32)^(unsigned long long)(l[e].p*16777216.0+0.5));
+ return(mix64(h^((unsigned long long)r*0x9E3779B97F4A7C15ULL))|1);
+}
+
+static double list_entropy(const struct sparse_entry *l, int cnt)
+{
+ double h=0;
+
+ for (int e=0; e<cnt; e++)
+  if (l[e].p>0) h-=l[e].p*log2(l[e].p);
+ return(h);
+}
+
+static void predict_list(const struct sparse_entry *in, int cnt, int action, struct sparse_entry *out)
+{
+ for (int e=0; e<cnt; e++)
+ {
+  out[e].state=macro_move(in[e].state,action);
+  out[e].p=in[e].p;
+ }
+}
+
+static void split_by_signature(const struct sparse_entry *l, int cnt, struct sparse_entry *out, int start[N_SIGNATURES+1], double mass[N_SIGNATURES])
+{
+ // Counting sort of l by the signature each state would scan - the posterior for outcome z
+ // is then out[start[z]] .. out[start[z+1]-1], normalized here, with probability mass[z]
+ int fill[N_SIGNATURES];
+
+ for (int z=0; z<N_SIGNATURES; z++)
+ {
+  mass[z]=0;
+  fill[z]=0;
+ }
+ for (int e=0; e<cnt; e++)
+ {
+  mass[map_sig[l[e].state]]+=l[e].p;
+  fill[map_sig[l[e].state]]++;
+ }
+ start[0]=0;
+ for (int z=0; z<N_SIGNATURES; z++)
+ {
+  start[z+1]=start[z]+fill[z];
+  fill[z]=start[z];
+ }
+ for (int e=0; e<cnt; e++)
+ {
+  int z=map_sig[l[e].state];
+  out[fill[z]].state=l[e].state;
+  out[fill[z]].p=l[e].p/mass[z];
+  fill[z]++;
+ }
+}
+
+static double value(struct explorer *ex, struct explore_worker *wk, const struct sparse_entry *l, int cnt, int r);
+
+static double expect(struct explorer *ex, struct explore_worker *wk, const struct sparse_entry *pred, int cnt, int r)
+{
+ // Expected entropy after scanning the predicted belief pred and then planning r-1 more steps
+ int start[N_SIGNATURES+1];
+ double mass[N_SIGNATURES];
+ double e=0;
+
+ split_by_signature(pred,cnt,wk->post[r],start,mass);
+ for (int z=0; z<N_SIGNATURES; z++)
+  if (start[z+1]-start[z]>1)
+   e+=mass[z]*value(ex,wk,wk->post[r]+start[z],start[z+1]-start[z],r-1);
+ return(e);
+}
+
+static double value(struct explorer *ex, struct explore_worker *wk, const struct sparse_entry *l, int cnt, int r)
+{
+ // Lowest expected entropy reachable from belief l with r macro actions left
+ struct explore_memo *m;
+ unsigned long long key;
+ double best, v;
+
+ if (cnt<=1) return(0);
+ if (r==0) return(list_entropy(l,cnt));
+ key=list_key(l,cnt,r);
+ m=&wk->memo[key&(((unsigned long long)1<<EXPLORE_MEMO_BITS)-1)];
+ if (m->generation==ex->generation&&m->key==key)
+ {
+  wk->hits++;
+  return(m->value);
+ }
+ wk->evaluations++;
+ best=INFINITY;
+ for (int a=0; a<N_MOVES; a++)
+ {
+  predict_list(l,cnt,a,wk->pred[r]);
+  v=expect(ex,wk,wk->pred[r],cnt,r);
+  if (v<best) best=v;
+ }
+ m->key=key;
+ m->generation=ex->generation;
+ m->value=best;
+ return(best);
+}
+
+static void first_level_task(int task, int worker, void *arg)
+{
+ // One (action, scan outcome) branch of the root - its probability-weighted expected entropy
+ struct explorer *ex=(struct explorer *)arg;
+ struct explore_worker *wk=&ex->workers[worker];
+ int a=task/N_SIGNATURES, z=task%N_SIGNATURES, r=ex->depth;
+ int start[N_SIGNATURES+1];
+ double mass[N_SIGNATURES];
+
+ predict_list(ex->root,ex->root_count,a,wk->pred[r]);
+ split_by_signature(wk->pred[r],ex->root_count,wk->post[r],start,mass);
+ ex->term[a][z]=0;
+ if (start[z+1]-start[z]>1)
+  ex->term[a][z]=mass[z]*value(ex,wk,wk->post[r]+start[z],start[z+1]-start[z],r-1);
+}
+
+static int plan(struct explorer *ex, double *expected_entropy)
+{
+ // Drops states below prune from ex->root, renormalizes it and searches from it
+ double sum=0, best=INFINITY, v;
+ int action=MOVE_FORWARD, c=0;
+
+ for (int e=0; e<ex->root_count; e++)
+  sum+=ex->root[e].p;
+ for (int e=0; e<ex->root_count; e++)
+  if (ex->root[e].p>0&&ex->root[e].p>=ex->prune*sum)
+   ex->root[c++]=ex->root[e];
+ sum=0;
+ for (int e=0; e<c; e++)
+  sum+=ex->root[e].p;
+ for (int e=0; e<c; e++)
+  ex->root[e].p/=sum;
+ ex->root_count=c;
+ if (ex->depth==0||c==0)
+ {
+  if (expected_entropy!=NULL) *expected_entropy=list_entropy(ex->root,c);
+  return(MOVE_FORWARD);
+ }
+
+ ex->generation++;
+ run_parallel(N_MOVES*N_SIGNATURES,ex->n_threads,first_level_task,ex);
+ for (int a=0; a<N_MOVES; a++)
+ {
+  v=0;
+  for (int z=0; z<N_SIGNATURES; z++)
+   v+=ex->term[a][z];
+  if (v<best-1e-12)
+  {
+   best=v;
+   action=a;
+  }
+ }
+ if (expected_entropy!=NULL) *expected_entropy=best;
+ return(action);
+}
+
+int select_action_sparse(struct explorer *ex, const struct sparse_entry *belief, int count, double *expected_entropy)
+{
+ // Best next macro action for a belief given as a (state, probability) list of at most
+ // max_support entries (any beyond that are ignored)
+ if (count>ex->max_support) count=ex->max_support;
+ memcpy(ex->root,belief,(size_t)count*sizeof(struct sparse_entry));
+ ex->root_count=count;
+ return(plan(ex,expected_entropy));
+}
+
+int select_action(struct explorer *ex, double (*b)[4], int n, double scale, double *expected_entropy)
+{
+ // Best next macro action for a dense (lazily scaled) belief, planned over its
+ // max_support most likely states
+ ex->root_count=top_states(b,n,scale,ex->max_support,ex->tmp_state,ex->tmp_p);
+ for (int e=0; e<ex->root_count; e++)
+ {
+  ex->root[e].state=ex->tmp_state[e];
+  ex->root[e].p=ex->tmp_p[e];
+ }
+ return(plan(ex,expected_entropy));
+}
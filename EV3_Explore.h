@@ -0,0 +1,84 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Information-gain exploration.
+
+ While localizing, every step is a macro action - optionally turn (left, right or
+ around) at the current intersection, drive to the next one, and scan it. Driving along
+ a symmetric part of the map teaches the robot nothing, so select_action() looks ahead:
+ for every sequence of up to depth macro actions, and every scan outcome along the way,
+ it works out the posterior belief, and picks the first action of the sequence with the
+ lowest expected posterior entropy (choosing the best action again after every
+ simulated scan - an expectimin search).
+
+ To keep this cheap:
+
+  * The belief is cut down to its max_support most likely states (top_states() in
+    EV3_SparseBeliefs.h), and states below prune of the mass are dropped. Planning uses
+    the noise-free transitions (move_state() in EV3_Motion.h), which permute states, so
+    the support never grows.
+  * Planning also treats the scan as noise-free, so a scan outcome z simply selects the
+    states whose map signature is z. The outcomes of a step then partition the support
+    (a counting sort by signature), and a whole level of the search costs O(support)
+    per action instead of O(81 x support). With the real sensor model every posterior
+    keeps some mass on the disagreeing states, which shifts all actions alike; what
+    separates good actions from bad ones is how finely they split the candidates.
+  * Expected entropies of sub-trees are memoised per worker, keyed by the remaining
+    depth and an order-independent hash of the (state, probability) list, so different
+    action orders that reach the same belief are only evaluated once.
+  * The first level (4 actions x 81 outcomes) is split into tasks that run in parallel
+    with run_parallel().
+
+ Actions are returned as MOVE_FORWARD (just drive on), MOVE_LEFT, MOVE_RIGHT or
+ MOVE_UTURN (turn that way, then drive).
+
+*/
+
+#ifndef __explore_header
+#define __explore_header
+
+#include "EV3_Motion.h"
+#include "EV3_Threads.h"
+
+#define EXPLORE_DEPTH 2             // Default look-ahead (macro actions)
+#define EXPLORE_MAX_DEPTH 6
+#define EXPLORE_SUPPORT 256         // Default number of states kept for planning
+#define EXPLORE_PRUNE 1e-4          // States with less than this fraction of the mass are not planned for
+#define EXPLORE_MEMO_BITS 14        // Memo table size per worker (entries, log2)
+
+struct explore_memo{
+ unsigned long long key;
+ unsigned int generation;
+ double value;
+};
+
+struct explore_worker{
+ struct sparse_entry *pred[EXPLORE_MAX_DEPTH+1];    // Scratch lists per remaining depth
+ struct sparse_entry *post[EXPLORE_MAX_DEPTH+1];
+ struct explore_memo *memo;
+ long evaluations;          // Sub-trees evaluated (memo misses)
+ long hits;                 // Memo hits
+};
+
+struct explorer{
+ int depth;
+ int max_support;
+ double prune;
+ int n_threads;             // 0 - default_threads()
+ int n_workers;
+ struct explore_worker *workers;
+ unsigned int generation;   // Memo entries from earlier decisions are ignored
+ struct sparse_entry *root; // The pruned belief being planned for
+ int root_count;
+ int *tmp_state;            // top_states() output
+ double *tmp_p;
+ double term[N_MOVES][N_SIGNATURES];        // Per first-level branch results
+};
+
+int alloc_explorer(struct explorer *ex, int depth, int max_support, int n_threads);
+void free_explorer(struct explorer *ex);
+int select_action(struct explorer *ex, double (*b)[4], int n, double scale, double *expected_entropy);
+int select_action_sparse(struct explorer *ex, const struct sparse_entry *belief, int count, double *expected_entropy);
+
+#endif
@@ -67,19 +67,56 @@ code that you have to complete in order to implement the localization algorithms
 #include<math.h>
 #include<malloc.h>
 #include "./EV3_RobotControl/btcomm.h"
+#include "EV3_Map.h"
+#include "EV3_MapCache.h"
+#include "EV3_Threads.h"
+#include "EV3_Beliefs.h"
+#include "EV3_SensorModel.h"
+#include "EV3_Monitor.h"
+#include "EV3_Planner.h"
+#include "EV3_RouteTable.h"
+#include "EV3_DStar.h"
+#include "EV3_QMDP.h"
+#include "EV3_CostModel.h"
+#include "EV3_Executor.h"
+#include "EV3_Motion.h"
+#include "EV3_Particles.h"
+#include "EV3_Explore.h"
+#include "EV3_Ambiguity.h"
 
 #ifndef HEXKEY
 	#define HEXKEY "00:16:53:56:07:89"	// <--- SET UP YOUR EV3's HEX ID here
 #endif
 
-int parse_map(unsigned char *map_img, int rx, int ry);
+#define LOCALIZED_PROB 0.9          // robot_localization() stops once one state has this belief
+#define MAX_LOCALIZATION_STEPS 200  // ... or gives up after this many intersections
+#define QMDP_MAX_ENTROPY 8.0        // ... and heads for the target once the beliefs are down to this many bits
+#define AMBIGUITY_MIN_GAIN 0.05     // Look-ahead expecting less entropy drop than this (bits) follows the stored separating sequence
+#define AMBIGUITY_MAX_SEQUENCE 256  // ... if it is at most this long
+#define MAX_TARGET_STEPS 500       // go_to_target() gives up after this many drives and turns...
+#define MAX_RELOCALIZATIONS 5       // ... or after getting lost this many times
+#define DRIVE_ATTEMPTS 2            // A street is taken to be blocked after this many failed drives along it
+#define PIPELINE_ROUTES 0           // 1 - go_to_target() drives routes open loop through EV3_Executor.h
+#define LEFT_WHEEL MOTOR_A          // Motor and sensor ports the executor's packets address
+#define RIGHT_WHEEL MOTOR_D
+#define COLOUR_SENSOR PORT_3
+#define CALIBRATION_SPOTS 3         // calibrate_sensor() samples each building colour at this many places...
+#define CALIBRATION_SAMPLES 50      // ... taking this many readings at each
+
 int robot_localization(int *robot_x, int *robot_y, int *direction);
 int go_to_target(int robot_x, int robot_y, int direction, int target_x, int target_y);
+int follow_route(const unsigned char *route, int len, int *state, int *steps);
+int follow_route_pipelined(const unsigned char *route, int len, int *state, int *steps);
+int watch_intersection(int state);
+int relocalize(int *state);
+int turn_action(int action);
+int timed_drive(void);
+int timed_turn(int action);
+int refresh_route_costs(void);
 int find_street(void);
 int drive_along_street(void);
 int scan_intersection(int *tl, int *tr, int *br, int *bl);
 int turn_at_intersection(int turn_direction);
 void calibrate_sensor(void);
-unsigned char *readPPMimage(const char *filename, int *rx, int*ry);
 
 #endif
@@ -0,0 +1,314 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Log-domain and fixed-point belief representations - see EV3_LogBeliefs.h
+
+*/
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include <math.h>
+#include <string.h>
+#include "EV3_LogBeliefs.h"
+
+#define LOG_ALIGN 32
+
+static void *alloc_aligned(size_t bytes)
+{
+ void *p=NULL;
+
+ if (posix_memalign(&p,LOG_ALIGN,bytes)!=0) return(NULL);
+ memset(p,0,bytes);
+ return(p);
+}
+
+void misread_loglikelihoods(double misread, float loglike[5])
+{
+ // log of the per-count likelihoods of update_beliefs_counts()
+ for (int m=0; m<=4; m++)
+  loglike[m]=(float)((m*log(1.0-misread))+((4-m)*log(misread/2.0)));
+}
+
+/******************************************************************************************
+ * Float log-beliefs
+ ******************************************************************************************/
+
+int alloc_belief_log(struct belief_log *bl, int n)
+{
+ size_t bytes=((((size_t)n+7)/8)*8)*sizeof(float);
+
+ bl->n=n;
+ for (int d=0; d<4; d++)
+  bl->l[d]=NULL;
+ for (int d=0; d<4; d++)
+ {
+  bl->l[d]=(float *)alloc_aligned(bytes);
+  if (bl->l[d]==NULL)
+  {
+   free_belief_log(bl);
+   return(0);
+  }
+ }
+ return(1);
+}
+
+void free_belief_log(struct belief_log *bl)
+{
+ for (int d=0; d<4; d++)
+ {
+  free(bl->l[d]);
+  bl->l[d]=NULL;
+ }
+}
+
+void init_belief_log(struct belief_log *bl)
+{
+ // Uniform - all log-beliefs equal, the normalizer takes care of the 1/(4n)
+ for (int d=0; d<4; d++)
+  for (int i=0; i<bl->n; i++)
+   bl->l[d][i]=0;
+ bl->offset=0;
+ bl->max=0;
+}
+
+static void recenter_log(struct belief_log *bl)
+{
+ // Shifts the array so its maximum is 0, clamping anything below LOG_FLOOR
+ float m=bl->max;
+
+ for (int d=0; d<4; d++)
+  for (int i=0; i<bl->n; i++)
+  {
+   float v=bl->l[d][i]-m;
+   bl->l[d][i]=(v<LOG_FLOOR)?LOG_FLOOR:v;
+  }
+ bl->offset+=m;
+ bl->max=0;
+}
+
+static float add_track_max(float *l, const unsigned char *cnt, int n, const float loglike[5])
+{
+ // l[i]+=loglike[cnt[i]], returns the maximum of the updated values
+ float mx=-INFINITY;
+ int i=0;
+
+#if defined(__AVX2__)
+ {
+  __m256 tbl=_mm256_setr_ps(loglike[0],loglike[1],loglike[2],loglike[3],loglike[4],0,0,0);
+  __m256 vmax=_mm256_set1_ps(-INFINITY);
+  float lanes[8];
+  for (; i+8<=n; i+=8)
+  {
+   __m256 ll=_mm256_permutevar8x32_ps(tbl,_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(cnt+i))));
+   __m256 v=_mm256_add_ps(_mm256_load_ps(l+i),ll);
+   _mm256_store_ps(l+i,v);
+   vmax=_mm256_max_ps(vmax,v);
+  }
+  _mm256_storeu_ps(&lanes[0],vmax);
+  for (int k=0; k<8; k++) if (lanes[k]>mx) mx=lanes[k];
+ }
+#endif
+ for (; i<n; i++)
+ {
+  l[i]+=loglike[cnt[i]];
+  if (l[i]>mx) mx=l[i];
+ }
+ return(mx);
+}
+
+void update_belief_log(struct belief_log *bl, const unsigned char *counts, const float loglike[5])
+{
+ // Measurement update in the log domain - one add per state, no normalization
+ float mx=-INFINITY, m;
+
+ for (int d=0; d<4; d++)
+ {
+  m=add_track_max(bl->l[d],counts+((size_t)d*bl->n),bl->n,loglike);
+  if (m>mx) mx=m;
+ }
+ bl->max=mx;
+ if (mx>LOG_RECENTER||mx<-LOG_RECENTER) recenter_log(bl);
+}
+
+double belief_log_normalizer(struct belief_log *bl)
+{
+ // Log-sum-exp of the stored values (relative to offset), so that
+ // P(idx,d)=exp(l[d][idx]-lse). Computed around the tracked max so exp() never overflows.
+ double sum=0;
+
+ for (int d=0; d<4; d++)
+  for (int i=0; i<bl->n; i++)
+   sum+=exp((double)(bl->l[d][i]-bl->max));
+ return(bl->max+log(sum));
+}
+
+void log_to_beliefs(struct belief_log *bl, double (*b)[4], double *scale)
+{
+ double lse=belief_log_normalizer(bl);
+
+ for (int i=0; i<bl->n; i++)
+  for (int d=0; d<4; d++)
+   b[i][d]=exp(bl->l[d][i]-lse);
+ *scale=1.0;
+}
+
+/******************************************************************************************
+ * Fixed-point log-beliefs
+ ******************************************************************************************/
+
+void fix_loglikelihoods(const float loglike[5], belief_fix_t fix[5])
+{
+ // Rounds float log-likelihoods to the fixed-point format. They are limited to half the
+ // floor, so adding one to a value at the floor can never overflow the integer type.
+ for (int m=0; m<=4; m++)
+ {
+  double v=floor((loglike[m]*(double)BELIEF_FIX_ONE)+0.5);
+  fix[m]=(belief_fix_t)((v<(double)(BELIEF_FIX_MIN/2))?(BELIEF_FIX_MIN/2):v);
+ }
+}
+
+int alloc_belief_fix(struct belief_fix *bf, int n)
+{
+ size_t bytes=((((size_t)n+15)/16)*16)*sizeof(belief_fix_t);
+
+ bf->n=n;
+ for (int d=0; d<4; d++)
+  bf->l[d]=NULL;
+ for (int d=0; d<4; d++)
+ {
+  bf->l[d]=(belief_fix_t *)alloc_aligned(bytes);
+  if (bf->l[d]==NULL)
+  {
+   free_belief_fix(bf);
+   return(0);
+  }
+ }
+ return(1);
+}
+
+void free_belief_fix(struct belief_fix *bf)
+{
+ for (int d=0; d<4; d++)
+ {
+  free(bf->l[d]);
+  bf->l[d]=NULL;
+ }
+}
+
+void init_belief_fix(struct belief_fix *bf)
+{
+ for (int d=0; d<4; d++)
+  memset(bf->l[d],0,(size_t)bf->n*sizeof(belief_fix_t));
+ bf->max=0;
+}
+
+static inline belief_fix_t sat_add(belief_fix_t a, long long b)
+{
+ long long v=(long long)a+b;
+ long long hi=(BELIEF_FIXED_BITS==16)?32767LL:2147483647LL;
+ if (v<(long long)BELIEF_FIX_MIN) return((belief_fix_t)BELIEF_FIX_MIN);
+ if (v>hi) return((belief_fix_t)hi);
+ return((belief_fix_t)v);
+}
+
+static int fix_add_track_max(belief_fix_t *l, const unsigned char *cnt, int n, const belief_fix_t ll[5])
+{
+ int mx=BELIEF_FIX_MIN;
+ int i=0;
+
+#if BELIEF_FIXED_BITS==16 && defined(__SSSE3__)
+ {
+  // Two pshufb table lookups give the low and high bytes of the 16-bit log-likelihood
+  // for 16 counts at once, then a saturating add handles the floor for free
+  unsigned char lo[16], hi[16];
+  short lanes[8];
+  memset(&lo[0],0,16);
+  memset(&hi[0],0,16);
+  for (int m=0; m<=4; m++)
+  {
+   lo[m]=(unsigned char)(ll[m]&0xFF);
+   hi[m]=(unsigned char)((ll[m]>>8)&0xFF);
+  }
+  __m128i tlo=_mm_loadu_si128((const __m128i *)&lo[0]);
+  __m128i thi=_mm_loadu_si128((const __m128i *)&hi[0]);
+  __m128i vmax=_mm_set1_epi16(BELIEF_FIX_MIN);
+  for (; i+16<=n; i+=16)
+  {
+   __m128i c=_mm_loadu_si128((const __m128i *)(cnt+i));
+   __m128i vlo=_mm_shuffle_epi8(tlo,c);
+   __m128i vhi=_mm_shuffle_epi8(thi,c);
+   __m128i v0=_mm_adds_epi16(_mm_load_si128((const __m128i *)(l+i)),_mm_unpacklo_epi8(vlo,vhi));
+   __m128i v1=_mm_adds_epi16(_mm_load_si128((const __m128i *)(l+i+8)),_mm_unpackhi_epi8(vlo,vhi));
+   _mm_store_si128((__m128i *)(l+i),v0);
+   _mm_store_si128((__m128i *)(l+i+8),v1);
+   vmax=_mm_max_epi16(vmax,_mm_max_epi16(v0,v1));
+  }
+  _mm_storeu_si128((__m128i *)&lanes[0],vmax);
+  for (int k=0; k<8; k++) if (lanes[k]>mx) mx=lanes[k];
+ }
+#elif BELIEF_FIXED_BITS==32 && defined(__AVX2__)
+ {
+  // Values are >= BELIEF_FIX_MIN and log-likelihoods >= BELIEF_FIX_MIN/2, so a plain add
+  // can not wrap, and a max with the floor gives the same result as a saturating add
+  __m256i tbl=_mm256_setr_epi32(ll[0],ll[1],ll[2],ll[3],ll[4],0,0,0);
+  __m256i vmax=_mm256_set1_epi32(BELIEF_FIX_MIN);
+  __m256i vfloor=_mm256_set1_epi32(BELIEF_FIX_MIN);
+  int lanes[8];
+  for (; i+8<=n; i+=8)
+  {
+   __m256i v=_mm256_add_epi32(_mm256_load_si256((const __m256i *)(l+i)),
+                              _mm256_permutevar8x32_epi32(tbl,_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(cnt+i)))));
+   v=_mm256_max_epi32(v,vfloor);
+   _mm256_store_si256((__m256i *)(l+i),v);
+   vmax=_mm256_max_epi32(vmax,v);
+  }
+  _mm256_storeu_si256((__m256i *)&lanes[0],vmax);
+  for (int k=0; k<8; k++) if (lanes[k]>mx) mx=lanes[k];
+ }
+#endif
+ for (; i<n; i++)
+ {
+  l[i]=sat_add(l[i],ll[cnt[i]]);
+  if (l[i]>mx) mx=l[i];
+ }
+ return(mx);
+}
+
+void update_belief_fix(struct belief_fix *bf, const unsigned char *counts, const belief_fix_t loglike[5])
+{
+ // Measurement update in fixed point - integer adds only
+ int mx=BELIEF_FIX_MIN, m;
+
+ for (int d=0; d<4; d++)
+ {
+  m=fix_add_track_max(bf->l[d],counts+((size_t)d*bf->n),bf->n,loglike);
+  if (m>mx) mx=m;
+ }
+ bf->max=mx;
+ if (mx<-BELIEF_FIX_RECENTER||mx>BELIEF_FIX_RECENTER)
+ {
+  // Shift back so the max is 0, values that were already at the floor stay there
+  for (int d=0; d<4; d++)
+   for (int i=0; i<bf->n; i++)
+    if (bf->l[d][i]!=BELIEF_FIX_MIN) bf->l[d][i]=sat_add(bf->l[d][i],-(long long)mx);
+  bf->max=0;
+ }
+}
+
+void fix_to_beliefs(struct belief_fix *bf, double (*b)[4], double *scale)
+{
+ double sum=0;
+
+ for (int i=0; i<bf->n; i++)
+  for (int d=0; d<4; d++)
+  {
+   b[i][d]=exp((double)(bf->l[d][i]-bf->max)/(double)BELIEF_FIX_ONE);
+   sum+=b[i][d];
+  }
+ for (int i=0; i<bf->n; i++)
+  for (int d=0; d<4; d++)
+   b[i][d]/=sum;
+ *scale=1.0;
+}
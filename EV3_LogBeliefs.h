@@ -0,0 +1,87 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Log-domain and fixed-point belief representations.
+
+ Long exploration runs multiply many small likelihoods into every belief, which underflows
+ doubles and needs a normalization pass over every state after every step. In the log
+ domain a measurement update is one addition per state, and normalization can wait until
+ somebody actually needs probabilities.
+
+ struct belief_log - float log-beliefs, one array per facing direction (same layout as
+ struct belief_soa in EV3_Beliefs.h). The stored values are unnormalized:
+
+     log P(idx,d) = l[d][idx] + offset - lse
+
+ update_belief_log() adds the per-count log-likelihood to every state and tracks the
+ maximum in the same pass. Whenever the maximum has drifted more than LOG_RECENTER away
+ from 0 the array is shifted back (and the shift moved into offset), so float precision
+ is never lost. The log-sum-exp lse is only computed by belief_log_normalizer(), on demand.
+
+ struct belief_fix - the same idea in fixed point: integer log-beliefs in units of
+ 1/BELIEF_FIX_ONE nats, so an update is a saturating integer add (8 or 16 states per SSE
+ instruction). The width is selected at compile time:
+
+     -DBELIEF_FIXED_BITS=16   (default) int16, 1/32 nat resolution, ~1000 nat range
+     -DBELIEF_FIXED_BITS=32   int32, 1/65536 nat resolution
+
+ Counts for both come from match_scan_packed_soa() (counts[(d*n)+idx]).
+
+*/
+
+#ifndef __log_beliefs_header
+#define __log_beliefs_header
+
+#include "EV3_Beliefs.h"
+
+#ifndef BELIEF_FIXED_BITS
+#define BELIEF_FIXED_BITS 16
+#endif
+
+#if BELIEF_FIXED_BITS==16
+typedef short belief_fix_t;
+#define BELIEF_FIX_ONE 32               // Units per nat
+#define BELIEF_FIX_MIN (-32768)
+#define BELIEF_FIX_RECENTER 16384       // Shift the array back once the max drops this low
+#elif BELIEF_FIXED_BITS==32
+typedef int belief_fix_t;
+#define BELIEF_FIX_ONE 65536
+#define BELIEF_FIX_MIN (-1073741824)    // Floor well inside int32, so a plain add can not wrap
+#define BELIEF_FIX_RECENTER 268435456
+#else
+#error "BELIEF_FIXED_BITS must be 16 or 32"
+#endif
+
+#define LOG_RECENTER 64.0f          // Max drift (nats) of the float log-beliefs before shifting back
+#define LOG_FLOOR (-1000.0f)        // Log-beliefs this far below the max are clamped when shifting
+
+struct belief_log{
+ int n;                     // Number of intersections
+ float *l[4];               // l[d][idx] - unnormalized log-belief
+ double offset;             // Accumulated shifts, see above
+ float max;                 // Largest value in l[][]
+};
+
+struct belief_fix{
+ int n;
+ belief_fix_t *l[4];        // l[d][idx] - unnormalized log-belief, 1/BELIEF_FIX_ONE nats per unit
+ int max;
+};
+
+void misread_loglikelihoods(double misread, float loglike[5]);
+int alloc_belief_log(struct belief_log *bl, int n);
+void free_belief_log(struct belief_log *bl);
+void init_belief_log(struct belief_log *bl);
+void update_belief_log(struct belief_log *bl, const unsigned char *counts, const float loglike[5]);
+double belief_log_normalizer(struct belief_log *bl);
+void log_to_beliefs(struct belief_log *bl, double (*b)[4], double *scale);
+
+void fix_loglikelihoods(const float loglike[5], belief_fix_t fix[5]);
+int alloc_belief_fix(struct belief_fix *bf, int n);
+void free_belief_fix(struct belief_fix *bf);
+void init_belief_fix(struct belief_fix *bf);
+void update_belief_fix(struct belief_fix *bf, const unsigned char *counts, const belief_fix_t loglike[5]);
+void fix_to_beliefs(struct belief_fix *bf, double (*b)[4], double *scale);
+
+#endif
@@ -0,0 +1,626 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Map parsing and storage - see EV3_Map.h for the conventions used by map[][], and the
+ derived signature/neighbour tables built from it.
+
+ parse_map() and readPPMimage() are the starter code versions, moved here from
+ EV3_Localization.c so that tools which do not talk to the robot can use them. The
+ map[][] array is now allocated to fit the parsed map instead of being limited to
+ 20x20 intersections.
+
+*/
+
+#include <sys/mman.h>
+#include "EV3_Map.h"
+#include "EV3_Threads.h"
+
+int (*map)[4]=NULL;         // This holds the representation of the map, sx*sy intersections,
+                            // raster ordered, 4 building colours per intersection.
+int sx, sy;                 // Size of the map (number of intersections along x and y)
+struct map_geometry map_geom;
+unsigned char *map_sig=NULL;
+unsigned char *map_packed=NULL;
+int *map_nbr=NULL;
+int *map_sig_start=NULL;
+int *map_sig_states=NULL;
+void *map_mapped=NULL;      // Non-NULL if the arrays above live in a mapped compiled map
+size_t map_mapped_size=0;
+int parse_verbose=1;        // parse_map() prints every intersection while this is set
+
+int parse_map(unsigned char *map_img, int rx, int ry)
+{
+ /*
+   This function takes an input image map array, and two integers that specify the image size.
+   It attempts to parse this image into a representation of the map in the image. The size
+   and resolution of the map image should not affect the parsing (i.e. you can make your own
+   maps without worrying about the exact position of intersections, roads, buildings, etc.).
+
+   However, this function requires:
+   
+   * White background for the image  [255 255 255]
+   * Red borders around the map  [255 0 0]
+   * Black roads  [0 0 0]
+   * Yellow intersections  [255 255 0]
+   * Buildings that are pure green [0 255 0], pure blue [0 0 255], or white [255 255 255]
+   (any other colour values are ignored - so you can add markings if you like, those 
+    will not affect parsing)
+
+   The image must be a properly formated .ppm image, see readPPMimage below for details of
+   the format. The GIMP image editor saves properly formatted .ppm images, as does the
+   imagemagick image processing suite.
+   
+   The map representation is read into the map array, with each row in the array corrsponding
+   to one intersection, in raster order, that is, for a map with k intersections along its width:
+   
+    (row index for the intersection)
+    
+    0     1     2    3 ......   k-1
+    
+    k    k+1   k+2  ........    
+    
+    Each row will then contain the colour values for buildings around the intersection 
+    clockwise from top-left, that is
+    
+    
+    top-left               top-right
+            
+            intersection
+    
+    bottom-left           bottom-right
+    
+    So, for the first intersection (at row 0 in the map array)
+    map[0][0] <---- colour for the top-left building
+    map[0][1] <---- colour for the top-right building
+    map[0][2] <---- colour for the bottom-right building
+    map[0][3] <---- colour for the bottom-left building
+    
+    Color values for map locations are defined as follows (this agrees with what the
+    EV3 sensor returns in indexed-colour-reading mode):
+    
+    1 -  Black
+    2 -  Blue
+    3 -  Green
+    4 -  Yellow
+    5 -  Red
+    6 -  White
+    
+    If you find a 0, that means you're trying to access an intersection that is not on the
+    map! Also note that in practice, because of how the map is defined, you should find
+    only Green, Blue, or White around a given intersection.
+    
+    The map size (the number of intersections along the horizontal and vertical directions) is
+    updated and left in the global variables sx and sy.
+
+    Feel free to create your own maps for testing (you'll have to print them to a reasonable
+    size to use with your bot).
+    
+ */    
+ 
+ int last3[3];
+ int x,y;
+ unsigned char R,G,B;
+ int ix,iy;
+ int bx,by,dx,dy,wx,wy;         // Intersection geometry parameters
+ int tgl;
+ int idx;
+ 
+ ix=iy=0;       // Index to identify the current intersection
+ 
+ // Determine the spacing and size of intersections in the map
+ tgl=0;
+ for (int i=0; i<rx; i++)
+ {
+  for (int j=0; j<ry; j++)
+  {
+   R=*(map_img+((i+(j*rx))*3));
+   G=*(map_img+((i+(j*rx))*3)+1);
+   B=*(map_img+((i+(j*rx))*3)+2);
+   if (R==255&&G==255&&B==0)
+   {
+    // First intersection, top-left pixel. Scan right to find width and spacing
+    bx=i;           // Anchor for intersection locations
+    by=j;
+    for (int k=i; k<rx; k++)        // Find width and horizontal distance to next intersection
+    {
+     R=*(map_img+((k+(by*rx))*3));
+     G=*(map_img+((k+(by*rx))*3)+1);
+     B=*(map_img+((k+(by*rx))*3)+2);
+     if (tgl==0&&(R!=255||G!=255||B!=0))
+     {
+      tgl=1;
+      wx=k-i;
+     }
+     if (tgl==1&&R==255&&G==255&&B==0)
+     {
+      tgl=2;
+      dx=k-i;
+     }
+    }
+    for (int k=j; k<ry; k++)        // Find height and vertical distance to next intersection
+    {
+     R=*(map_img+((bx+(k*rx))*3));
+     G=*(map_img+((bx+(k*rx))*3)+1);
+     B=*(map_img+((bx+(k*rx))*3)+2);
+     if (tgl==2&&(R!=255||G!=255||B!=0))
+     {
+      tgl=3;
+      wy=k-j;
+     }
+     if (tgl==3&&R==255&&G==255&&B==0)
+     {
+      tgl=4;
+      dy=k-j;
+     }
+    }
+    
+    if (tgl!=4)
+    {
+     fprintf(stderr,"Unable to determine intersection geometry!\n");
+     return(0);
+    }
+    else break;
+   }
+  }
+  if (tgl==4) break;
+ }
+ if (tgl!=4)
+ {
+  fprintf(stderr,"No intersections found in the map!\n");
+  return(0);
+ }
+  fprintf(stderr,"Intersection parameters: base_x=%d, base_y=%d, width=%d, height=%d, horiz_distance=%d, vertical_distance=%d\n",bx,by,wx,wy,dx,dy);
+
+  sx=0;
+  for (int i=bx+(wx/2);i<rx;i+=dx)
+  {
+   R=*(map_img+((i+(by*rx))*3));
+   G=*(map_img+((i+(by*rx))*3)+1);
+   B=*(map_img+((i+(by*rx))*3)+2);
+   if (R==255&&G==255&&B==0) sx++;
+  }
+
+  sy=0;
+  for (int j=by+(wy/2);j<ry;j+=dy)
+  {
+   R=*(map_img+((bx+(j*rx))*3));
+   G=*(map_img+((bx+(j*rx))*3)+1);
+   B=*(map_img+((bx+(j*rx))*3)+2);
+   if (R==255&&G==255&&B==0) sy++;
+  }
+  
+  fprintf(stderr,"Map size: Number of horizontal intersections=%d, number of vertical intersections=%d\n",sx,sy);
+  if (sx<=0||sy<=0)
+  {
+   fprintf(stderr,"No intersections found in the map!\n");
+   return(0);
+  }
+  if (alloc_map(sx,sy)==0) return(0);
+  map_geom.bx=bx;
+  map_geom.by=by;
+  map_geom.wx=wx;
+  map_geom.wy=wy;
+  map_geom.dx=dx;
+  map_geom.dy=dy;
+
+  // Scan for building colours around each intersection
+  idx=0;
+  for (int j=0; j<sy; j++)
+   for (int i=0; i<sx; i++)
+   {
+    x=bx+(i*dx)+(wx/2);
+    y=by+(j*dy)+(wy/2);
+    
+    if (parse_verbose) fprintf(stderr,"Intersection location: %d, %d\n",x,y);
+    // Top-left
+    x-=wx;
+    y-=wy;
+    R=*(map_img+((x+(y*rx))*3));
+    G=*(map_img+((x+(y*rx))*3)+1);
+    B=*(map_img+((x+(y*rx))*3)+2);
+    if (R==0&&G==255&&B==0) map[idx][0]=3;
+    else if (R==0&&G==0&&B==255) map[idx][0]=2;
+    else if (R==255&&G==255&&B==255) map[idx][0]=6;
+    else fprintf(stderr,"Colour is not valid for intersection %d,%d, Top-Left RGB=%d,%d,%d\n",i,j,R,G,B);
+
+    // Top-right
+    x+=2*wx;
+    R=*(map_img+((x+(y*rx))*3));
+    G=*(map_img+((x+(y*rx))*3)+1);
+    B=*(map_img+((x+(y*rx))*3)+2);
+    if (R==0&&G==255&&B==0) map[idx][1]=3;
+    else if (R==0&&G==0&&B==255) map[idx][1]=2;
+    else if (R==255&&G==255&&B==255) map[idx][1]=6;
+    else fprintf(stderr,"Colour is not valid for intersection %d,%d, Top-Right RGB=%d,%d,%d\n",i,j,R,G,B);
+
+    // Bottom-right
+    y+=2*wy;
+    R=*(map_img+((x+(y*rx))*3));
+    G=*(map_img+((x+(y*rx))*3)+1);
+    B=*(map_img+((x+(y*rx))*3)+2);
+    if (R==0&&G==255&&B==0) map[idx][2]=3;
+    else if (R==0&&G==0&&B==255) map[idx][2]=2;
+    else if (R==255&&G==255&&B==255) map[idx][2]=6;
+    else fprintf(stderr,"Colour is not valid for intersection %d,%d, Bottom-Right RGB=%d,%d,%d\n",i,j,R,G,B);
+    
+    // Bottom-left
+    x-=2*wx;
+    R=*(map_img+((x+(y*rx))*3));
+    G=*(map_img+((x+(y*rx))*3)+1);
+    B=*(map_img+((x+(y*rx))*3)+2);
+    if (R==0&&G==255&&B==0) map[idx][3]=3;
+    else if (R==0&&G==0&&B==255) map[idx][3]=2;
+    else if (R==255&&G==255&&B==255) map[idx][3]=6;
+    else fprintf(stderr,"Colour is not valid for intersection %d,%d, Bottom-Left RGB=%d,%d,%d\n",i,j,R,G,B);
+    
+    if (parse_verbose) fprintf(stderr,"Colours for this intersection: %d, %d, %d, %d\n",map[idx][0],map[idx][1],map[idx][2],map[idx][3]);
+    
+    idx++;
+   }
+
+ return(build_map_tables());
+}
+
+unsigned char *readPPMimage(const char *filename, int *rx, int *ry)
+{
+ // Reads an image from a .ppm file. A .ppm file is a very simple image representation
+ // format with a text header followed by the binary RGB data at 24bits per pixel.
+ // The header has the following form:
+ //
+ // P6
+ // # One or more comment lines preceded by '#'
+ // 340 200
+ // 255
+ //
+ // The first line 'P6' is the .ppm format identifier, this is followed by one or more
+ // lines with comments, typically used to inidicate which program generated the
+ // .ppm file.
+ // After the comments, a line with two integer values specifies the image resolution
+ // as number of pixels in x and number of pixels in y.
+ // The final line of the header stores the maximum value for pixels in the image,
+ // usually 255.
+ // After this last header line, binary data stores the RGB values for each pixel
+ // in row-major order. Each pixel requires 3 bytes ordered R, G, and B.
+ //
+ // NOTE: Windows file handling is rather crotchetty. You may have to change the
+ //       way this file is accessed if the images are being corrupted on read
+ //       on Windows.
+ //
+
+ FILE *f;
+ unsigned char *im;
+ char line[1024];
+ int i;
+ unsigned char *tmp;
+ double *fRGB;
+
+ im=NULL;
+ f=fopen(filename,"rb+");
+ if (f==NULL)
+ {
+  fprintf(stderr,"Unable to open file %s for reading, please check name and path\n",filename);
+  return(NULL);
+ }
+ fgets(&line[0],1000,f);
+ if (strcmp(&line[0],"P6\n")!=0)
+ {
+  fprintf(stderr,"Wrong file format, not a .ppm file or header end-of-line characters missing\n");
+  fclose(f);
+  return(NULL);
+ }
+ fprintf(stderr,"%s\n",line);
+ // Skip over comments
+ fgets(&line[0],511,f);
+ while (line[0]=='#')
+ {
+  fprintf(stderr,"%s",line);
+  fgets(&line[0],511,f);
+ }
+ sscanf(&line[0],"%d %d\n",rx,ry);                  // Read image size
+ fprintf(stderr,"nx=%d, ny=%d\n\n",*rx,*ry);
+
+ fgets(&line[0],9,f);  	                // Read the remaining header line
+ fprintf(stderr,"%s\n",line);
+ im=(unsigned char *)calloc((*rx)*(*ry)*3,sizeof(unsigned char));
+ if (im==NULL)
+ {
+  fprintf(stderr,"Out of memory allocating space for image\n");
+  fclose(f);
+  return(NULL);
+ }
+ fread(im,(*rx)*(*ry)*3*sizeof(unsigned char),1,f);
+ fclose(f);
+
+ return(im);    
+}
+
+int alloc_map(int size_x, int size_y)
+{
+ // Allocates (zeroed) storage for a map of size_x * size_y intersections, releasing
+ // any map held previously. Returns 1 on success, 0 if out of memory.
+ free_map();
+ map=(int (*)[4])calloc((size_t)size_x*size_y,sizeof(int[4]));
+ map_sig=(unsigned char *)calloc((size_t)size_x*size_y*4,sizeof(unsigned char));
+ map_packed=(unsigned char *)calloc((size_t)size_x*size_y,sizeof(unsigned char));
+ map_nbr=(int *)calloc((size_t)size_x*size_y*4,sizeof(int));
+ map_sig_start=(int *)calloc(N_SIGNATURES+1,sizeof(int));
+ map_sig_states=(int *)calloc((size_t)size_x*size_y*4,sizeof(int));
+ if (map==NULL||map_sig==NULL||map_packed==NULL||map_nbr==NULL||map_sig_start==NULL||map_sig_states==NULL)
+ {
+  fprintf(stderr,"Out of memory allocating space for a %d x %d map\n",size_x,size_y);
+  free_map();
+  return(0);
+ }
+ sx=size_x;
+ sy=size_y;
+ return(1);
+}
+
+static void intersection_tables(int i, int j)
+{
+ int idx=i+(j*sx);
+
+ for (int d=0; d<4; d++)
+  map_sig[(idx*4)+d]=(unsigned char)map_signature(idx,d);
+ map_packed[idx]=pack_colours(map[idx][0],map[idx][1],map[idx][2],map[idx][3]);
+ map_nbr[(idx*4)+0]=(j>0)?idx-sx:-1;
+ map_nbr[(idx*4)+1]=(i<sx-1)?idx+1:-1;
+ map_nbr[(idx*4)+2]=(j<sy-1)?idx+sx:-1;
+ map_nbr[(idx*4)+3]=(i>0)?idx-1:-1;
+}
+
+int build_map_tables(void)
+{
+ // Fills in the derived tables from map[][]:
+ //  map_sig[] - the signature the robot would read at each intersection for each facing direction
+ //  map_packed[] - the building colours packed into one byte per intersection
+ //  map_nbr[] - the intersection reached by driving one block in each direction, -1 if that
+ //              would cross the red border
+ //  map_sig_start[], map_sig_states[] - the inverted signature index
+ if (map==NULL||map_sig==NULL||map_packed==NULL||map_nbr==NULL) return(0);
+ for (int j=0; j<sy; j++)
+  for (int i=0; i<sx; i++)
+   intersection_tables(i,j);
+ build_signature_index();
+ return(1);
+}
+
+void build_signature_index(void)
+{
+ // Groups all (intersection, direction) states by the signature the robot would read there,
+ // so a measurement update only has to visit the states that agree with the scan (see
+ // EV3_Beliefs.h). Counting sort over map_sig[], states stay in increasing order per signature.
+ int n=sx*sy*4;
+ int fill[N_SIGNATURES];
+
+ memset(map_sig_start,0,(N_SIGNATURES+1)*sizeof(int));
+ for (int s=0; s<n; s++)
+  map_sig_start[map_sig[s]+1]++;
+ for (int g=0; g<N_SIGNATURES; g++)
+  map_sig_start[g+1]+=map_sig_start[g];
+ memcpy(&fill[0],map_sig_start,N_SIGNATURES*sizeof(int));
+ for (int s=0; s<n; s++)
+  map_sig_states[fill[map_sig[s]]++]=s;
+}
+
+/*
+  Tiled, multithreaded version of parse_map() for very large (scanned, high-DPI) map images.
+
+  It produces exactly the same map as parse_map(), but:
+
+  * The search for the first intersection pixel is done over horizontal tiles of the image,
+    each tile scanned in row-major order (the serial version walks the image column by column,
+    which touches a new cache line for every pixel). Each tile reports the left-most, then
+    top-most, yellow pixel it contains and the tiles are reduced to the overall first pixel.
+
+  * Building colours are read per tile. An intersection belongs to the tile that contains its
+    centre row, so intersections straddling a tile border are processed exactly once - their
+    building samples are simply read from the neighbouring tile's rows (the image is read-only).
+
+  * Nothing is printed per intersection, only unreadable building colours are reported.
+*/
+
+#define PARSE_TILES_PER_THREAD 8
+
+struct parse_job{
+ unsigned char *img;
+ int rx, ry;
+ int rows_per_tile;
+ int *first_x, *first_y;    // Per tile result of the first-pixel search
+ int bad;                   // Number of buildings with an unreadable colour
+};
+
+static inline int is_yellow(unsigned char *img, int rx, int x, int y)
+{
+ unsigned char *p=img+(((size_t)x+((size_t)y*rx))*3);
+ return(*(p)==255&&*(p+1)==255&&*(p+2)==0);
+}
+
+static int building_colour(unsigned char *img, int rx, int ry, int x, int y)
+{
+ // Colour index of the building pixel at x,y, or 0 if it is not a valid building colour
+ unsigned char *p;
+
+ if (x<0||x>=rx||y<0||y>=ry) return(0);
+ p=img+(((size_t)x+((size_t)y*rx))*3);
+ if (*(p)==0&&*(p+1)==255&&*(p+2)==0) return(3);
+ if (*(p)==0&&*(p+1)==0&&*(p+2)==255) return(2);
+ if (*(p)==255&&*(p+1)==255&&*(p+2)==255) return(6);
+ return(0);
+}
+
+static void find_first_tile(int task, int worker, void *arg)
+{
+ struct parse_job *job=(struct parse_job *)arg;
+ int y0=task*job->rows_per_tile;
+ int y1=y0+job->rows_per_tile;
+ int best_x=job->rx, best_y=-1;
+
+ (void)worker;
+ if (y1>job->ry) y1=job->ry;
+ for (int j=y0; j<y1; j++)
+  for (int i=0; i<best_x; i++)          // Only pixels left of the best so far can improve on it
+   if (is_yellow(job->img,job->rx,i,j))
+   {
+    best_x=i;
+    best_y=j;
+    break;
+   }
+ job->first_x[task]=best_x;
+ job->first_y[task]=best_y;
+}
+
+static void colour_tile(int task, int worker, void *arg)
+{
+ struct parse_job *job=(struct parse_job *)arg;
+ int y0=task*job->rows_per_tile;
+ int y1=y0+job->rows_per_tile;
+ int x,y,idx,bad;
+ const int ox[4]={-1,1,1,-1};           // Sample offsets (in intersection widths) clockwise
+ const int oy[4]={-1,-1,1,1};           // from the top-left
+
+ (void)worker;
+ bad=0;
+ for (int j=0; j<sy; j++)
+ {
+  y=map_geom.by+(j*map_geom.dy)+(map_geom.wy/2);
+  if (y<y0||y>=y1) continue;            // Intersection row owned by another tile
+  for (int i=0; i<sx; i++)
+  {
+   x=map_geom.bx+(i*map_geom.dx)+(map_geom.wx/2);
+   idx=i+(j*sx);
+   for (int k=0; k<4; k++)
+   {
+    map[idx][k]=building_colour(job->img,job->rx,job->ry,x+(ox[k]*map_geom.wx),y+(oy[k]*map_geom.wy));
+    if (map[idx][k]==0) bad++;
+   }
+   intersection_tables(i,j);
+  }
+ }
+ if (bad>0) __sync_fetch_and_add(&job->bad,bad);
+}
+
+int parse_map_parallel(unsigned char *map_img, int rx, int ry, int n_threads)
+{
+ // Same inputs and result as parse_map(), the work is split over n_threads threads
+ // (n_threads<=0 uses all available cores). Returns 1 on success, 0 on failure.
+ struct parse_job job;
+ int n_tiles;
+ int bx,by,dx,dy,wx,wy,tgl;
+
+ if (n_threads<=0) n_threads=default_threads();
+ job.img=map_img;
+ job.rx=rx;
+ job.ry=ry;
+ job.bad=0;
+ n_tiles=n_threads*PARSE_TILES_PER_THREAD;
+ if (n_tiles>ry) n_tiles=ry;
+ job.rows_per_tile=(ry+n_tiles-1)/n_tiles;
+ n_tiles=(ry+job.rows_per_tile-1)/job.rows_per_tile;
+ job.first_x=(int *)calloc(n_tiles,sizeof(int));
+ job.first_y=(int *)calloc(n_tiles,sizeof(int));
+ if (job.first_x==NULL||job.first_y==NULL)
+ {
+  fprintf(stderr,"Out of memory parsing map\n");
+  free(job.first_x);
+  free(job.first_y);
+  return(0);
+ }
+
+ // First intersection - left-most, then top-most, yellow pixel over all tiles
+ run_parallel(n_tiles,n_threads,find_first_tile,&job);
+ bx=rx;
+ by=-1;
+ for (int t=0; t<n_tiles; t++)
+  if (job.first_y[t]>=0&&job.first_x[t]<bx)
+  {
+   bx=job.first_x[t];
+   by=job.first_y[t];
+  }
+ if (by<0)
+ {
+  fprintf(stderr,"No intersections found in the map!\n");
+  free(job.first_x);
+  free(job.first_y);
+  return(0);
+ }
+
+ // Width/spacing along the first intersection's top row and left column. These scans
+ // touch a single row and column, so they stay serial.
+ tgl=0;
+ wx=wy=dx=dy=0;
+ for (int k=bx; k<rx&&tgl<2; k++)
+ {
+  if (tgl==0&&!is_yellow(map_img,rx,k,by)) {tgl=1; wx=k-bx;}
+  if (tgl==1&&is_yellow(map_img,rx,k,by)) {tgl=2; dx=k-bx;}
+ }
+ for (int k=by; k<ry&&tgl<4; k++)
+ {
+  if (tgl==2&&!is_yellow(map_img,rx,bx,k)) {tgl=3; wy=k-by;}
+  if (tgl==3&&is_yellow(map_img,rx,bx,k)) {tgl=4; dy=k-by;}
+ }
+ if (tgl!=4)
+ {
+  fprintf(stderr,"Unable to determine intersection geometry!\n");
+  free(job.first_x);
+  free(job.first_y);
+  return(0);
+ }
+ fprintf(stderr,"Intersection parameters: base_x=%d, base_y=%d, width=%d, height=%d, horiz_distance=%d, vertical_distance=%d\n",bx,by,wx,wy,dx,dy);
+
+ sx=0;
+ for (int i=bx+(wx/2);i<rx;i+=dx)
+  if (is_yellow(map_img,rx,i,by)) sx++;
+ sy=0;
+ for (int j=by+(wy/2);j<ry;j+=dy)
+  if (is_yellow(map_img,rx,bx,j)) sy++;
+ fprintf(stderr,"Map size: Number of horizontal intersections=%d, number of vertical intersections=%d\n",sx,sy);
+ if (sx<=0||sy<=0||alloc_map(sx,sy)==0)
+ {
+  free(job.first_x);
+  free(job.first_y);
+  return(0);
+ }
+ map_geom.bx=bx;
+ map_geom.by=by;
+ map_geom.wx=wx;
+ map_geom.wy=wy;
+ map_geom.dx=dx;
+ map_geom.dy=dy;
+
+ // Building colours and derived tables, one tile of intersection rows per task
+ run_parallel(n_tiles,n_threads,colour_tile,&job);
+ build_signature_index();
+ if (job.bad>0) fprintf(stderr,"%d buildings around intersections have invalid colours\n",job.bad);
+
+ free(job.first_x);
+ free(job.first_y);
+ return(1);
+}
+
+void free_map(void)
+{
+ // Releases the map and its derived tables, whether allocated or mapped from a compiled map file
+ if (map_mapped!=NULL)
+ {
+  munmap(map_mapped,map_mapped_size);
+  map_mapped=NULL;
+  map_mapped_size=0;
+ }
+ else
+ {
+  free(map);
+  free(map_sig);
+  free(map_packed);
+  free(map_nbr);
+  free(map_sig_start);
+  free(map_sig_states);
+ }
+ map=NULL;
+ map_sig=NULL;
+ map_packed=NULL;
+ map_nbr=NULL;
+ map_sig_start=NULL;
+ map_sig_states=NULL;
+}
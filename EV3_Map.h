@@ -0,0 +1,93 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Map representation and parsing. This module owns the map[][] array together with the
+ map size (sx, sy) and the intersection geometry found while parsing the input image.
+
+ It does not depend on the EV3 bluetooth library, so offline tools (map generators,
+ benchmarks, analyzers) can link against it without a robot attached.
+
+ Conventions used throughout:
+
+ * Intersections are stored in raster order, index=i+(j*sx)
+ * map[idx][0..3] holds building colours clockwise from the top-left
+ * Directions are 0 - UP, 1 - RIGHT, 2 - DOWN, 3 - LEFT
+ * A scan taken while facing direction d returns (tl,tr,br,bl) relative to the robot,
+   which corresponds to map[idx][(k+d)&3] for k=0..3
+
+*/
+
+#ifndef __map_header
+#define __map_header
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+
+// Intersection geometry in image pixels, as determined by parse_map()
+struct map_geometry{
+ int bx, by;                // Top-left pixel of the first intersection
+ int wx, wy;                // Width and height of an intersection
+ int dx, dy;                // Horizontal and vertical distance between intersections
+};
+
+extern int (*map)[4];               // Building colours per intersection, sx*sy rows
+extern int sx, sy;                  // Size of the map (number of intersections along x and y)
+extern struct map_geometry map_geom;
+
+// Derived tables, rebuilt by build_map_tables() or loaded from the compiled map cache
+extern unsigned char *map_sig;      // map_sig[(idx*4)+d] - scan signature seen at idx facing d
+extern int *map_nbr;                // map_nbr[(idx*4)+d] - intersection reached driving from idx
+                                    //                      in direction d, -1 at the map border
+extern unsigned char *map_packed;    // map_packed[idx] - the 4 building codes (colour_code()) of
+                                    // intersection idx, 2 bits each, top-left in the low bits
+extern int *map_sig_start;          // Inverted signature index: the states (idx*4)+d whose scan
+extern int *map_sig_states;         // signature is s are map_sig_states[map_sig_start[s]] up to
+                                    // map_sig_states[map_sig_start[s+1]-1]
+extern void *map_mapped;            // Set when the arrays above point into a compiled map file
+extern size_t map_mapped_size;      // (see EV3_MapCache.h), so free_map() unmaps instead of freeing
+extern int parse_verbose;           // Set to 0 to stop parse_map() printing every intersection
+
+#define N_SIGNATURES 81             // 3 building colours ^ 4 buildings
+#define PARALLEL_PARSE_PIXELS 4000000   // Images larger than this are parsed with parse_map_parallel()
+
+int parse_map(unsigned char *map_img, int rx, int ry);
+int parse_map_parallel(unsigned char *map_img, int rx, int ry, int n_threads);
+unsigned char *readPPMimage(const char *filename, int *rx, int*ry);
+int alloc_map(int size_x, int size_y);
+int build_map_tables(void);
+void build_signature_index(void);
+void free_map(void);
+
+// Colour index (2 - Blue, 3 - Green, 6 - White) to a 0-2 building code. Anything else
+// (including the 0 left for unparseable buildings) is treated as white - no building.
+static inline int colour_code(int colour)
+{
+ return(colour==2?0:(colour==3?1:2));
+}
+
+static inline int code_colour(int code)
+{
+ return(code==0?2:(code==1?3:6));
+}
+
+// Packs 4 building colours into one byte, 2 bits per building, first building in the low bits
+static inline unsigned char pack_colours(int c0, int c1, int c2, int c3)
+{
+ return((unsigned char)(colour_code(c0)|(colour_code(c1)<<2)|(colour_code(c2)<<4)|(colour_code(c3)<<6)));
+}
+
+// Signature of a 4-building scan in robot-relative order tl, tr, br, bl
+static inline int scan_signature(int tl, int tr, int br, int bl)
+{
+ return(colour_code(tl)+(3*colour_code(tr))+(9*colour_code(br))+(27*colour_code(bl)));
+}
+
+// Signature expected at intersection idx while facing direction d
+static inline int map_signature(int idx, int d)
+{
+ return(scan_signature(map[idx][d&3],map[idx][(d+1)&3],map[idx][(d+2)&3],map[idx][(d+3)&3]));
+}
+
+#endif
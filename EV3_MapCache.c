@@ -0,0 +1,209 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Compiled map cache - see EV3_MapCache.h for the file layout and how it is keyed.
+
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "EV3_MapCache.h"
+
+unsigned long long map_hash=0;
+static unsigned long long map_ppm_size=0;
+
+static unsigned long long align_up(unsigned long long x)
+{
+ return((x+CMAP_ALIGN-1)&~((unsigned long long)CMAP_ALIGN-1));
+}
+
+unsigned long long hash_bytes(const unsigned char *data, size_t len)
+{
+ // FNV-1a style hash, but consuming 8 bytes per step so hashing a large map image
+ // costs a small fraction of parsing it. A final avalanche step mixes the high bits down.
+ unsigned long long h=0xcbf29ce484222325ULL^len;
+ unsigned long long w;
+ size_t i;
+
+ for (i=0; i+8<=len; i+=8)
+ {
+  memcpy(&w,data+i,8);
+  h^=w;
+  h*=0x100000001b3ULL;
+  h^=h>>29;
+ }
+ for (; i<len; i++)
+ {
+  h^=data[i];
+  h*=0x100000001b3ULL;
+ }
+ h^=h>>33;
+ h*=0xff51afd7ed558ccdULL;
+ h^=h>>33;
+ return(h);
+}
+
+int hash_map_file(const char *mapname, unsigned long long *hash, unsigned long long *size)
+{
+ // Hashes the contents of the map image file. Returns 1 on success, 0 if the file
+ // can not be read.
+ struct stat st;
+ unsigned char *data;
+ int fd;
+
+ fd=open(mapname,O_RDONLY);
+ if (fd<0) return(0);
+ if (fstat(fd,&st)!=0||st.st_size<=0)
+ {
+  close(fd);
+  return(0);
+ }
+ data=(unsigned char *)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+ close(fd);
+ if (data==MAP_FAILED) return(0);
+ *hash=hash_bytes(data,st.st_size);
+ *size=st.st_size;
+ munmap(data,st.st_size);
+ return(1);
+}
+
+void map_cache_path(const char *mapname, const char *ext, char *path, size_t len)
+{
+ snprintf(path,len,"%s.%s",mapname,ext);
+}
+
+int load_map_cache(const char *mapname)
+{
+ // Tries to load the compiled map for the given map image. Always computes map_hash
+ // for the image (so save_map_cache() can use it on a miss). Returns 1 if a valid
+ // compiled map was found and is now the current map, 0 otherwise.
+ char path[1024];
+ struct stat st;
+ struct cmap_header *hdr;
+ unsigned char *data;
+ unsigned long long n;
+ int fd;
+
+ map_hash=0;
+ map_ppm_size=0;
+ if (hash_map_file(mapname,&map_hash,&map_ppm_size)==0) return(0);
+
+ map_cache_path(mapname,"cmap",&path[0],1024);
+ fd=open(&path[0],O_RDONLY);
+ if (fd<0) return(0);
+ if (fstat(fd,&st)!=0||(size_t)st.st_size<sizeof(struct cmap_header))
+ {
+  close(fd);
+  return(0);
+ }
+ // MAP_PRIVATE with write access - the map arrays are not const, any stray write
+ // stays in this process instead of corrupting the cache file
+ data=(unsigned char *)mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+ close(fd);
+ if (data==MAP_FAILED) return(0);
+
+ hdr=(struct cmap_header *)data;
+ n=(unsigned long long)hdr->sx*hdr->sy;
+ if (strncmp(&hdr->magic[0],CMAP_MAGIC,8)!=0||hdr->version!=CMAP_VERSION||
+     hdr->header_size!=sizeof(struct cmap_header)||hdr->file_size!=(unsigned long long)st.st_size||
+     hdr->ppm_hash!=map_hash||hdr->ppm_size!=map_ppm_size||hdr->sx<=0||hdr->sy<=0||
+     hdr->colour_offset+(n*4*sizeof(int))>hdr->file_size||
+     hdr->sig_offset+(n*4)>hdr->file_size||
+     hdr->packed_offset+n>hdr->file_size||
+     hdr->nbr_offset+(n*4*sizeof(int))>hdr->file_size||
+     hdr->sig_start_offset+((N_SIGNATURES+1)*sizeof(int))>hdr->file_size||
+     hdr->sig_states_offset+(n*4*sizeof(int))>hdr->file_size)
+ {
+  fprintf(stderr,"Compiled map %s is stale or invalid, re-parsing map image\n",&path[0]);
+  munmap(data,st.st_size);
+  return(0);
+ }
+
+ free_map();
+ sx=hdr->sx;
+ sy=hdr->sy;
+ map_geom=hdr->geom;
+ map=(int (*)[4])(data+hdr->colour_offset);
+ map_sig=data+hdr->sig_offset;
+ map_packed=data+hdr->packed_offset;
+ map_nbr=(int *)(data+hdr->nbr_offset);
+ map_sig_start=(int *)(data+hdr->sig_start_offset);
+ map_sig_states=(int *)(data+hdr->sig_states_offset);
+ map_mapped=data;
+ map_mapped_size=st.st_size;
+ fprintf(stderr,"Loaded compiled map %s: %d x %d intersections\n",&path[0],sx,sy);
+ return(1);
+}
+
+static int write_section(FILE *f, unsigned long long *pos, unsigned long long offset, const void *data, size_t size)
+{
+ // Pads the file with zeros up to offset, then writes the section
+ static const unsigned char pad[CMAP_ALIGN]={0};
+
+ if (offset<*pos||offset-*pos>CMAP_ALIGN) return(0);
+ if (offset>*pos&&fwrite(&pad[0],offset-*pos,1,f)!=1) return(0);
+ if (fwrite(data,size,1,f)!=1) return(0);
+ *pos=offset+size;
+ return(1);
+}
+
+int save_map_cache(const char *mapname)
+{
+ // Writes the current map (as left by parse_map()) to the compiled map file. The file
+ // is written under a temporary name and renamed into place, so a concurrent reader
+ // never sees a partial file. Returns 1 on success, 0 otherwise.
+ char path[1024], tmp_path[1100];
+ struct cmap_header hdr;
+ unsigned long long n, pos;
+ FILE *f;
+ int ok;
+
+ if (map==NULL||map_sig==NULL||map_packed==NULL||map_nbr==NULL||map_sig_start==NULL||map_sig_states==NULL) return(0);
+ if (map_hash==0&&hash_map_file(mapname,&map_hash,&map_ppm_size)==0) return(0);
+
+ n=(unsigned long long)sx*sy;
+ memset(&hdr,0,sizeof(struct cmap_header));
+ strncpy(&hdr.magic[0],CMAP_MAGIC,8);
+ hdr.version=CMAP_VERSION;
+ hdr.header_size=sizeof(struct cmap_header);
+ hdr.ppm_hash=map_hash;
+ hdr.ppm_size=map_ppm_size;
+ hdr.sx=sx;
+ hdr.sy=sy;
+ hdr.geom=map_geom;
+ hdr.colour_offset=align_up(sizeof(struct cmap_header));
+ hdr.sig_offset=align_up(hdr.colour_offset+(n*4*sizeof(int)));
+ hdr.packed_offset=align_up(hdr.sig_offset+(n*4));
+ hdr.nbr_offset=align_up(hdr.packed_offset+n);
+ hdr.sig_start_offset=align_up(hdr.nbr_offset+(n*4*sizeof(int)));
+ hdr.sig_states_offset=align_up(hdr.sig_start_offset+((N_SIGNATURES+1)*sizeof(int)));
+ hdr.file_size=hdr.sig_states_offset+(n*4*sizeof(int));
+
+ map_cache_path(mapname,"cmap",&path[0],1024);
+ snprintf(&tmp_path[0],1100,"%s.tmp%d",&path[0],(int)getpid());
+ f=fopen(&tmp_path[0],"wb");
+ if (f==NULL)
+ {
+  fprintf(stderr,"Unable to write compiled map %s\n",&path[0]);
+  return(0);
+ }
+ pos=0;
+ ok=write_section(f,&pos,0,&hdr,sizeof(struct cmap_header));
+ ok=ok&&write_section(f,&pos,hdr.colour_offset,&map[0][0],n*4*sizeof(int));
+ ok=ok&&write_section(f,&pos,hdr.sig_offset,map_sig,n*4);
+ ok=ok&&write_section(f,&pos,hdr.packed_offset,map_packed,n);
+ ok=ok&&write_section(f,&pos,hdr.nbr_offset,map_nbr,n*4*sizeof(int));
+ ok=ok&&write_section(f,&pos,hdr.sig_start_offset,map_sig_start,(N_SIGNATURES+1)*sizeof(int));
+ ok=ok&&write_section(f,&pos,hdr.sig_states_offset,map_sig_states,n*4*sizeof(int));
+ if (fclose(f)!=0) ok=0;
+ if (!ok||rename(&tmp_path[0],&path[0])!=0)
+ {
+  fprintf(stderr,"Unable to write compiled map %s\n",&path[0]);
+  remove(&tmp_path[0]);
+  return(0);
+ }
+ return(1);
+}
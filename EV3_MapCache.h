@@ -0,0 +1,58 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Compiled map cache. Parsing a map image (and printing every intersection while doing so)
+ is by far the slowest part of start-up, so once a map has been parsed its contents are
+ saved to a binary file next to the image:
+
+    Map1.ppm  -->  Map1.ppm.cmap
+
+ The compiled map holds sx, sy, the intersection geometry, the per-intersection building
+ colours, and the derived tables from EV3_Map.h (signatures, packed colours, neighbours,
+ and the inverted signature index). It is keyed by a 64-bit hash of the .ppm file contents, so editing the
+ image invalidates it automatically. Sections are 64-byte aligned and stored in native
+ byte order, so on a cache hit the file is mmap()ed and the map arrays point straight
+ into it - nothing is parsed or copied.
+
+ Other per-map precomputed data (route tables, ambiguity analysis, ...) should use
+ map_cache_path() with its own extension and store map_hash in its header, so all files
+ derived from a map are invalidated together.
+
+*/
+
+#ifndef __map_cache_header
+#define __map_cache_header
+
+#include "EV3_Map.h"
+
+#define CMAP_MAGIC "EV3CMAP"
+#define CMAP_VERSION 3
+#define CMAP_ALIGN 64
+
+struct cmap_header{
+ char magic[8];                     // CMAP_MAGIC, zero padded
+ unsigned int version;              // CMAP_VERSION - files with any other version are ignored
+ unsigned int header_size;          // sizeof(struct cmap_header), guards against layout changes
+ unsigned long long ppm_hash;       // Hash of the source .ppm file
+ unsigned long long ppm_size;       // Size in bytes of the source .ppm file
+ int sx, sy;
+ struct map_geometry geom;
+ unsigned long long colour_offset;  // int[sx*sy][4]     building colours
+ unsigned long long sig_offset;     // unsigned char[sx*sy*4]  scan signatures
+ unsigned long long packed_offset;  // unsigned char[sx*sy]    packed building colours
+ unsigned long long nbr_offset;     // int[sx*sy*4]      neighbour indices
+ unsigned long long sig_start_offset;   // int[N_SIGNATURES+1]  signature index offsets
+ unsigned long long sig_states_offset;  // int[sx*sy*4]         states grouped by signature
+ unsigned long long file_size;
+};
+
+extern unsigned long long map_hash;         // Hash of the .ppm the current map came from
+
+unsigned long long hash_bytes(const unsigned char *data, size_t len);
+int hash_map_file(const char *mapname, unsigned long long *hash, unsigned long long *size);
+void map_cache_path(const char *mapname, const char *ext, char *path, size_t len);
+int load_map_cache(const char *mapname);
+int save_map_cache(const char *mapname);
+
+#endif
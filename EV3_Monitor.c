@@ -0,0 +1,47 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Lost-robot detection - see EV3_Monitor.h
+
+*/
+
+#include <math.h>
+#include "EV3_Monitor.h"
+
+void init_lost_monitor(struct lost_monitor *lm, const struct sensor_model *sm, double odds)
+{
+ // Scan likelihoods for a robot that could be anywhere on the current map - the
+ // per-signature likelihoods weighted by how many states show each signature
+ int total=map_sig_start[N_SIGNATURES];
+
+ lm->threshold=log(odds);
+ for (int z=0; z<N_SIGNATURES; z++)
+ {
+  double p=0;
+  for (int s=0; s<N_SIGNATURES; s++)
+   p+=sm->like[z][s]*(double)(map_sig_start[s+1]-map_sig_start[s]);
+  lm->p_lost[z]=(total>0)?p/(double)total:0;
+ }
+ reset_lost_monitor(lm);
+}
+
+void reset_lost_monitor(struct lost_monitor *lm)
+{
+ lm->llr=0;
+ lm->scans=0;
+}
+
+int lost_monitor_scan(struct lost_monitor *lm, const struct sensor_model *sm, int sig, int expected_state)
+{
+ // Adds the evidence of a scan with signature sig taken where the robot should be in
+ // expected_state. Returns 1 if the robot is now considered lost, 0 otherwise.
+ double on_track;
+
+ if (sig<0||sig>=N_SIGNATURES) return(0);
+ on_track=sm->like[sig][map_sig[expected_state]];
+ lm->llr+=log(lm->p_lost[sig])-log(on_track);
+ if (lm->llr<0) lm->llr=0;
+ lm->scans++;
+ return(lm->llr>lm->threshold);
+}
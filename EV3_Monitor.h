@@ -0,0 +1,56 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Lost-robot detection.
+
+ Once localized, go_to_target() knows where the robot should be: every drive and turn
+ moves the expected state along with move_state() (EV3_Motion.h). If a move goes wrong
+ (a wheel slips, the robot leaves the street, or the localization was wrong to begin
+ with) the scans stop agreeing with the map at the expected state, and struct
+ lost_monitor notices. For every scan z it compares two hypotheses:
+
+   on track - the robot is at the expected state s: P(z | s) = like[z][map_sig[s]]
+   lost     - the robot could be anywhere: P(z | lost) = average of P(z | s') over all
+              states s' of the map
+
+ (like[][] is the calibrated scan likelihood table of EV3_SensorModel.h), and keeps a
+ running log-likelihood ratio in the CUSUM form
+
+     llr = max(0, llr + log(P(z | lost) / P(z | s)))
+
+ The clamp at 0 means a long stretch of good scans does not build up credit that would
+ delay noticing a later failure. A single misread building is still much likelier on
+ track than lost, so llr stays near 0 while things go well; when it goes past
+ log(odds), the monitor reports the robot lost. With the default LOST_ODDS of 100 that
+ takes about two scans that disagree with the expected state in two or more buildings.
+
+ P(z | lost) only depends on z, so init_lost_monitor() precomputes it for all 81
+ signatures from the map's signature index. Each scan then costs O(1).
+
+ After a detection, reseed_beliefs() (EV3_Beliefs.h) mixes the current beliefs with a
+ uniform floor, so localization can resume from what the filter still knows without
+ ruling out any state.
+
+*/
+
+#ifndef __monitor_header
+#define __monitor_header
+
+#include "EV3_SensorModel.h"
+
+#define LOST_ODDS 100.0             // Lost once the evidence favours it by this factor
+#define LOST_FLOOR 0.05             // Uniform mass mixed into the beliefs when re-seeding
+
+struct lost_monitor{
+ double threshold;          // log(odds)
+ double llr;                // Running log-likelihood ratio, lost vs. on track
+ int scans;                 // Scans checked since the last reset
+ double p_lost[N_SIGNATURES];   // P(z | lost) for every scan signature z
+};
+
+void init_lost_monitor(struct lost_monitor *lm, const struct sensor_model *sm, double odds);
+void reset_lost_monitor(struct lost_monitor *lm);
+int lost_monitor_scan(struct lost_monitor *lm, const struct sensor_model *sm, int sig, int expected_state);
+
+#endif
@@ -0,0 +1,323 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Motion model for the prediction step - see EV3_Motion.h
+
+*/
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <string.h>
+#include "EV3_Motion.h"
+
+void default_motion_noise(struct motion_noise *noise)
+{
+ noise->slip=MOTION_SLIP_PROB;
+ noise->overshoot=MOTION_OVERSHOOT_PROB;
+ noise->turn_fail=MOTION_TURN_FAIL_PROB;
+ noise->over_turn=MOTION_OVER_TURN_PROB;
+}
+
+static inline int step_state(int state)
+{
+ // One block forward, or turned around at the border
+ int nb=map_nbr[state];
+
+ if (nb<0) return((state&~3)|((state+2)&3));
+ return((nb*4)+(state&3));
+}
+
+int move_state(int state, int action)
+{
+ // State reached by the noise-free version of an action
+ switch (action)
+ {
+  case MOVE_FORWARD: return(step_state(state));
+  case MOVE_LEFT: return((state&~3)|((state+3)&3));
+  case MOVE_RIGHT: return((state&~3)|((state+1)&3));
+  case MOVE_UTURN: return((state&~3)|((state+2)&3));
+ }
+ return(state);
+}
+
+int macro_move(int state, int action)
+{
+ // Noise-free macro action - turn (unless the action is MOVE_FORWARD), then drive one block
+ if (action!=MOVE_FORWARD) state=move_state(state,action);
+ return(move_state(state,MOVE_FORWARD));
+}
+
+static int outcomes(const struct motion_noise *noise, int state, int action, int out[SPARSE_FANOUT], double p[SPARSE_FANOUT])
+{
+ // The noisy outcomes of an action taken in state, returns how many there are
+ int base=state&~3, d=state&3, r, c=0;
+
+ if (action==MOVE_FORWARD)
+ {
+  out[c]=step_state(state); p[c++]=1.0-noise->slip-noise->overshoot;
+  out[c]=state; p[c++]=noise->slip;
+  out[c]=step_state(out[0]); p[c++]=noise->overshoot;
+  return(c);
+ }
+ r=(action==MOVE_LEFT)?3:((action==MOVE_RIGHT)?1:2);
+ out[c]=base|((d+r)&3); p[c++]=1.0-noise->turn_fail-noise->over_turn;
+ out[c]=state; p[c++]=noise->turn_fail;
+ if (action==MOVE_UTURN)
+ {
+  out[c]=base|((d+1)&3); p[c++]=noise->over_turn/2.0;
+  out[c]=base|((d+3)&3); p[c++]=noise->over_turn/2.0;
+ }
+ else
+ {
+  out[c]=base|((d+2)&3); p[c++]=noise->over_turn;
+ }
+ return(c);
+}
+
+int sample_move(const struct motion_noise *noise, int state, int action, double u)
+{
+ // One noisy outcome of an action, picked by u in [0,1) - for simulating the robot
+ int out[SPARSE_FANOUT], c;
+ double p[SPARSE_FANOUT];
+
+ c=outcomes(noise,state,action,out,p);
+ for (int v=0; v<c-1; v++)
+ {
+  if (u<p[v]) return(out[v]);
+  u-=p[v];
+ }
+ return(out[c-1]);
+}
+
+int build_motion_model(struct motion_model *mm, const struct motion_noise *noise)
+{
+ // Precomputes the forward gather table and the turn matrices for the current map.
+ // Returns 1 on success, 0 if out of memory.
+ int n4=sx*sy*4;
+ int out[SPARSE_FANOUT], c, k;
+ double p[SPARSE_FANOUT];
+ unsigned char *deg;
+
+ memset(mm,0,sizeof(struct motion_model));
+ mm->n=sx*sy;
+ mm->noise=*noise;
+
+ for (int a=0; a<N_MOVES; a++)
+  for (int e=0; e<4; e++)
+  {
+   if (a==MOVE_FORWARD)
+   {
+    mm->turn[a][e][e]=1.0;
+    continue;
+   }
+   c=outcomes(noise,e,a,out,p);
+   for (int v=0; v<c; v++)
+    mm->turn[a][out[v]][e]+=p[v];
+  }
+
+ // In-degree of every destination bounds the number of slots it needs
+ deg=(unsigned char *)calloc(n4,sizeof(unsigned char));
+ mm->scratch=(double (*)[4])calloc(mm->n,sizeof(double[4]));
+ if (deg==NULL||mm->scratch==NULL)
+ {
+  free(deg);
+  free_motion_model(mm);
+  return(0);
+ }
+ for (int s=0; s<n4; s++)
+ {
+  c=outcomes(noise,s,MOVE_FORWARD,out,p);
+  for (int v=0; v<c; v++)
+   if (p[v]>0) deg[out[v]]++;
+ }
+ mm->w=1;
+ for (int s=0; s<n4; s++)
+  if (deg[s]>mm->w) mm->w=deg[s];
+
+ mm->src=(int *)malloc((size_t)mm->w*n4*sizeof(int));
+ mm->weight=(float *)malloc((size_t)mm->w*n4*sizeof(float));
+ if (mm->src==NULL||mm->weight==NULL)
+ {
+  free(deg);
+  free_motion_model(mm);
+  return(0);
+ }
+ for (k=0; k<mm->w; k++)
+  for (int s=0; s<n4; s++)
+  {
+   mm->src[((size_t)k*n4)+s]=s;
+   mm->weight[((size_t)k*n4)+s]=0;
+  }
+
+ // Fill in the slots, merging outcomes that reach the same destination from the same source
+ memset(deg,0,n4);
+ for (int s=0; s<n4; s++)
+ {
+  c=outcomes(noise,s,MOVE_FORWARD,out,p);
+  for (int v=0; v<c; v++)
+  {
+   if (p[v]<=0) continue;
+   for (k=0; k<deg[out[v]]; k++)
+    if (mm->src[((size_t)k*n4)+out[v]]==s) break;
+   if (k==deg[out[v]])
+   {
+    mm->src[((size_t)k*n4)+out[v]]=s;
+    deg[out[v]]++;
+   }
+   mm->weight[((size_t)k*n4)+out[v]]+=(float)p[v];
+  }
+ }
+ free(deg);
+ return(1);
+}
+
+void free_motion_model(struct motion_model *mm)
+{
+ free(mm->src);
+ free(mm->weight);
+ free(mm->scratch);
+ mm->src=NULL;
+ mm->weight=NULL;
+ mm->scratch=NULL;
+}
+
+static void predict_forward(struct motion_model *mm, const double *in, double *out)
+{
+ int n4=mm->n*4;
+ int s=0;
+
+#if defined(__AVX2__)
+ for (; s+4<=n4; s+=4)
+ {
+  __m256d acc=_mm256_setzero_pd();
+  for (int k=0; k<mm->w; k++)
+  {
+   __m128i vi=_mm_loadu_si128((const __m128i *)(mm->src+((size_t)k*n4)+s));
+   __m256d vw=_mm256_cvtps_pd(_mm_loadu_ps(mm->weight+((size_t)k*n4)+s));
+   __m256d vb=_mm256_mask_i32gather_pd(_mm256_setzero_pd(),in,vi,_mm256_castsi256_pd(_mm256_set1_epi64x(-1)),8);
+   acc=_mm256_add_pd(acc,_mm256_mul_pd(vw,vb));
+  }
+  _mm256_storeu_pd(out+s,acc);
+ }
+#endif
+ for (; s<n4; s++)
+ {
+  double acc=0;
+  for (int k=0; k<mm->w; k++)
+   acc+=mm->weight[((size_t)k*n4)+s]*in[mm->src[((size_t)k*n4)+s]];
+  out[s]=acc;
+ }
+}
+
+void predict_beliefs(struct motion_model *mm, int action, double (*in)[4], double (*out)[4])
+{
+ // Prediction step, in[][] and out[][] must not overlap. Any lazy scale is unchanged.
+ if (action==MOVE_FORWARD)
+ {
+  predict_forward(mm,&in[0][0],&out[0][0]);
+  return;
+ }
+ double (*t)[4]=mm->turn[action];
+ int i=0;
+#if defined(__AVX2__)
+ {
+  // One intersection per vector - the sum of the matrix columns weighted by each input belief
+  __m256d col[4];
+  for (int e=0; e<4; e++)
+   col[e]=_mm256_setr_pd(t[0][e],t[1][e],t[2][e],t[3][e]);
+  for (; i<mm->n; i++)
+  {
+   __m256d acc=_mm256_mul_pd(col[0],_mm256_broadcast_sd(&in[i][0]));
+   acc=_mm256_add_pd(acc,_mm256_mul_pd(col[1],_mm256_broadcast_sd(&in[i][1])));
+   acc=_mm256_add_pd(acc,_mm256_mul_pd(col[2],_mm256_broadcast_sd(&in[i][2])));
+   acc=_mm256_add_pd(acc,_mm256_mul_pd(col[3],_mm256_broadcast_sd(&in[i][3])));
+   _mm256_storeu_pd(&out[i][0],acc);
+  }
+ }
+#endif
+ for (; i<mm->n; i++)
+  for (int d=0; d<4; d++)
+   out[i][d]=(t[d][0]*in[i][0])+(t[d][1]*in[i][1])+(t[d][2]*in[i][2])+(t[d][3]*in[i][3]);
+}
+
+void apply_motion(struct motion_model *mm, int action, double (**b)[4])
+{
+ // Prediction into the scratch buffer, which then becomes *b (the old array becomes scratch)
+ double (*t)[4];
+
+ predict_beliefs(mm,action,*b,mm->scratch);
+ t=*b;
+ *b=mm->scratch;
+ mm->scratch=t;
+}
+
+static int by_state(const void *a, const void *b)
+{
+ return(((const struct sparse_entry *)a)->state-((const struct sparse_entry *)b)->state);
+}
+
+static int by_prob_desc(const void *a, const void *b)
+{
+ double pa=((const struct sparse_entry *)a)->p, pb=((const struct sparse_entry *)b)->p;
+ return((pa<pb)?1:((pa>pb)?-1:0));
+}
+
+static void predict_sparse(struct motion_model *mm, struct adaptive_belief *ab, int action)
+{
+ // Pushes every listed state through the action's outcomes, merges duplicates and keeps
+ // the K most likely. Whatever does not fit joins the residual, which stays uniform.
+ struct sparse_belief *sp=&ab->sp;
+ int out[SPARSE_FANOUT], c, m=0, u;
+ double p[SPARSE_FANOUT];
+
+ for (int e=0; e<sp->count; e++)
+ {
+  c=outcomes(&mm->noise,sp->state[e],action,out,p);
+  for (int v=0; v<c; v++)
+   if (p[v]>0)
+   {
+    sp->next[m].state=out[v];
+    sp->next[m].p=sp->p[e]*p[v];
+    m++;
+   }
+ }
+ qsort(sp->next,m,sizeof(struct sparse_entry),by_state);
+ u=0;
+ for (int e=0; e<m; e++)
+ {
+  if (u>0&&sp->next[u-1].state==sp->next[e].state) sp->next[u-1].p+=sp->next[e].p;
+  else sp->next[u++]=sp->next[e];
+ }
+ if (u>sp->k)
+ {
+  qsort(sp->next,u,sizeof(struct sparse_entry),by_prob_desc);
+  for (int e=sp->k; e<u; e++)
+   sp->elsewhere+=sp->next[e].p;
+  u=sp->k;
+ }
+ for (int e=0; e<u; e++)
+ {
+  sp->state[e]=sp->next[e].state;
+  sp->p[e]=sp->next[e].p;
+ }
+ sp->count=u;
+ rebuild_sparse_hash(sp);
+}
+
+void predict_adaptive_belief(struct motion_model *mm, struct adaptive_belief *ab, int action)
+{
+ double (*t)[4];
+
+ if (ab->sparse)
+ {
+  predict_sparse(mm,ab,action);
+  if (ab->sp.elsewhere>ab->leave_mass) make_dense(ab);
+  return;
+ }
+ predict_beliefs(mm,action,ab->dense,mm->scratch);
+ t=ab->dense;
+ ab->dense=mm->scratch;
+ mm->scratch=t;
+}
@@ -0,0 +1,87 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Motion model for the prediction step of the histogram filter.
+
+ The robot has four actions:
+
+   MOVE_FORWARD - drive along the street to the next intersection
+   MOVE_LEFT, MOVE_RIGHT - turn 90 degrees at the current intersection
+   MOVE_UTURN - turn around at the current intersection
+
+ Driving toward the red border is not possible - the robot detects the border, turns
+ around and comes back, so a forward move from a border intersection leaves the robot
+ where it was, facing the opposite direction.
+
+ Each action has a few noisy outcomes, with probabilities given by struct motion_noise:
+
+   forward  - nominal, slip (wheels spin, the robot never left the intersection),
+              overshoot (missed the next intersection and stopped at the one after it,
+              bouncing off the border if there is none)
+   turns    - nominal, turn_fail (the robot stays on its street), over_turn (90 degrees
+              too far - a left or right turn ends up as a U-turn, a U-turn ends up on one
+              of the side streets, half of over_turn each)
+
+ The forward transition depends on the map, so build_motion_model() precomputes it once
+ per map as a gather table: for every destination state s, up to w source states and
+ their weights, stored slot-major (src[(k*4n)+s], weight[(k*4n)+s]) and padded with
+ zero-weight self references. The prediction is then
+
+     out[s] = sum over k of weight[k][s] * in[src[k][s]]
+
+ with no branches, four states per AVX2 gather. Turns do not depend on the map, only on
+ the facing direction, so they are a 4x4 direction mixing matrix applied to every
+ intersection. Both preserve the total mass, so the lazy scale of EV3_Beliefs.h carries
+ over unchanged.
+
+ predict_adaptive_belief() applies the same model to struct adaptive_belief
+ (EV3_SparseBeliefs.h) - through the gather table in dense mode, by pushing the K listed
+ states forward (and keeping the K most likely results) in sparse mode.
+
+*/
+
+#ifndef __motion_header
+#define __motion_header
+
+#include "EV3_SparseBeliefs.h"
+
+#define MOVE_FORWARD 0
+#define MOVE_LEFT 1
+#define MOVE_RIGHT 2
+#define MOVE_UTURN 3
+#define N_MOVES 4
+
+#define MOTION_SLIP_PROB 0.05           // Default motion_noise values
+#define MOTION_OVERSHOOT_PROB 0.05
+#define MOTION_TURN_FAIL_PROB 0.05
+#define MOTION_OVER_TURN_PROB 0.02
+
+struct motion_noise{
+ double slip;
+ double overshoot;
+ double turn_fail;
+ double over_turn;
+};
+
+struct motion_model{
+ int n;                     // Number of intersections
+ struct motion_noise noise;
+ int w;                     // Slots per destination in the forward gather table
+ int *src;                  // src[(k*4n)+s] - k-th source state of destination s
+ float *weight;             // weight[(k*4n)+s] - its transition probability
+ double turn[N_MOVES][4][4];// turn[a][d][e] - probability that facing e becomes facing d
+ double (*scratch)[4];      // Output buffer for the dense prediction, swapped with the input
+};
+
+void default_motion_noise(struct motion_noise *noise);
+int move_state(int state, int action);
+int macro_move(int state, int action);
+int sample_move(const struct motion_noise *noise, int state, int action, double u);
+int build_motion_model(struct motion_model *mm, const struct motion_noise *noise);
+void free_motion_model(struct motion_model *mm);
+void predict_beliefs(struct motion_model *mm, int action, double (*in)[4], double (*out)[4]);
+void apply_motion(struct motion_model *mm, int action, double (**b)[4]);
+void predict_adaptive_belief(struct motion_model *mm, struct adaptive_belief *ab, int action);
+
+#endif
@@ -0,0 +1,335 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Continuous-pose particle filter - see EV3_Particles.h
+
+*/
+
+#include <math.h>
+#include "EV3_Particles.h"
+
+#define PF_ALIGN 32
+
+struct pf_job{
+ struct particle_filter *pf;
+ float dl, dr;
+ int colour;
+};
+
+static void *alloc_aligned(size_t bytes)
+{
+ void *p=NULL;
+
+ if (posix_memalign(&p,PF_ALIGN,bytes)!=0) return(NULL);
+ memset(p,0,bytes);
+ return(p);
+}
+
+static inline unsigned long long splitmix64(unsigned long long *s)
+{
+ unsigned long long z=(*s+=0x9E3779B97F4A7C15ULL);
+ z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+ z=(z^(z>>27))*0x94D049BB133111EBULL;
+ return(z^(z>>31));
+}
+
+static inline float uniform01(unsigned long long *s)
+{
+ return((float)(splitmix64(s)>>40)*(1.0f/16777216.0f));
+}
+
+static inline float gauss(unsigned long long *s)
+{
+ // Sum of four uniforms, rescaled to unit variance - close enough to normal for motion noise
+ return((uniform01(s)+uniform01(s)+uniform01(s)+uniform01(s)-2.0f)*1.7320508f);
+}
+
+unsigned char *pf_colour_image(unsigned char *map_img, int rx, int ry)
+{
+ // Indexed colour (1 - Black ... 6 - White) of every pixel, nearest palette colour
+ const int pal[PF_N_COLOURS][3]={{-1000,-1000,-1000},{0,0,0},{0,0,255},{0,255,0},{255,255,0},{255,0,0},{255,255,255}};
+ unsigned char *c;
+ int r, g, b, d, best, bd;
+
+ c=(unsigned char *)malloc((size_t)rx*ry);
+ if (c==NULL) return(NULL);
+ for (size_t p=0; p<(size_t)rx*ry; p++)
+ {
+  r=map_img[(p*3)];
+  g=map_img[(p*3)+1];
+  b=map_img[(p*3)+2];
+  best=1;
+  bd=1<<30;
+  for (int k=1; k<PF_N_COLOURS; k++)
+  {
+   d=((r-pal[k][0])*(r-pal[k][0]))+((g-pal[k][1])*(g-pal[k][1]))+((b-pal[k][2])*(b-pal[k][2]));
+   if (d<bd)
+   {
+    bd=d;
+    best=k;
+   }
+  }
+  c[p]=(unsigned char)best;
+ }
+ return(c);
+}
+
+int alloc_particle_filter(struct particle_filter *pf, int n, unsigned char *map_img, int rx, int ry)
+{
+ // Sets up a filter with n particles on the given map image, uniformly initialized.
+ // Returns 1 on success, 0 if out of memory.
+ size_t bytes=((((size_t)n+7)/8)*8)*sizeof(float);
+ float street;
+
+ memset(pf,0,sizeof(struct particle_filter));
+ pf->n=n;
+ pf->rx=rx;
+ pf->ry=ry;
+ pf->x=(float *)alloc_aligned(bytes);
+ pf->y=(float *)alloc_aligned(bytes);
+ pf->theta=(float *)alloc_aligned(bytes);
+ pf->w=(float *)alloc_aligned(bytes);
+ pf->nx=(float *)alloc_aligned(bytes);
+ pf->ny=(float *)alloc_aligned(bytes);
+ pf->ntheta=(float *)alloc_aligned(bytes);
+ pf->block_sum=(double *)calloc((n+PF_BLOCK-1)/PF_BLOCK,sizeof(double));
+ pf->colour=pf_colour_image(map_img,rx,ry);
+ if (pf->x==NULL||pf->y==NULL||pf->theta==NULL||pf->w==NULL||pf->nx==NULL||pf->ny==NULL||
+     pf->ntheta==NULL||pf->block_sum==NULL||pf->colour==NULL)
+ {
+  free_particle_filter(pf);
+  return(0);
+ }
+
+ street=(map_geom.wx>0)?(float)map_geom.wx:10.0f;
+ pf->wheel_base=street;
+ pf->sensor_offset=street/2.0f;
+ pf->dist_noise=PF_DIST_NOISE;
+ pf->dist_noise_min=PF_DIST_NOISE_MIN;
+ pf->hit=PF_COLOUR_HIT;
+ pf->px_per_power_sec=street/10.0f;
+ pf->px_per_degree=street/360.0f;
+ pf->resample_ratio=PF_RESAMPLE_RATIO;
+ pf->seed=0x5EED5EEDULL;
+ pf_init_uniform(pf);
+ return(1);
+}
+
+void free_particle_filter(struct particle_filter *pf)
+{
+ free(pf->x);
+ free(pf->y);
+ free(pf->theta);
+ free(pf->w);
+ free(pf->nx);
+ free(pf->ny);
+ free(pf->ntheta);
+ free(pf->block_sum);
+ free(pf->colour);
+ memset(pf,0,sizeof(struct particle_filter));
+}
+
+static void uniform_weights(struct particle_filter *pf)
+{
+ for (int i=0; i<pf->n; i++)
+  pf->w[i]=1.0f/(float)pf->n;
+}
+
+void pf_init_uniform(struct particle_filter *pf)
+{
+ // Poses spread uniformly over the street and intersection pixels, any heading
+ unsigned long long s=pf->seed^0xA5A5A5A5ULL^(pf->steps*0x9E3779B97F4A7C15ULL);
+ long px;
+ int tries;
+
+ for (int i=0; i<pf->n; i++)
+ {
+  for (tries=0; tries<1000; tries++)
+  {
+   px=(long)(uniform01(&s)*(float)pf->rx*(float)pf->ry);
+   if (px>=(long)pf->rx*pf->ry) px=((long)pf->rx*pf->ry)-1;
+   if (pf->colour[px]==1||pf->colour[px]==4) break;
+  }
+  pf->x[i]=(float)(px%pf->rx)+uniform01(&s);
+  pf->y[i]=(float)(px/pf->rx)+uniform01(&s);
+  pf->theta[i]=(uniform01(&s)*2.0f*(float)M_PI)-(float)M_PI;
+ }
+ uniform_weights(pf);
+}
+
+void pf_init_pose(struct particle_filter *pf, float x, float y, float theta, float spread_xy, float spread_theta)
+{
+ // Gaussian cloud around a known pose
+ unsigned long long s=pf->seed^0x3C3C3C3CULL^(pf->steps*0x9E3779B97F4A7C15ULL);
+
+ for (int i=0; i<pf->n; i++)
+ {
+  pf->x[i]=x+(spread_xy*gauss(&s));
+  pf->y[i]=y+(spread_xy*gauss(&s));
+  pf->theta[i]=theta+(spread_theta*gauss(&s));
+ }
+ uniform_weights(pf);
+}
+
+void pf_init_state(struct particle_filter *pf, int state, float spread_xy, float spread_theta)
+{
+ // Cloud around a histogram filter state (idx*4)+d - the centre of the intersection,
+ // facing along the street
+ const float heading[4]={-(float)M_PI/2.0f,0.0f,(float)M_PI/2.0f,(float)M_PI};
+ int idx=state/4;
+ float cx=map_geom.bx+((idx%sx)*map_geom.dx)+(map_geom.wx/2.0f);
+ float cy=map_geom.by+((idx/sx)*map_geom.dy)+(map_geom.wy/2.0f);
+
+ pf_init_pose(pf,cx,cy,heading[state&3],spread_xy,spread_theta);
+}
+
+void pf_motor_distances(struct particle_filter *pf, int lpower, int rpower, float seconds, float *dl, float *dr)
+{
+ *dl=(float)lpower*pf->px_per_power_sec*seconds;
+ *dr=(float)rpower*pf->px_per_power_sec*seconds;
+}
+
+void pf_tacho_distances(struct particle_filter *pf, float ldeg, float rdeg, float *dl, float *dr)
+{
+ *dl=ldeg*pf->px_per_degree;
+ *dr=rdeg*pf->px_per_degree;
+}
+
+static void step_block(int task, int worker, void *arg)
+{
+ // Moves and weights the particles of one block
+ struct pf_job *job=(struct pf_job *)arg;
+ struct particle_filter *pf=job->pf;
+ unsigned long long s=pf->seed^(pf->steps*0x9E3779B97F4A7C15ULL)^((unsigned long long)task*0xD1B54A32D192ED03ULL);
+ int first=task*PF_BLOCK;
+ int last=(first+PF_BLOCK<pf->n)?first+PF_BLOCK:pf->n;
+ float sl=pf->dist_noise*fabsf(job->dl)+pf->dist_noise_min;
+ float sr=pf->dist_noise*fabsf(job->dr)+pf->dist_noise_min;
+ float like_hit=pf->hit, like_miss=(1.0f-pf->hit)/5.0f;
+ float dl, dr, dc, dth, h, sx_, sy_;
+ int px, py;
+ double sum=0;
+
+ (void)worker;
+ splitmix64(&s);
+ for (int i=first; i<last; i++)
+ {
+  // Differential drive - the arc's chord follows the mean heading. With y pointing down,
+  // a right wheel that travels further turns the robot toward smaller theta.
+  dl=job->dl+(sl*gauss(&s));
+  dr=job->dr+(sr*gauss(&s));
+  dc=(dl+dr)*0.5f;
+  dth=(dl-dr)/pf->wheel_base;
+  h=pf->theta[i]+(dth*0.5f);
+  pf->x[i]+=dc*cosf(h);
+  pf->y[i]+=dc*sinf(h);
+  pf->theta[i]+=dth;
+  if (pf->theta[i]>(float)M_PI) pf->theta[i]-=2.0f*(float)M_PI;
+  else if (pf->theta[i]<-(float)M_PI) pf->theta[i]+=2.0f*(float)M_PI;
+
+  if (job->colour>0)
+  {
+   sx_=pf->x[i]+(pf->sensor_offset*cosf(pf->theta[i]));
+   sy_=pf->y[i]+(pf->sensor_offset*sinf(pf->theta[i]));
+   px=(int)floorf(sx_);
+   py=(int)floorf(sy_);
+   if (px<0||py<0||px>=pf->rx||py>=pf->ry) pf->w[i]=0;
+   else pf->w[i]*=(pf->colour[px+((size_t)py*pf->rx)]==job->colour)?like_hit:like_miss;
+  }
+  sum+=pf->w[i];
+ }
+ pf->block_sum[task]=sum;
+}
+
+double pf_step(struct particle_filter *pf, float dl, float dr, int colour)
+{
+ // One filter step - wheel distances dl, dr (pixels) and the indexed colour read at the
+ // end of the motion (pass 0 to skip the measurement). Resamples if needed, returns the
+ // effective sample size. If no particle agrees with the reading at all the robot is
+ // lost, and the filter starts over from a uniform spread.
+ struct pf_job job;
+ int blocks=(pf->n+PF_BLOCK-1)/PF_BLOCK;
+ double total=0, neff;
+
+ job.pf=pf;
+ job.dl=dl;
+ job.dr=dr;
+ job.colour=(colour>=1&&colour<PF_N_COLOURS)?colour:0;
+ run_parallel(blocks,pf->n_threads,step_block,&job);
+ pf->steps++;
+
+ for (int b=0; b<blocks; b++)
+  total+=pf->block_sum[b];
+ if (total<=0)
+ {
+  pf_init_uniform(pf);
+  return(pf->n);
+ }
+ for (int i=0; i<pf->n; i++)
+  pf->w[i]=(float)(pf->w[i]/total);
+
+ neff=pf_effective_size(pf);
+ if (neff<pf->resample_ratio*pf->n)
+ {
+  pf_resample(pf);
+  neff=pf->n;
+ }
+ return(neff);
+}
+
+double pf_effective_size(struct particle_filter *pf)
+{
+ // 1/sum(w^2) for normalized weights
+ double s=0;
+
+ for (int i=0; i<pf->n; i++)
+  s+=(double)pf->w[i]*pf->w[i];
+ return((s>0)?1.0/s:0);
+}
+
+void pf_resample(struct particle_filter *pf)
+{
+ // Systematic resampling - n evenly spaced pointers into the cumulative weights, with a
+ // single random offset, O(n)
+ unsigned long long s=pf->seed^0x77777777ULL^(pf->steps*0x9E3779B97F4A7C15ULL);
+ double step=1.0/pf->n, u, c;
+ float *t;
+ int j=0;
+
+ u=uniform01(&s)*step;
+ c=pf->w[0];
+ for (int i=0; i<pf->n; i++)
+ {
+  while (u>c&&j<pf->n-1)
+  {
+   j++;
+   c+=pf->w[j];
+  }
+  pf->nx[i]=pf->x[j];
+  pf->ny[i]=pf->y[j];
+  pf->ntheta[i]=pf->theta[j];
+  u+=step;
+ }
+ t=pf->x; pf->x=pf->nx; pf->nx=t;
+ t=pf->y; pf->y=pf->ny; pf->ny=t;
+ t=pf->theta; pf->theta=pf->ntheta; pf->ntheta=t;
+ uniform_weights(pf);
+}
+
+void pf_estimate(struct particle_filter *pf, float *x, float *y, float *theta)
+{
+ // Weighted mean pose, circular mean for the heading
+ double mx=0, my=0, c=0, s=0;
+
+ for (int i=0; i<pf->n; i++)
+ {
+  mx+=(double)pf->w[i]*pf->x[i];
+  my+=(double)pf->w[i]*pf->y[i];
+  c+=(double)pf->w[i]*cos(pf->theta[i]);
+  s+=(double)pf->w[i]*sin(pf->theta[i]);
+ }
+ *x=(float)mx;
+ *y=(float)my;
+ *theta=(float)atan2(s,c);
+}
@@ -0,0 +1,92 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Continuous-pose particle filter.
+
+ The histogram filter (beliefs[][]) only reasons about intersections and four headings,
+ so it learns nothing while the robot drives along a street. struct particle_filter
+ tracks (x, y, theta) poses in map image pixels instead, so every colour sensor reading
+ taken on the way (black street, yellow intersection, red border, a building the sensor
+ swept over) can be used.
+
+ * Particles are stored as separate x[], y[], theta[] and w[] float arrays (structure of
+   arrays), so each pass streams through memory. Theta is in radians, with the heading
+   vector (cos theta, sin theta) in image coordinates - x to the right, y down - so
+   facing UP on the map is theta=-pi/2.
+
+ * The motion model is a differential drive: pf_step() takes the distance each wheel
+   travelled (in pixels), perturbs it per particle with noise proportional to the
+   distance plus a small constant, and moves the particle along the resulting arc.
+   pf_motor_distances() converts the motor power and duration of a BT_drive()/BT_turn()
+   command to wheel distances with the px_per_power_sec calibration constant, and
+   pf_tacho_distances() converts wheel rotation in degrees with px_per_degree, for
+   when tacho counts are available (the bluetooth API in EV3_RobotControl does not
+   read them yet).
+
+ * The measurement model reads the map image. pf_colour_image() classifies every pixel
+   of the .ppm map to the nearest of the EV3 indexed colours (1 - Black ... 6 - White,
+   see parse_map()), and a reading has probability hit if it agrees with the pixel
+   under the sensor (sensor_offset pixels ahead of the wheel axis) and (1-hit)/5
+   otherwise. Particles off the image get weight 0.
+
+ * pf_step() does the prediction and, if colour is a valid reading (1-6), the weighting
+   in one pass, split into blocks of PF_BLOCK particles that run in parallel with
+   run_parallel() (EV3_Threads.h). Each block draws its noise from its own generator,
+   seeded from the filter seed, the step number and the block number, so results do
+   not depend on the number of threads.
+
+ * Systematic resampling (one random offset, O(N)) runs whenever the effective sample
+   size drops below resample_ratio*N.
+
+ All lengths are in map image pixels. alloc_particle_filter() sets defaults from the
+ map geometry (wheel base about one street width), calibrate them for the actual print.
+
+*/
+
+#ifndef __particles_header
+#define __particles_header
+
+#include "EV3_Map.h"
+#include "EV3_Threads.h"
+
+#define PF_BLOCK 4096               // Particles per parallel task
+#define PF_COLOUR_HIT 0.8           // Default probability that the sensor reads the map colour
+#define PF_DIST_NOISE 0.1           // Default wheel noise, std. dev. per pixel travelled...
+#define PF_DIST_NOISE_MIN 0.5       // ... plus this constant (pixels)
+#define PF_RESAMPLE_RATIO 0.5       // Resample when the effective sample size is below this fraction
+#define PF_N_COLOURS 7              // Indexed colours 0 (unknown) to 6 (white)
+
+struct particle_filter{
+ int n;                     // Number of particles
+ float *x, *y, *theta, *w;  // Particle poses and weights
+ float *nx, *ny, *ntheta;   // Resampling buffers, swapped with x, y, theta
+ double *block_sum;         // Weight sum per PF_BLOCK block
+ unsigned char *colour;     // Indexed colour of every map image pixel, rx*ry
+ int rx, ry;
+ float wheel_base;          // Distance between the wheels (pixels)
+ float sensor_offset;       // Colour sensor distance ahead of the wheel axis (pixels)
+ float dist_noise, dist_noise_min;
+ float hit;                 // Sensor model
+ float px_per_power_sec;    // Calibration for pf_motor_distances()
+ float px_per_degree;       // Calibration for pf_tacho_distances()
+ double resample_ratio;
+ unsigned long long seed;
+ unsigned long long steps;  // Number of pf_step() calls, mixed into the per-block seeds
+ int n_threads;             // 0 - default_threads()
+};
+
+unsigned char *pf_colour_image(unsigned char *map_img, int rx, int ry);
+int alloc_particle_filter(struct particle_filter *pf, int n, unsigned char *map_img, int rx, int ry);
+void free_particle_filter(struct particle_filter *pf);
+void pf_init_uniform(struct particle_filter *pf);
+void pf_init_pose(struct particle_filter *pf, float x, float y, float theta, float spread_xy, float spread_theta);
+void pf_init_state(struct particle_filter *pf, int state, float spread_xy, float spread_theta);
+double pf_step(struct particle_filter *pf, float dl, float dr, int colour);
+void pf_motor_distances(struct particle_filter *pf, int lpower, int rpower, float seconds, float *dl, float *dr);
+void pf_tacho_distances(struct particle_filter *pf, float ldeg, float rdeg, float *dl, float *dr);
+double pf_effective_size(struct particle_filter *pf);
+void pf_resample(struct particle_filter *pf);
+void pf_estimate(struct particle_filter *pf, float *x, float *y, float *theta);
+
+#endif
@@ -0,0 +1,313 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Route planning with turn costs - see EV3_Planner.h
+
+*/
+
+#include "EV3_Planner.h"
+
+void default_route_costs(struct route_costs *c)
+{
+ c->forward=ROUTE_FORWARD_COST;
+ c->turn=ROUTE_TURN_COST;
+ c->uturn=ROUTE_UTURN_COST;
+}
+
+int alloc_route_planner(struct route_planner *rp, const struct route_costs *c)
+{
+ // Sizes the planner for the current map. Returns 1 on success, 0 if out of memory.
+ int ns=sx*sy*4;
+
+ memset(rp,0,sizeof(struct route_planner));
+ rp->n=sx*sy;
+ rp->cost=*c;
+ rp->g=(double *)calloc(ns,sizeof(double));
+ rp->prev=(int *)calloc(ns,sizeof(int));
+ rp->action=(unsigned char *)calloc(ns,sizeof(unsigned char));
+ rp->stamp=(unsigned int *)calloc(ns,sizeof(unsigned int));
+ rp->heap=(int *)calloc(ns,sizeof(int));
+ rp->key=(double *)calloc(ns,sizeof(double));
+ rp->pos=(int *)calloc(ns,sizeof(int));
+ if (rp->g==NULL||rp->prev==NULL||rp->action==NULL||rp->stamp==NULL||rp->heap==NULL||rp->key==NULL||rp->pos==NULL)
+ {
+  free_route_planner(rp);
+  return(0);
+ }
+ return(1);
+}
+
+void free_route_planner(struct route_planner *rp)
+{
+ free(rp->g);
+ free(rp->prev);
+ free(rp->action);
+ free(rp->stamp);
+ free(rp->heap);
+ free(rp->key);
+ free(rp->pos);
+ memset(rp,0,sizeof(struct route_planner));
+}
+
+static inline double turn_cost(const struct route_costs *c, int from, int to)
+{
+ // Cheapest way to turn from heading from to heading to
+ int r=(to-from)&3;
+
+ if (r==0) return(0);
+ if (r==2) return((c->uturn<2*c->turn)?c->uturn:2*c->turn);
+ return(c->turn);
+}
+
+static inline double heuristic_xy(const struct route_costs *c, int x, int y, int d, int tx, int ty)
+{
+ // route_heuristic() with the coordinates already worked out
+ int dx=tx-x, dy=ty-y;
+ int hx=(dx>0)?1:3, hy=(dy>0)?2:0;      // Headings that drive toward the target
+ double h, a, b;
+
+ h=c->forward*(double)(abs(dx)+abs(dy));
+ if (dx!=0&&dy!=0)
+ {
+  a=turn_cost(c,d,hx)+turn_cost(c,hx,hy);
+  b=turn_cost(c,d,hy)+turn_cost(c,hy,hx);
+  h+=(a<b)?a:b;
+ }
+ else if (dx!=0) h+=turn_cost(c,d,hx);
+ else if (dy!=0) h+=turn_cost(c,d,hy);
+ return(h);
+}
+
+double route_heuristic(const struct route_costs *c, int state, int target)
+{
+ // Lower bound on the cost from state to intersection target: every block of the Manhattan
+ // distance, plus the turns needed to face each direction the robot still has to drive in
+ return(heuristic_xy(c,(state/4)%sx,(state/4)/sx,state&3,target%sx,target/sx));
+}
+
+static inline void heap_swap(struct route_planner *rp, int i, int j)
+{
+ int s=rp->heap[i];
+ double k=rp->key[i];
+
+ rp->heap[i]=rp->heap[j];
+ rp->key[i]=rp->key[j];
+ rp->heap[j]=s;
+ rp->key[j]=k;
+ rp->pos[rp->heap[i]]=i;
+ rp->pos[rp->heap[j]]=j;
+}
+
+static void heap_up(struct route_planner *rp, int i)
+{
+ while (i>0&&rp->key[(i-1)/2]>rp->key[i])
+ {
+  heap_swap(rp,i,(i-1)/2);
+  i=(i-1)/2;
+ }
+}
+
+static void heap_down(struct route_planner *rp, int i)
+{
+ int c;
+
+ while ((c=(2*i)+1)<rp->heap_size)
+ {
+  if (c+1<rp->heap_size&&rp->key[c+1]<rp->key[c]) c++;
+  if (rp->key[c]>=rp->key[i]) break;
+  heap_swap(rp,i,c);
+  i=c;
+ }
+}
+
+static void heap_push_or_decrease(struct route_planner *rp, int s, double k)
+{
+ int i=rp->pos[s];
+
+ if (i<0)
+ {
+  i=rp->heap_size++;
+  rp->heap[i]=s;
+  rp->pos[s]=i;
+ }
+ rp->key[i]=k;
+ heap_up(rp,i);
+}
+
+static int heap_pop(struct route_planner *rp)
+{
+ int s=rp->heap[0];
+
+ rp->pos[s]=-1;
+ rp->heap_size--;
+ if (rp->heap_size>0)
+ {
+  rp->heap[0]=rp->heap[rp->heap_size];
+  rp->key[0]=rp->key[rp->heap_size];
+  rp->pos[rp->heap[0]]=0;
+  heap_down(rp,0);
+ }
+ return(s);
+}
+
+static void new_query(struct route_planner *rp)
+{
+ rp->query++;
+ if (rp->query==0)
+ {
+  // Stamps wrapped around, old entries could look current
+  memset(rp->stamp,0,(size_t)rp->n*4*sizeof(unsigned int));
+  rp->query=1;
+ }
+ rp->expanded=0;
+ rp->heap_size=0;
+}
+
+int plan_route(struct route_planner *rp, int start, int target, unsigned char *actions, int max_actions, double *cost)
+{
+ // Cheapest action sequence from state start to intersection target (any heading). Writes
+ // up to max_actions MOVE_* actions to actions[] and the route cost to *cost (if not NULL).
+ // Returns the number of actions, or -1 if there is no route, it is longer than
+ // max_actions, or the planner was sized for a different map.
+ const int dir_dx[4]={0,1,0,-1}, dir_dy[4]={-1,0,1,0};
+ const struct route_costs *c=&rp->cost;
+ int s, t, a, len, x, y, nx, ny, tx, ty;
+ double g;
+
+ if (rp->n!=sx*sy||start<0||start>=rp->n*4||target<0||target>=rp->n) return(-1);
+ tx=target%sx;
+ ty=target/sx;
+ new_query(rp);
+ rp->stamp[start]=rp->query;
+ rp->g[start]=0;
+ rp->prev[start]=-1;
+ rp->pos[start]=-1;
+ heap_push_or_decrease(rp,start,route_heuristic(c,start,target));
+
+ s=-1;
+ while (rp->heap_size>0)
+ {
+  s=heap_pop(rp);
+  if (s/4==target) break;
+  rp->expanded++;
+  x=(s/4)%sx;
+  y=(s/4)/sx;
+  for (a=0; a<N_MOVES; a++)
+  {
+   // Successor state and its coordinates - forward moves one block, turns stay put
+   if (a==MOVE_FORWARD)
+   {
+    if (map_nbr[s]<0) continue;
+    t=(map_nbr[s]*4)+(s&3);
+    g=rp->g[s]+c->forward;
+    nx=x+dir_dx[s&3];
+    ny=y+dir_dy[s&3];
+   }
+   else
+   {
+    t=move_state(s,a);
+    g=rp->g[s]+((a==MOVE_UTURN)?c->uturn:c->turn);
+    nx=x;
+    ny=y;
+   }
+   if (rp->stamp[t]!=rp->query)
+   {
+    rp->stamp[t]=rp->query;
+    rp->pos[t]=-1;
+   }
+   else if (g>=rp->g[t]) continue;
+   rp->g[t]=g;
+   rp->prev[t]=s;
+   rp->action[t]=(unsigned char)a;
+   heap_push_or_decrease(rp,t,g+heuristic_xy(c,nx,ny,t&3,tx,ty));
+  }
+  s=-1;
+ }
+ // Leave pos[] clean for the states still in the heap
+ for (int i=0; i<rp->heap_size; i++)
+  rp->pos[rp->heap[i]]=-1;
+ if (s<0) return(-1);
+
+ len=0;
+ for (t=s; t!=start; t=rp->prev[t])
+  len++;
+ if (len>max_actions) return(-1);
+ for (t=s, a=len-1; t!=start; t=rp->prev[t], a--)
+  actions[a]=rp->action[t];
+ if (cost!=NULL) *cost=rp->g[s];
+ return(len);
+}
+
+int routes_to_target(struct route_planner *rp, int target, unsigned char *next)
+{
+ // Backward Dijkstra from all four headings at intersection target. On return next[]
+ // (n bytes) holds, for every state s, the first action of a cheapest route from s to
+ // target, 2 bits per state: bits 2*(s&3) of next[s/4]. States that can not reach the
+ // target (none, on a map without holes) and the target's own states get MOVE_FORWARD.
+ // next may be NULL - either way rp->g[s] is left holding the cost from s to the target
+ // for every state with rp->stamp[s]==rp->query. Returns 1 on success, 0 if the planner
+ // was sized for a different map.
+ return(routes_to_states(rp,target,next,NULL,0));
+}
+
+int routes_to_states(struct route_planner *rp, int target, unsigned char *next, const int *starts, int n_starts)
+{
+ // routes_to_target(), stopped as soon as every state in starts[] is settled (n_starts 0
+ // searches the whole map). next[] and g[] are then only valid for the settled states -
+ // those with rp->stamp[s]==rp->query and rp->pos[s]==-1 - but following next[] from a
+ // settled state only ever reaches settled states, so routes from starts[] read off whole.
+ const struct route_costs *c=&rp->cost;
+ int s, p, a, d, k=0;
+ double g, w;
+
+ if (rp->n!=sx*sy||target<0||target>=rp->n) return(0);
+ new_query(rp);
+ if (next!=NULL) memset(next,0,(size_t)rp->n);
+ for (d=0; d<4; d++)
+ {
+  s=(target*4)+d;
+  rp->stamp[s]=rp->query;
+  rp->g[s]=0;
+  rp->pos[s]=-1;
+  heap_push_or_decrease(rp,s,0);
+ }
+ while (rp->heap_size>0)
+ {
+  s=heap_pop(rp);
+  rp->expanded++;
+  if (n_starts>0)
+  {
+   while (k<n_starts&&rp->stamp[starts[k]]==rp->query&&rp->pos[starts[k]]==-1) k++;
+   if (k==n_starts) break;
+  }
+  d=s&3;
+  for (a=0; a<N_MOVES; a++)
+  {
+   // The state p from which action a leads to s
+   if (a==MOVE_FORWARD)
+   {
+    p=map_nbr[(s&~3)+((d+2)&3)];
+    if (p<0) continue;
+    p=(p*4)+d;
+    w=c->forward;
+   }
+   else
+   {
+    p=(s&~3)|((d+((a==MOVE_LEFT)?1:((a==MOVE_RIGHT)?3:2)))&3);
+    w=(a==MOVE_UTURN)?c->uturn:c->turn;
+   }
+   g=rp->g[s]+w;
+   if (rp->stamp[p]!=rp->query)
+   {
+    rp->stamp[p]=rp->query;
+    rp->pos[p]=-1;
+   }
+   else if (g>=rp->g[p]) continue;
+   rp->g[p]=g;
+   if (next!=NULL) next[p/4]=(unsigned char)((next[p/4]&~(3<<(2*(p&3))))|(a<<(2*(p&3))));
+   heap_push_or_decrease(rp,p,g);
+  }
+ }
+ return(1);
+}
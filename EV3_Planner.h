@@ -0,0 +1,81 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Route planning with turn costs.
+
+ The robot's position on the map is a state (intersection, heading) - idx*4+d as in
+ beliefs[][]. It can change state in four ways, with separate costs in struct route_costs:
+
+   MOVE_FORWARD - drive one block along the street it faces (cost forward). Not allowed
+                  when the street leads into the red border (map_nbr[] is -1), so a
+                  route never leaves the map.
+   MOVE_LEFT, MOVE_RIGHT - turn 90 degrees in place (cost turn)
+   MOVE_UTURN - turn around in place (cost uturn)
+
+ Turning is slow and error-prone compared to driving straight, so the cheapest route
+ usually has fewer turns than a plain shortest path in blocks.
+
+ plan_route() is an A* search over this state graph from the robot's state to any state
+ at the target intersection. The heuristic is the Manhattan distance times the forward
+ cost, plus the cheapest sequence of turns that faces the robot, in turn, along every
+ direction it still has to go in (0 if the target is straight ahead, one turn if it is
+ off to the side, ...). It never overestimates, so routes are optimal.
+
+ The search allocates nothing per query: struct route_planner holds per-state arrays
+ for g, the predecessor, and the open list (a binary heap of states in one flat array,
+ with each state's heap position kept for decrease-key). Arrays are not cleared between
+ queries either - every state carries the number of the query that last touched it,
+ and entries with an older number count as unvisited.
+
+ The result is a list of MOVE_* actions, start to target, that go_to_target() executes
+ one by one - turn_at_intersection() for turns, drive_along_street() for MOVE_FORWARD.
+
+ routes_to_target() runs the search the other way: a Dijkstra backward from the target
+ over the reversed state graph, which gives the first action of a cheapest route from
+ every state at once. EV3_RouteTable.h builds its all-pairs table from it, EV3_QMDP.h its
+ per-state action values from the costs it leaves in g[].
+ routes_to_states() stops the same search once a given set of start states is settled,
+ for batches of queries toward one target (EV3_RouteBatch.h).
+
+*/
+
+#ifndef __planner_header
+#define __planner_header
+
+#include "EV3_Motion.h"
+
+#define ROUTE_FORWARD_COST 1.0      // Default costs (about seconds on the course robot)
+#define ROUTE_TURN_COST 1.5
+#define ROUTE_UTURN_COST 2.5
+
+struct route_costs{
+ double forward;
+ double turn;
+ double uturn;
+};
+
+struct route_planner{
+ int n;                     // Number of intersections the arrays are sized for
+ struct route_costs cost;
+ double *g;                 // Cost of the best known route to each state
+ int *prev;                 // Predecessor state on that route
+ unsigned char *action;     // Action taken from prev
+ unsigned int *stamp;       // Query that last reached the state (g, prev valid only if current)
+ unsigned int query;
+ int *heap;                 // Open list - binary heap of states ordered by g + heuristic
+ double *key;               // Heap keys, by heap position
+ int *pos;                  // Heap position of each state, -1 if not in the heap
+ int heap_size;
+ long expanded;             // States expanded by the last query
+};
+
+void default_route_costs(struct route_costs *c);
+int alloc_route_planner(struct route_planner *rp, const struct route_costs *c);
+void free_route_planner(struct route_planner *rp);
+double route_heuristic(const struct route_costs *c, int state, int target);
+int plan_route(struct route_planner *rp, int start, int target, unsigned char *actions, int max_actions, double *cost);
+int routes_to_target(struct route_planner *rp, int target, unsigned char *next);
+int routes_to_states(struct route_planner *rp, int target, unsigned char *next, const int *starts, int n_starts);
+
+#endif
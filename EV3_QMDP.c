@@ -0,0 +1,131 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ QMDP action selection - see EV3_QMDP.h
+
+*/
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <string.h>
+#include "EV3_QMDP.h"
+
+int alloc_qmdp(struct qmdp_policy *qp)
+{
+ // Sizes the policy for the current map. Returns 1 on success, 0 if out of memory.
+ memset(qp,0,sizeof(struct qmdp_policy));
+ qp->n=sx*sy;
+ qp->target=-1;
+ if (posix_memalign((void **)&qp->q,QMDP_ALIGN,(size_t)N_MOVES*qp->n*4*sizeof(float))!=0)
+ {
+  qp->q=NULL;
+  return(0);
+ }
+ return(1);
+}
+
+void free_qmdp(struct qmdp_policy *qp)
+{
+ free(qp->q);
+ memset(qp,0,sizeof(struct qmdp_policy));
+ qp->target=-1;
+}
+
+int build_qmdp(struct qmdp_policy *qp, struct route_planner *rp, int target)
+{
+ // Fills in Q toward intersection target, with the route costs of the planner (which is
+ // used for one backward search). Returns 1 on success, 0 if the target is not on the map
+ // or the policy or planner were sized for a different map.
+ const struct route_costs *c=&rp->cost;
+ const double turn[N_MOVES]={0,c->turn,c->turn,c->uturn};
+ size_t n4=(size_t)qp->n*4;
+ int a, s, t;
+ double v;
+
+ if (qp->q==NULL||qp->n!=sx*sy||routes_to_target(rp,target,NULL)==0) return(0);
+ qp->target=target;
+ qp->cost=*c;
+ for (s=0; s<(int)n4; s++)
+ {
+  if (s/4==target)
+  {
+   for (a=0; a<N_MOVES; a++)
+    qp->q[(a*n4)+s]=0;
+   continue;
+  }
+  for (a=0; a<N_MOVES; a++)
+  {
+   // Turn, then drive - or bounce off the border and come back turned around
+   t=(a==MOVE_FORWARD)?s:move_state(s,a);
+   v=turn[a]+c->forward;
+   if (map_nbr[t]<0) v+=c->uturn;
+   t=move_state(t,MOVE_FORWARD);
+   v=(rp->stamp[t]==rp->query)?v+rp->g[t]:QMDP_UNREACHABLE;
+   qp->q[(a*n4)+s]=(v<QMDP_UNREACHABLE)?(float)v:QMDP_UNREACHABLE;
+  }
+ }
+ return(1);
+}
+
+int qmdp_action(const struct qmdp_policy *qp, double (*b)[4], double expected_cost[N_MOVES])
+{
+ // The macro action with the lowest expected cost to the target under beliefs b[][] (any
+ // lazy scale), and, if expected_cost is not NULL, the expected cost of every action.
+ // Returns -1 if Q has not been built for the current map.
+ const double *p=&b[0][0];
+ size_t n4=(size_t)qp->n*4, s=0;
+ const float *q0, *q1, *q2, *q3;
+ double acc[N_MOVES], sum;
+ int a, best;
+
+ if (qp->target<0||qp->n!=sx*sy) return(-1);
+ q0=qp->q;
+ q1=q0+n4;
+ q2=q1+n4;
+ q3=q2+n4;
+#if defined(__AVX2__)
+ {
+  __m256d vb, vs=_mm256_setzero_pd();
+  __m256d v0=_mm256_setzero_pd(), v1=_mm256_setzero_pd(), v2=_mm256_setzero_pd(), v3=_mm256_setzero_pd();
+  double t[4];
+
+  for (; s+4<=n4; s+=4)
+  {
+   vb=_mm256_loadu_pd(p+s);
+   vs=_mm256_add_pd(vs,vb);
+   v0=_mm256_add_pd(v0,_mm256_mul_pd(vb,_mm256_cvtps_pd(_mm_load_ps(q0+s))));
+   v1=_mm256_add_pd(v1,_mm256_mul_pd(vb,_mm256_cvtps_pd(_mm_load_ps(q1+s))));
+   v2=_mm256_add_pd(v2,_mm256_mul_pd(vb,_mm256_cvtps_pd(_mm_load_ps(q2+s))));
+   v3=_mm256_add_pd(v3,_mm256_mul_pd(vb,_mm256_cvtps_pd(_mm_load_ps(q3+s))));
+  }
+  // Horizontal sums
+  _mm256_storeu_pd(t,vs); sum=t[0]+t[1]+t[2]+t[3];
+  _mm256_storeu_pd(t,v0); acc[0]=t[0]+t[1]+t[2]+t[3];
+  _mm256_storeu_pd(t,v1); acc[1]=t[0]+t[1]+t[2]+t[3];
+  _mm256_storeu_pd(t,v2); acc[2]=t[0]+t[1]+t[2]+t[3];
+  _mm256_storeu_pd(t,v3); acc[3]=t[0]+t[1]+t[2]+t[3];
+ }
+#else
+ sum=0;
+ for (a=0; a<N_MOVES; a++)
+  acc[a]=0;
+#endif
+ for (; s<n4; s++)
+ {
+  sum+=p[s];
+  acc[0]+=p[s]*q0[s];
+  acc[1]+=p[s]*q1[s];
+  acc[2]+=p[s]*q2[s];
+  acc[3]+=p[s]*q3[s];
+ }
+ best=0;
+ for (a=0; a<N_MOVES; a++)
+ {
+  acc[a]=(sum>0)?acc[a]/sum:0;
+  if (expected_cost!=NULL) expected_cost[a]=acc[a];
+  if (acc[a]<acc[best]) best=a;
+ }
+ return(best);
+}
@@ -0,0 +1,60 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ QMDP action selection toward a target.
+
+ robot_localization() keeps exploring until one state holds LOCALIZED_PROB of the
+ belief, and only then does go_to_target() start driving. Often the few states still in
+ the running all want the robot to go the same way, and the scans on the way there
+ finish the localization for free. QMDP (Littman, Cassandra and Kaelbling, 1995) picks
+ actions that way: it pretends the uncertainty will be gone after the next step, so the
+ value of a macro action a (turn as in EV3_Explore.h, then drive one block) under belief
+ b is the expected cost over the states the robot might be in:
+
+     cost(a) = sum over states s of b(s) * Q(s,a)
+
+     Q(s,a)  = cost of turning for a + cost of driving one block + V(state it leads to)
+
+ where V(s) is the cost of a cheapest route from s to the target under struct
+ route_costs (EV3_Planner.h, from one backward search - routes_to_target()). A drive
+ into the red border ends up back at the same intersection turned around (EV3_Motion.h)
+ and is charged forward + uturn. Every state at the target has Q = 0 for all actions.
+
+ Q is built once per target. It is stored action-major as float, Q[a][s] for the 4n
+ states in beliefs[][] order, so qmdp_action() is four dot products with the flat
+ beliefs array that share a single streaming pass over it (AVX2: four states per vector,
+ Q widened to double). The same pass sums the beliefs, so the lazy scale of
+ EV3_Beliefs.h does not matter - the expected costs come out normalized.
+
+ QMDP never picks an action just to learn something, so robot_localization() only
+ hands over to it once the beliefs are down to a few hundred candidates (QMDP_MAX_ENTROPY
+ in EV3_Localization.h) and leaves the earlier, more ambiguous steps to the
+ information-gain explorer. In simulation (mc_localize -g against -g -q 8, 500
+ episodes) the gain in the cost of getting to the target, localization included,
+ depends on how ambiguous the map is: 2-5% on the plain and irregular 20x20 to 100x100
+ corpus maps, 7-19% on the ambiguous ones.
+
+*/
+
+#ifndef __qmdp_header
+#define __qmdp_header
+
+#include "EV3_Planner.h"
+
+#define QMDP_ALIGN 32
+#define QMDP_UNREACHABLE 1e9f       // Q for states that can not reach the target
+
+struct qmdp_policy{
+ int n;                     // Number of intersections
+ int target;                // Target intersection, -1 if Q has not been built
+ struct route_costs cost;
+ float *q;                  // q[(a*4n)+s] - expected cost to the target after macro action a in state s
+};
+
+int alloc_qmdp(struct qmdp_policy *qp);
+void free_qmdp(struct qmdp_policy *qp);
+int build_qmdp(struct qmdp_policy *qp, struct route_planner *rp, int target);
+int qmdp_action(const struct qmdp_policy *qp, double (*b)[4], double expected_cost[N_MOVES]);
+
+#endif
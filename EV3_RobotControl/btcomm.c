@@ -2051,3 +2051,61 @@ int BT_restore_previous_display(int no){
  }
  return (0);
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Added for EV3_Executor.c (CSC C85 project code) - pre-encoded commands
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int BT_send_command(const unsigned char *cmd, int len)
+{
+ //////////////////////////////////////////////////////////////////////////////////////////////////
+ // Writes an already encoded command string (length field, message id and all) to the EV3
+ // without waiting for the reply - read it later with BT_read_reply().
+ //
+ // Inputs: The command string and its length in bytes
+ //
+ // Returns: 1 on success
+ //          0 otherwise
+ //////////////////////////////////////////////////////////////////////////////////////////////////
+ int done=0, n;
+
+ while (done<len)
+ {
+  n=write(*socket_id,cmd+done,len-done);
+  if (n<=0) return(0);
+  done+=n;
+ }
+ message_id_counter++;
+ return(1);
+}
+
+static int read_fully(unsigned char *buf, int len)
+{
+ int done=0, n;
+
+ while (done<len)
+ {
+  n=read(*socket_id,buf+done,len-done);
+  if (n<=0) return(0);
+  done+=n;
+ }
+ return(1);
+}
+
+int BT_read_reply(unsigned char *reply, int max_len)
+{
+ //////////////////////////////////////////////////////////////////////////////////////////////////
+ // Reads exactly one reply from the EV3: the 2-byte length field, then that many bytes.
+ //
+ // Inputs: Buffer for the reply, and its size
+ //
+ // Returns: The length of the reply including the length field
+ //          -1 on failure, or if the reply does not fit
+ //////////////////////////////////////////////////////////////////////////////////////////////////
+ int len;
+
+ if (max_len<2||read_fully(reply,2)==0) return(-1);
+ len=reply[0]|(reply[1]<<8);
+ if (len+2>max_len||read_fully(reply+2,len)==0) return(-1);
+ return(len+2);
+}
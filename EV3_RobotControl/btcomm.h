@@ -172,4 +172,10 @@ int BT_set_LED_colour(int colour);
 int BT_draw_image_from_file(int colour, int x_0, int y_0, const char *file_path);
 int BT_restore_previous_display(int no);
 int BT_store_current_display(int no);
+
+// Pre-encoded command section (added for EV3_Executor.c, CSC C85 project code)
+// Lets a caller send several commands before reading their replies - each reply is read
+// whole, by its length field, so replies that arrive back to back are not mixed up.
+int BT_send_command(const unsigned char *cmd, int len);
+int BT_read_reply(unsigned char *reply, int max_len);
 #endif
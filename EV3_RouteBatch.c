@@ -0,0 +1,302 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Batched route queries - see EV3_RouteBatch.h
+
+*/
+
+#include "EV3_RouteBatch.h"
+
+struct batch_run{
+ struct route_batch *rb;
+ const struct route_query *q;
+ struct route_result *res;
+ int want_paths;
+ int failed;
+};
+
+int alloc_route_batch(struct route_batch *rb, const struct route_costs *c, int n_threads)
+{
+ // Sizes the batch for the current map, with one search per worker. n_threads 0 uses
+ // default_threads(). Query buffers grow with the batches. Returns 1 on success, 0 if
+ // out of memory.
+ memset(rb,0,sizeof(struct route_batch));
+ if (n_threads<=0) n_threads=default_threads();
+ rb->n=sx*sy;
+ rb->n_threads=n_threads;
+ rb->workers=(struct batch_worker *)calloc(n_threads,sizeof(struct batch_worker));
+ rb->count=(int *)calloc(rb->n,sizeof(int));
+ if (rb->workers==NULL||rb->count==NULL)
+ {
+  free_route_batch(rb);
+  return(0);
+ }
+ for (int w=0; w<n_threads; w++)
+ {
+  rb->workers[w].next=(unsigned char *)malloc((size_t)rb->n);
+  if (rb->workers[w].next==NULL||alloc_route_planner(&rb->workers[w].rp,c)==0)
+  {
+   free_route_batch(rb);
+   return(0);
+  }
+ }
+ return(1);
+}
+
+void free_route_batch(struct route_batch *rb)
+{
+ if (rb->workers!=NULL)
+  for (int w=0; w<rb->n_threads; w++)
+  {
+   free_route_planner(&rb->workers[w].rp);
+   free(rb->workers[w].next);
+   free(rb->workers[w].paths);
+  }
+ free(rb->workers);
+ free(rb->count);
+ free(rb->order);
+ free(rb->starts);
+ free(rb->group);
+ free(rb->worker_of);
+ free(rb->paths);
+ memset(rb,0,sizeof(struct route_batch));
+}
+
+static int grow_queries(struct route_batch *rb, int n_queries)
+{
+ int *o, *s, *g, *w;
+
+ if (n_queries<=rb->max_queries) return(1);
+ o=(int *)realloc(rb->order,(size_t)n_queries*sizeof(int));
+ if (o!=NULL) rb->order=o;
+ s=(int *)realloc(rb->starts,(size_t)n_queries*sizeof(int));
+ if (s!=NULL) rb->starts=s;
+ g=(int *)realloc(rb->group,((size_t)n_queries+1)*sizeof(int));
+ if (g!=NULL) rb->group=g;
+ w=(int *)realloc(rb->worker_of,(size_t)n_queries*sizeof(int));
+ if (w!=NULL) rb->worker_of=w;
+ if (o==NULL||s==NULL||g==NULL||w==NULL) return(0);
+ rb->max_queries=n_queries;
+ return(1);
+}
+
+static int worker_path_space(struct batch_worker *bw, long len)
+{
+ long cap;
+ unsigned char *p;
+
+ if (bw->used+len<=bw->capacity) return(1);
+ cap=(bw->capacity>0)?bw->capacity:4096;
+ while (cap<bw->used+len) cap*=2;
+ p=(unsigned char *)realloc(bw->paths,(size_t)cap);
+ if (p==NULL) return(0);
+ bw->paths=p;
+ bw->capacity=cap;
+ return(1);
+}
+
+static int shared_tree_pays(const struct route_batch *rb, const struct route_costs *c, int first, int last, int target)
+{
+ // Whether one backward search beats an A* per query for this group. A* on these maps
+ // expands little more than the states along the route, about h/forward + 4; the shared
+ // search settles every state within reach of the farthest start - a diamond of radius
+ // R = max h/forward blocks, 4*(2R^2+2R+1) states, and never more than the whole map.
+ double h, r=0, astar=0, tree;
+
+ for (int k=first; k<last; k++)
+ {
+  h=route_heuristic(c,rb->starts[k],target)/c->forward;
+  astar+=h+4;
+  if (h>r) r=h;
+ }
+ tree=4.0*((2*r*r)+(2*r)+1);
+ if (tree>4.0*rb->n) tree=4.0*rb->n;
+ return(tree<astar);
+}
+
+static void astar_group(struct batch_run *br, int worker, int first, int last, int target)
+{
+ // Small or spread out group - one plan_route() per query
+ struct route_batch *rb=br->rb;
+ struct batch_worker *bw=&rb->workers[worker];
+ int i, len;
+ double cost;
+
+ for (int k=first; k<last; k++)
+ {
+  i=rb->order[k];
+  rb->worker_of[i]=worker;
+  br->res[i].offset=-1;
+  // Routes are written straight into the worker's buffer, and kept only if asked for
+  if (worker_path_space(bw,(long)rb->n*4)==0)
+  {
+   br->failed=1;
+   return;
+  }
+  len=plan_route(&bw->rp,rb->starts[k],target,bw->paths+bw->used,rb->n*4,&cost);
+  bw->expanded+=bw->rp.expanded;
+  br->res[i].cost=(len>=0)?cost:-1;
+  br->res[i].len=len;
+  if (br->want_paths&&len>=0)
+  {
+   br->res[i].offset=bw->used;
+   bw->used+=len;
+  }
+ }
+}
+
+static void group_task(int task, int worker, void *arg)
+{
+ // One search for every query in group task, then each route read off its tree - unless
+ // the group is answered faster by A*
+ struct batch_run *br=(struct batch_run *)arg;
+ struct route_batch *rb=br->rb;
+ struct batch_worker *bw=&rb->workers[worker];
+ const struct route_costs *c=&bw->rp.cost;
+ int first=rb->group[task], last=rb->group[task+1];
+ int target=br->q[rb->order[first]].target;
+ int i, s, a, len;
+ double cost;
+
+ if (!shared_tree_pays(rb,c,first,last,target))
+ {
+  astar_group(br,worker,first,last,target);
+  return;
+ }
+ if (routes_to_states(&bw->rp,target,bw->next,&rb->starts[first],last-first)==0)
+ {
+  br->failed=1;
+  return;
+ }
+ bw->expanded+=bw->rp.expanded;
+ bw->trees++;
+ for (int k=first; k<last; k++)
+ {
+  i=rb->order[k];
+  s=rb->starts[k];
+  rb->worker_of[i]=worker;
+  br->res[i].offset=-1;
+  if (bw->rp.stamp[s]!=bw->rp.query||bw->rp.pos[s]!=-1)
+  {
+   br->res[i].cost=-1;
+   br->res[i].len=-1;
+   continue;
+  }
+  // A cheapest route never visits a state twice, so it is at most 4n long
+  if (br->want_paths&&worker_path_space(bw,(long)rb->n*4)==0)
+  {
+   br->failed=1;
+   return;
+  }
+  len=0;
+  cost=0;
+  while (s/4!=target&&len<rb->n*4)
+  {
+   a=(bw->next[s/4]>>(2*(s&3)))&3;
+   if (a==MOVE_FORWARD)
+   {
+    s=(map_nbr[s]*4)+(s&3);
+    cost+=c->forward;
+   }
+   else
+   {
+    s=move_state(s,a);
+    cost+=(a==MOVE_UTURN)?c->uturn:c->turn;
+   }
+   if (br->want_paths) bw->paths[bw->used+len]=(unsigned char)a;
+   len++;
+  }
+  br->res[i].cost=cost;
+  br->res[i].len=len;
+  if (br->want_paths)
+  {
+   br->res[i].offset=bw->used;
+   bw->used+=len;
+  }
+ }
+}
+
+int route_batch(struct route_batch *rb, const struct route_query *q, int n_queries, struct route_result *res, int want_paths)
+{
+ // Answers n_queries route queries into res[] (same order). With want_paths set, the
+ // actions of every route are left in rb->paths from res[i].offset on. Returns 1 on
+ // success, 0 if a query is out of range, the batch was sized for a different map, or
+ // out of memory.
+ struct batch_run br;
+ long total;
+ int t, k;
+
+ rb->groups=0;
+ rb->trees=0;
+ rb->expanded=0;
+ if (rb->n!=sx*sy) return(0);
+ if (n_queries<=0) return(1);
+ for (k=0; k<n_queries; k++)
+  if (q[k].start<0||q[k].start>=rb->n*4||q[k].target<0||q[k].target>=rb->n)
+  {
+   fprintf(stderr,"route_batch(): Query %d is off the map\n",k);
+   return(0);
+  }
+ if (grow_queries(rb,n_queries)==0) return(0);
+
+ // Counting sort by target - count[t] becomes the first position of target t's group
+ memset(rb->count,0,(size_t)rb->n*sizeof(int));
+ for (k=0; k<n_queries; k++)
+  rb->count[q[k].target]++;
+ total=0;
+ for (t=0; t<rb->n; t++)
+ {
+  int c=rb->count[t];
+  rb->count[t]=(int)total;
+  if (c>0) rb->group[rb->groups++]=(int)total;
+  total+=c;
+ }
+ rb->group[rb->groups]=n_queries;
+ for (k=0; k<n_queries; k++)
+ {
+  int p=rb->count[q[k].target]++;
+  rb->order[p]=k;
+  rb->starts[p]=q[k].start;
+ }
+
+ br.rb=rb;
+ br.q=q;
+ br.res=res;
+ br.want_paths=want_paths;
+ br.failed=0;
+ for (int w=0; w<rb->n_threads; w++)
+ {
+  rb->workers[w].used=0;
+  rb->workers[w].expanded=0;
+  rb->workers[w].trees=0;
+ }
+ run_parallel((int)rb->groups,rb->n_threads,group_task,&br);
+ if (br.failed) return(0);
+ for (int w=0; w<rb->n_threads; w++)
+ {
+  rb->expanded+=rb->workers[w].expanded;
+  rb->trees+=rb->workers[w].trees;
+ }
+ if (!want_paths) return(1);
+
+ // Gather the workers' routes into one buffer
+ total=0;
+ for (int w=0; w<rb->n_threads; w++)
+ {
+  rb->workers[w].base=total;
+  total+=rb->workers[w].used;
+ }
+ if (total>rb->paths_capacity)
+ {
+  unsigned char *p=(unsigned char *)realloc(rb->paths,(size_t)total);
+  if (p==NULL) return(0);
+  rb->paths=p;
+  rb->paths_capacity=total;
+ }
+ for (int w=0; w<rb->n_threads; w++)
+  if (rb->workers[w].used>0) memcpy(rb->paths+rb->workers[w].base,rb->workers[w].paths,(size_t)rb->workers[w].used);
+ for (k=0; k<n_queries; k++)
+  if (res[k].offset>=0) res[k].offset+=rb->workers[rb->worker_of[k]].base;
+ return(1);
+}
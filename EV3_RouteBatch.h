@@ -0,0 +1,87 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Batched route queries.
+
+ A dispatcher scoring assignments of robots to jobs asks for the cost of every (robot,
+ job) pair - thousands of routes from a state (intersection, heading) to a target
+ intersection, but only a few distinct targets. Answering them one plan_route() at a
+ time repeats nearly the same search for every robot sent to the same place.
+
+ route_batch() groups the queries by target (a counting sort over intersections) and
+ runs one backward search per target - routes_to_states() in EV3_Planner.h, a Dijkstra
+ from the target that stops as soon as every start state of its group is settled. The
+ search leaves the first action of a cheapest route for each settled state, so the cost
+ and route of every query in the group are read off that one tree. Groups are split over
+ threads with run_parallel(), one route_planner and one next-action buffer per worker;
+ routes are costed the same way as plan_route() (equal costs, the routes may differ
+ where several tie).
+
+ The shared tree only pays when a group is dense: A* with route_heuristic() expands
+ little more than the states along the route, while the backward search settles every
+ state as close to the target as the farthest start. Each group is therefore sized up
+ first (shared_tree_pays()), and one with few or widely spread starts is answered with
+ one plan_route() per query instead, on the same worker.
+
+ Results come back in query order in a flat array: cost and number of actions, and - if
+ paths were asked for - the offset of the route's MOVE_* actions in rb->paths, one buffer
+ for the whole batch owned by struct route_batch (valid until the next call). Workers
+ collect routes in their own buffers, which are copied into rb->paths at the end.
+
+ bench_batch in EV3_Benchmarks compares this with one plan_route() per query on random
+ maps. With 5000 queries over 5 targets on a 100x100 map (1000 per target) the batch
+ takes about 40ms against 90ms, and 50000 queries over 5 targets on 200x200 take 0.2s
+ against 2.2s; with 50 or more targets the groups fall back to A* and the two run level.
+
+*/
+
+#ifndef __route_batch_header
+#define __route_batch_header
+
+#include "EV3_Planner.h"
+#include "EV3_Threads.h"
+
+struct route_query{
+ int start;                 // State idx*4+d
+ int target;                // Intersection
+};
+
+struct route_result{
+ double cost;               // Cost of a cheapest route, -1 if there is none
+ int len;                   // Number of actions, -1 if there is no route
+ long offset;               // Its actions start at rb->paths[offset] (-1 without paths)
+};
+
+struct batch_worker{
+ struct route_planner rp;
+ unsigned char *next;       // Next actions toward the current target, 2 bits per state
+ unsigned char *paths;      // Routes found by this worker
+ long used, capacity;
+ long base;                 // Where they go in rb->paths
+ long expanded;             // States expanded by this worker's searches
+ long trees;                // Groups it answered from a shared search
+};
+
+struct route_batch{
+ int n;                     // Number of intersections the buffers are sized for
+ int n_threads;
+ struct batch_worker *workers;
+ int *count;                // Queries per target, then the first query of each target's group
+ int *order;                // Query indices sorted by target
+ int *starts;               // Their start states, in the same order
+ int *group;                // First position in order[] of each group, and one past the end
+ int *worker_of;            // Worker that found each query's route
+ int max_queries;           // Size of order[], starts[], group[] and worker_of[]
+ unsigned char *paths;      // All routes of the last batch
+ long paths_capacity;
+ long groups;               // Groups (distinct targets) in the last batch...
+ long trees;                // ... those answered from one shared search...
+ long expanded;             // ... and states expanded for all of them
+};
+
+int alloc_route_batch(struct route_batch *rb, const struct route_costs *c, int n_threads);
+void free_route_batch(struct route_batch *rb);
+int route_batch(struct route_batch *rb, const struct route_query *q, int n_queries, struct route_result *res, int want_paths);
+
+#endif
@@ -0,0 +1,195 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ All-pairs next-action table - see EV3_RouteTable.h
+
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "EV3_RouteTable.h"
+
+struct table_build{
+ struct route_table *rt;
+ struct route_planner *workers;
+ int failed;
+};
+
+static void table_task(int task, int worker, void *arg)
+{
+ // Row of the table for target intersection task
+ struct table_build *tb=(struct table_build *)arg;
+
+ if (routes_to_target(&tb->workers[worker],task,tb->rt->next+((size_t)task*tb->rt->n))==0) tb->failed=1;
+}
+
+int build_route_table(struct route_table *rt, const struct route_costs *c, int n_threads)
+{
+ // Builds the table for the current map with the given costs. n_threads 0 uses
+ // default_threads(). Returns 1 on success, 0 if the map is too large or out of memory.
+ struct table_build tb;
+ int w;
+
+ memset(rt,0,sizeof(struct route_table));
+ if (sx*sy>ROUTE_TABLE_MAX_INTERSECTIONS) return(0);
+ if (n_threads<=0) n_threads=default_threads();
+ rt->n=sx*sy;
+ rt->cost=*c;
+ rt->next=(unsigned char *)malloc((size_t)rt->n*rt->n);
+ tb.rt=rt;
+ tb.failed=0;
+ tb.workers=(struct route_planner *)calloc(n_threads,sizeof(struct route_planner));
+ if (rt->next==NULL||tb.workers==NULL)
+ {
+  free(tb.workers);
+  free_route_table(rt);
+  return(0);
+ }
+ for (w=0; w<n_threads; w++)
+  if (alloc_route_planner(&tb.workers[w],c)==0) break;
+ if (w==n_threads) run_parallel(rt->n,n_threads,table_task,&tb);
+ else tb.failed=1;
+ for (int k=0; k<n_threads; k++)
+  free_route_planner(&tb.workers[k]);
+ free(tb.workers);
+ if (tb.failed)
+ {
+  free_route_table(rt);
+  return(0);
+ }
+ return(1);
+}
+
+void free_route_table(struct route_table *rt)
+{
+ if (rt->mapped!=NULL) munmap(rt->mapped,rt->mapped_size);
+ else free(rt->next);
+ memset(rt,0,sizeof(struct route_table));
+}
+
+int route_table_walk(const struct route_table *rt, int start, int target, unsigned char *actions, int max_actions, double *cost)
+{
+ // Same result as plan_route() (a cheapest route, though not necessarily the same one
+ // when several tie), read off the table. Returns the number of actions, or -1 if the
+ // route is longer than max_actions or the table does not fit the current map.
+ int s=start, len=0, a;
+ double c=0;
+
+ if (rt->next==NULL||rt->n!=sx*sy||start<0||start>=rt->n*4||target<0||target>=rt->n) return(-1);
+ while (s/4!=target)
+ {
+  // A cheapest route never visits a state twice, so it is at most 4n long
+  if (len>=max_actions||len>=rt->n*4) return(-1);
+  a=route_table_action(rt,s,target);
+  if (a==MOVE_FORWARD)
+  {
+   if (map_nbr[s]<0) return(-1);
+   s=(map_nbr[s]*4)+(s&3);
+   c+=rt->cost.forward;
+  }
+  else
+  {
+   s=move_state(s,a);
+   c+=(a==MOVE_UTURN)?rt->cost.uturn:rt->cost.turn;
+  }
+  actions[len++]=(unsigned char)a;
+ }
+ if (cost!=NULL) *cost=c;
+ return(len);
+}
+
+int load_route_table(struct route_table *rt, const char *mapname, const struct route_costs *c)
+{
+ // Maps the stored table for the current map (map_hash, see load_map_cache()) if there is
+ // one built with the same costs. Returns 1 on success, 0 otherwise.
+ char path[1024];
+ struct stat st;
+ struct rtab_header *hdr;
+ unsigned char *data;
+ unsigned long long n;
+ int fd;
+
+ memset(rt,0,sizeof(struct route_table));
+ if (map_hash==0) return(0);
+ map_cache_path(mapname,"rtab",&path[0],1024);
+ fd=open(&path[0],O_RDONLY);
+ if (fd<0) return(0);
+ if (fstat(fd,&st)!=0||(size_t)st.st_size<sizeof(struct rtab_header))
+ {
+  close(fd);
+  return(0);
+ }
+ data=(unsigned char *)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+ close(fd);
+ if (data==MAP_FAILED) return(0);
+
+ hdr=(struct rtab_header *)data;
+ n=(unsigned long long)sx*sy;
+ if (strncmp(&hdr->magic[0],RTAB_MAGIC,8)!=0||hdr->version!=RTAB_VERSION||
+     hdr->header_size!=sizeof(struct rtab_header)||hdr->file_size!=(unsigned long long)st.st_size||
+     hdr->map_hash!=map_hash||hdr->sx!=sx||hdr->sy!=sy||
+     hdr->cost.forward!=c->forward||hdr->cost.turn!=c->turn||hdr->cost.uturn!=c->uturn||
+     hdr->table_offset+(n*n)>hdr->file_size)
+ {
+  fprintf(stderr,"Route table %s is stale or invalid, rebuilding it\n",&path[0]);
+  munmap(data,st.st_size);
+  return(0);
+ }
+ rt->n=(int)n;
+ rt->cost=*c;
+ rt->next=data+hdr->table_offset;
+ rt->mapped=data;
+ rt->mapped_size=st.st_size;
+ return(1);
+}
+
+int save_route_table(const struct route_table *rt, const char *mapname)
+{
+ // Writes the table next to the map image (under a temporary name, then renamed into
+ // place like save_map_cache()). Returns 1 on success, 0 otherwise.
+ char path[1024], tmp_path[1100];
+ static const unsigned char pad[CMAP_ALIGN]={0};
+ struct rtab_header hdr;
+ unsigned long long n, size;
+ FILE *f;
+ int ok;
+
+ if (rt->next==NULL||rt->n!=sx*sy) return(0);
+ if (map_hash==0&&hash_map_file(mapname,&map_hash,&size)==0) return(0);
+
+ n=(unsigned long long)rt->n;
+ memset(&hdr,0,sizeof(struct rtab_header));
+ strncpy(&hdr.magic[0],RTAB_MAGIC,8);
+ hdr.version=RTAB_VERSION;
+ hdr.header_size=sizeof(struct rtab_header);
+ hdr.map_hash=map_hash;
+ hdr.sx=sx;
+ hdr.sy=sy;
+ hdr.cost=rt->cost;
+ hdr.table_offset=((sizeof(struct rtab_header)+CMAP_ALIGN-1)/CMAP_ALIGN)*CMAP_ALIGN;
+ hdr.file_size=hdr.table_offset+(n*n);
+
+ map_cache_path(mapname,"rtab",&path[0],1024);
+ snprintf(&tmp_path[0],1100,"%s.tmp%d",&path[0],(int)getpid());
+ f=fopen(&tmp_path[0],"wb");
+ if (f==NULL)
+ {
+  fprintf(stderr,"Unable to write route table %s\n",&path[0]);
+  return(0);
+ }
+ ok=(fwrite(&hdr,sizeof(struct rtab_header),1,f)==1);
+ if (hdr.table_offset>sizeof(struct rtab_header))
+  ok=ok&&(fwrite(&pad[0],hdr.table_offset-sizeof(struct rtab_header),1,f)==1);
+ ok=ok&&(fwrite(rt->next,n*n,1,f)==1);
+ if (fclose(f)!=0) ok=0;
+ if (!ok||rename(&tmp_path[0],&path[0])!=0)
+ {
+  fprintf(stderr,"Unable to write route table %s\n",&path[0]);
+  remove(&tmp_path[0]);
+  return(0);
+ }
+ return(1);
+}
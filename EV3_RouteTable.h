@@ -0,0 +1,78 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ All-pairs next-action table.
+
+ When the robot is sent to many targets on the same map, searching for every route is
+ wasted work - the answer for a given (state, target) pair never changes. struct
+ route_table stores, for every target intersection and every state (intersection,
+ heading), the first MOVE_* action of a cheapest route under the given struct
+ route_costs (EV3_Planner.h). A route is then read off by following the table:
+
+     while the robot is not at target:  a = table[target][state], state = a applied to state
+
+ which is O(path length) with no search at all (route_table_walk()).
+
+ Layout: four actions of 2 bits fit in one byte, one byte per (target, intersection) -
+ the action for state s toward target t is bits 2*(s&3) of next[(t*n)+(s/4)]. The table
+ takes n*n bytes for n intersections, so it is only built for maps of up to
+ ROUTE_TABLE_MAX_INTERSECTIONS (a 64x64 map needs 16MB); go_to_target() plans with A*
+ on anything larger.
+
+ build_route_table() runs one backward Dijkstra per target (routes_to_target() in
+ EV3_Planner.h) - targets are independent, so they are split over threads with
+ run_parallel(), one route_planner of scratch space per worker.
+
+ The table is stored next to the map image like the compiled map (EV3_MapCache.h):
+
+    Map1.ppm  -->  Map1.ppm.rtab
+
+ with map_hash and the route costs in its header, so a table for an edited map or for
+ different costs is ignored and rebuilt. On a hit the file is mmap()ed and used in place.
+
+*/
+
+#ifndef __route_table_header
+#define __route_table_header
+
+#include "EV3_Planner.h"
+#include "EV3_MapCache.h"
+#include "EV3_Threads.h"
+
+#define RTAB_MAGIC "EV3RTAB"
+#define RTAB_VERSION 1
+#define ROUTE_TABLE_MAX_INTERSECTIONS 4096
+
+struct rtab_header{
+ char magic[8];                     // RTAB_MAGIC, zero padded
+ unsigned int version;              // RTAB_VERSION
+ unsigned int header_size;          // sizeof(struct rtab_header)
+ unsigned long long map_hash;       // map_hash of the map the table was built for
+ int sx, sy;
+ struct route_costs cost;
+ unsigned long long table_offset;   // unsigned char[n*n]
+ unsigned long long file_size;
+};
+
+struct route_table{
+ int n;                     // Number of intersections
+ struct route_costs cost;
+ unsigned char *next;       // next[(t*n)+(s/4)] - actions toward target t, 2 bits per state s
+ void *mapped;              // Set if next points into a mapped table file
+ size_t mapped_size;
+};
+
+int build_route_table(struct route_table *rt, const struct route_costs *c, int n_threads);
+void free_route_table(struct route_table *rt);
+int load_route_table(struct route_table *rt, const char *mapname, const struct route_costs *c);
+int save_route_table(const struct route_table *rt, const char *mapname);
+int route_table_walk(const struct route_table *rt, int start, int target, unsigned char *actions, int max_actions, double *cost);
+
+// First action of a cheapest route from state toward intersection target
+static inline int route_table_action(const struct route_table *rt, int state, int target)
+{
+ return((rt->next[((size_t)target*rt->n)+(state/4)]>>(2*(state&3)))&3);
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Calibrated sensor model - see EV3_SensorModel.h
+
+*/
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <math.h>
+#include "EV3_SensorModel.h"
+
+void init_sensor_model(struct sensor_model *sm, double misread)
+{
+ // No calibration counts - the confusion matrix is the default model
+ memset(sm->counts,0,sizeof(sm->counts));
+ sm->misread=misread;
+ estimate_sensor_model(sm);
+}
+
+void sensor_model_add(struct sensor_model *sm, int building_colour, int reading)
+{
+ // One calibration reading over a building of the given indexed colour (2 - Blue,
+ // 3 - Green, 6 - White). Call estimate_sensor_model() once all readings are in.
+ if (reading<0||reading>=SENSOR_N_READINGS) return;
+ sm->counts[colour_code(building_colour)][reading]++;
+}
+
+void estimate_sensor_model(struct sensor_model *sm)
+{
+ // Confusion matrix from the calibration counts, smoothed toward the default model
+ for (int t=0; t<3; t++)
+ {
+  double total=SENSOR_PRIOR_COUNT;
+  for (int r=0; r<3; r++)
+   sm->confusion[t][r]=SENSOR_PRIOR_COUNT*((r==t)?(1.0-sm->misread):(sm->misread/2.0));
+  for (int c=0; c<SENSOR_N_READINGS; c++)
+  {
+   sm->confusion[t][colour_code(c)]+=sm->counts[t][c];
+   total+=sm->counts[t][c];
+  }
+  for (int r=0; r<3; r++)
+   sm->confusion[t][r]/=total;
+ }
+ build_likelihood_table(sm);
+}
+
+void build_likelihood_table(struct sensor_model *sm)
+{
+ // like[z][s] for every pair of signatures - each is a product of four confusion entries
+ for (int z=0; z<N_SIGNATURES; z++)
+  for (int s=0; s<N_SIGNATURES; s++)
+  {
+   double l=1.0;
+   for (int k=0, zk=z, sk=s; k<4; k++, zk/=3, sk/=3)
+    l*=sm->confusion[sk%3][zk%3];
+   sm->like[z][s]=l;
+  }
+}
+
+int load_sensor_model(struct sensor_model *sm, const char *filename)
+{
+ // Reads calibration counts saved by save_sensor_model() and builds the model from them,
+ // smoothed toward the default misread rate. Returns 1 on success, 0 if the file is
+ // missing or not a calibration file (sm is left unchanged).
+ struct sensor_model tmp;
+ char magic[16];
+ int version;
+ FILE *f;
+
+ f=fopen(filename,"r");
+ if (f==NULL) return(0);
+ if (fscanf(f,"%15s %d",magic,&version)!=2||strcmp(magic,SENSOR_MAGIC)!=0||version!=SENSOR_VERSION)
+ {
+  fprintf(stderr,"load_sensor_model(): %s is not a sensor calibration file\n",filename);
+  fclose(f);
+  return(0);
+ }
+ for (int t=0; t<3; t++)
+  for (int c=0; c<SENSOR_N_READINGS; c++)
+   if (fscanf(f,"%ld",&tmp.counts[t][c])!=1||tmp.counts[t][c]<0)
+   {
+    fprintf(stderr,"load_sensor_model(): %s is truncated or corrupted\n",filename);
+    fclose(f);
+    return(0);
+   }
+ fclose(f);
+ memcpy(sm->counts,tmp.counts,sizeof(sm->counts));
+ sm->misread=BUILDING_MISREAD_PROB;
+ estimate_sensor_model(sm);
+ return(1);
+}
+
+int save_sensor_model(const struct sensor_model *sm, const char *filename)
+{
+ // Writes the calibration counts. Returns 1 on success, 0 on failure.
+ FILE *f;
+
+ f=fopen(filename,"w");
+ if (f==NULL)
+ {
+  fprintf(stderr,"save_sensor_model(): Unable to create %s\n",filename);
+  return(0);
+ }
+ fprintf(f,"%s %d\n",SENSOR_MAGIC,SENSOR_VERSION);
+ for (int t=0; t<3; t++)
+ {
+  for (int c=0; c<SENSOR_N_READINGS; c++)
+   fprintf(f,"%ld%c",sm->counts[t][c],(c==SENSOR_N_READINGS-1)?'\n':' ');
+ }
+ if (fclose(f)!=0)
+ {
+  fprintf(stderr,"save_sensor_model(): Error writing %s\n",filename);
+  return(0);
+ }
+ return(1);
+}
+
+#if defined(__AVX2__)
+static inline __m256d log2_pd(__m256d x)
+{
+ // log2(x) for x>0, see log2_ps() in EV3_Beliefs.c - same method, series up to t^11. The
+ // exponent field is turned into a double by placing it in the mantissa of 2^52.
+ const __m256d one=_mm256_set1_pd(1.0);
+ __m256i bits=_mm256_castpd_si256(x);
+ __m256d e=_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits,52),_mm256_set1_epi64x(0x4330000000000000LL))),
+                         _mm256_set1_pd(4503599627370496.0+1023.0));
+ __m256d m=_mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits,_mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)),_mm256_set1_epi64x(0x3FF0000000000000LL)));
+ __m256d big=_mm256_cmp_pd(m,_mm256_set1_pd(1.4142135623730951),_CMP_GT_OQ);
+ m=_mm256_blendv_pd(m,_mm256_mul_pd(m,_mm256_set1_pd(0.5)),big);
+ e=_mm256_add_pd(e,_mm256_and_pd(big,one));
+ __m256d t=_mm256_div_pd(_mm256_sub_pd(m,one),_mm256_add_pd(m,one));
+ __m256d t2=_mm256_mul_pd(t,t);
+ __m256d poly=_mm256_add_pd(_mm256_mul_pd(t2,_mm256_set1_pd(0.26230818925253880)),_mm256_set1_pd(0.32059889797532520));
+ poly=_mm256_add_pd(_mm256_mul_pd(t2,poly),_mm256_set1_pd(0.41219858311113240));
+ poly=_mm256_add_pd(_mm256_mul_pd(t2,poly),_mm256_set1_pd(0.57707801635558534));
+ poly=_mm256_add_pd(_mm256_mul_pd(t2,poly),_mm256_set1_pd(0.96179669392597560));
+ poly=_mm256_add_pd(_mm256_mul_pd(t2,poly),_mm256_set1_pd(2.88539008177792680));
+ return(_mm256_add_pd(_mm256_mul_pd(t,poly),e));
+}
+
+static inline __m256d table_row_gather(const double *row, const unsigned char *sig)
+{
+ // row[sig[0..3]]
+ int v;
+ memcpy(&v,sig,4);
+ return(_mm256_mask_i32gather_pd(_mm256_setzero_pd(),row,_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)),
+                                 _mm256_castsi256_pd(_mm256_set1_epi64x(-1)),8));
+}
+#endif
+
+static double table_multiply(double *p, int cnt, const double *row)
+{
+ // p[s]*=row[map_sig[s]], returns the sum of the updated values
+ double sum=0;
+ int s=0;
+
+#if defined(__AVX2__)
+ {
+  __m256d acc0=_mm256_setzero_pd(), acc1=_mm256_setzero_pd();
+  double lanes[4];
+  for (; s+8<=cnt; s+=8)
+  {
+   __m256d p0=_mm256_mul_pd(_mm256_loadu_pd(p+s),table_row_gather(row,map_sig+s));
+   __m256d p1=_mm256_mul_pd(_mm256_loadu_pd(p+s+4),table_row_gather(row,map_sig+s+4));
+   _mm256_storeu_pd(p+s,p0);
+   _mm256_storeu_pd(p+s+4,p1);
+   acc0=_mm256_add_pd(acc0,p0);
+   acc1=_mm256_add_pd(acc1,p1);
+  }
+  _mm256_storeu_pd(&lanes[0],_mm256_add_pd(acc0,acc1));
+  sum=(lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+ }
+#endif
+ for (; s<cnt; s++)
+ {
+  p[s]*=row[map_sig[s]];
+  sum+=p[s];
+ }
+ return(sum);
+}
+
+static double table_multiply_stats(double *p, int cnt, const double *row, double *plogp, double *m1, int *i1, double *m2, int *i2)
+{
+ // table_multiply() that also accumulates p*log2(p) and keeps the two largest updated
+ // values - per lane in the AVX2 loop, merged at the end
+ double sum=0;
+ int s=0;
+
+#if defined(__AVX2__)
+ {
+  __m256d acc=_mm256_setzero_pd(), accl=_mm256_setzero_pd();
+  __m256d bm1=_mm256_set1_pd(-1.0), bm2=_mm256_set1_pd(-1.0);
+  __m256d bi1=_mm256_set1_pd(-1.0), bi2=_mm256_set1_pd(-1.0);       // States, as doubles
+  __m256d idx=_mm256_setr_pd(0,1,2,3);
+  double lanes[4], lm1[4], lm2[4], li1[4], li2[4];
+  for (; s+4<=cnt; s+=4)
+  {
+   __m256d p0=_mm256_mul_pd(_mm256_loadu_pd(p+s),table_row_gather(row,map_sig+s));
+   __m256d gt1=_mm256_cmp_pd(p0,bm1,_CMP_GT_OQ), gt2=_mm256_cmp_pd(p0,bm2,_CMP_GT_OQ);
+   _mm256_storeu_pd(p+s,p0);
+   acc=_mm256_add_pd(acc,p0);
+   accl=_mm256_add_pd(accl,_mm256_mul_pd(p0,log2_pd(p0)));
+   // New runner-up: the old best if p0 beats it, else p0 if it beats the old runner-up
+   bm2=_mm256_blendv_pd(_mm256_blendv_pd(bm2,p0,gt2),bm1,gt1);
+   bi2=_mm256_blendv_pd(_mm256_blendv_pd(bi2,idx,gt2),bi1,gt1);
+   bm1=_mm256_blendv_pd(bm1,p0,gt1);
+   bi1=_mm256_blendv_pd(bi1,idx,gt1);
+   idx=_mm256_add_pd(idx,_mm256_set1_pd(4.0));
+  }
+  _mm256_storeu_pd(&lanes[0],acc);
+  sum=(lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+  _mm256_storeu_pd(&lanes[0],accl);
+  *plogp+=(lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+  _mm256_storeu_pd(&lm1[0],bm1);
+  _mm256_storeu_pd(&lm2[0],bm2);
+  _mm256_storeu_pd(&li1[0],bi1);
+  _mm256_storeu_pd(&li2[0],bi2);
+  for (int k=0; k<4; k++)
+  {
+   if (li1[k]>=0) top2_insert(lm1[k],(int)li1[k],m1,i1,m2,i2);
+   if (li2[k]>=0) top2_insert(lm2[k],(int)li2[k],m1,i1,m2,i2);
+  }
+ }
+#endif
+ for (; s<cnt; s++)
+ {
+  p[s]*=row[map_sig[s]];
+  sum+=p[s];
+  if (p[s]>0) *plogp+=p[s]*log2(p[s]);
+  if (p[s]>=*m2) top2_insert(p[s],s,m1,i1,m2,i2);
+ }
+ return(sum);
+}
+
+void update_beliefs_table(double (*b)[4], int n, double *scale, int sig, const struct sensor_model *sm, struct belief_stats *st)
+{
+ // Measurement update for a scan with signature sig: every state is multiplied by
+ // like[sig][map_sig[state]]. The normalization goes into *scale. If st is not NULL the
+ // belief statistics are collected in the same pass (see EV3_Beliefs.h).
+ double sum, plogp=0, m1=-1, m2=-1;
+ int i1=-1, i2=-1;
+
+ if (sig<0||sig>=N_SIGNATURES) return;
+ if (st==NULL) sum=table_multiply(&b[0][0],n*4,sm->like[sig]);
+ else sum=table_multiply_stats(&b[0][0],n*4,sm->like[sig],&plogp,&m1,&i1,&m2,&i2);
+ if (!(sum>0))
+ {
+  init_beliefs(b,n,scale);
+  if (st!=NULL) finish_belief_stats(st,n,0,0,-1,-1,-1,-1);
+  return;
+ }
+ if (st!=NULL) finish_belief_stats(st,n,sum,plogp,m1,i1,m2,i2);
+ *scale=1.0/sum;
+ if (*scale<BELIEF_FOLD_LIMIT||*scale>1.0/BELIEF_FOLD_LIMIT) fold_belief_scale(b,n,scale);
+}
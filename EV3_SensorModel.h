@@ -0,0 +1,68 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Calibrated sensor model for scan updates.
+
+ The colour sensor does not misread all colours alike - under a given light, blue may be
+ read as green far more often than white is read as anything. struct sensor_model keeps
+ a confusion matrix
+
+     confusion[t][r] = P(building read as code r | building has code t)
+
+ over the three building codes of colour_code() (0 - Blue, 1 - Green, 2 - White). It is
+ estimated from calibration counts - how often each EV3 indexed colour (0-7) was read
+ over a building of each kind - collected by calibrate_sensor() and saved to
+ SENSOR_CALIBRATION_FILE. Readings that are neither blue nor green count as white, the
+ same way scan_signature() treats them. The counts are smoothed with SENSOR_PRIOR_COUNT
+ pseudo-readings per building code, spread according to the default model (each building
+ misread as one of the two other colours with probability misread/2), so a short
+ calibration can not produce zero probabilities.
+
+ The buildings of a scan are read independently, so the likelihood of scan signature z
+ at a state whose map signature is s is the product of four confusion entries. There are
+ only 81 x 81 (z, s) pairs, so they are all precomputed:
+
+     like[z][s] = prod over k of confusion[code k of s][code k of z]
+
+ and update_beliefs_table() costs one lookup in the 81-entry row like[z] per state,
+ indexed by map_sig[], with no per-building work. On AVX2 builds four states are done
+ per gather. It can also collect the belief statistics (best, runner-up, entropy) in the
+ same pass, see EV3_Beliefs.h.
+
+ Calibration file format (text):
+
+     EV3SENSOR 1
+     <8 counts for blue buildings>
+     <8 counts for green buildings>
+     <8 counts for white (no building)>
+
+*/
+
+#ifndef __sensor_model_header
+#define __sensor_model_header
+
+#include "EV3_Beliefs.h"
+
+#define SENSOR_CALIBRATION_FILE "EV3_sensor.cal"
+#define SENSOR_MAGIC "EV3SENSOR"
+#define SENSOR_VERSION 1
+#define SENSOR_N_READINGS 8         // EV3 indexed colours 0 (unknown) to 7 (brown)
+#define SENSOR_PRIOR_COUNT 10.0     // Pseudo-readings per building code mixed into the calibration counts
+
+struct sensor_model{
+ long counts[3][SENSOR_N_READINGS];         // counts[t][c] - readings of colour c over buildings with code t
+ double misread;                            // Default model the counts are smoothed toward
+ double confusion[3][3];                    // confusion[t][r] - P(read code r | true code t)
+ double like[N_SIGNATURES][N_SIGNATURES];   // like[z][s] - P(scan signature z | map signature s)
+};
+
+void init_sensor_model(struct sensor_model *sm, double misread);
+void sensor_model_add(struct sensor_model *sm, int building_colour, int reading);
+void estimate_sensor_model(struct sensor_model *sm);
+void build_likelihood_table(struct sensor_model *sm);
+int load_sensor_model(struct sensor_model *sm, const char *filename);
+int save_sensor_model(const struct sensor_model *sm, const char *filename);
+void update_beliefs_table(double (*b)[4], int n, double *scale, int sig, const struct sensor_model *sm, struct belief_stats *st);
+
+#endif
@@ -0,0 +1,287 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Adaptive dense/sparse beliefs - see EV3_SparseBeliefs.h
+
+*/
+
+#include <math.h>
+#include "EV3_SparseBeliefs.h"
+
+int alloc_adaptive_belief(struct adaptive_belief *ab, int n, int k)
+{
+ // Returns 1 on success, 0 if out of memory
+ if (k>n*4) k=n*4;
+ ab->n=n;
+ ab->sp.k=k;
+ ab->sp.hash_size=1;
+ while (ab->sp.hash_size<2*k) ab->sp.hash_size*=2;
+ ab->dense=(double (*)[4])calloc(n,sizeof(double[4]));
+ ab->sp.state=(int *)calloc(k,sizeof(int));
+ ab->sp.p=(double *)calloc(k,sizeof(double));
+ ab->sp.hash=(int *)calloc(ab->sp.hash_size,sizeof(int));
+ ab->sp.next=(struct sparse_entry *)calloc((size_t)SPARSE_FANOUT*k,sizeof(struct sparse_entry));
+ if (ab->dense==NULL||ab->sp.state==NULL||ab->sp.p==NULL||ab->sp.hash==NULL||ab->sp.next==NULL)
+ {
+  free_adaptive_belief(ab);
+  return(0);
+ }
+ ab->enter_entropy=SPARSE_ENTER_ENTROPY;
+ ab->leave_mass=SPARSE_LEAVE_MASS;
+ init_adaptive_belief(ab);
+ return(1);
+}
+
+void free_adaptive_belief(struct adaptive_belief *ab)
+{
+ free(ab->dense);
+ free(ab->sp.state);
+ free(ab->sp.p);
+ free(ab->sp.hash);
+ free(ab->sp.next);
+ ab->dense=NULL;
+ ab->sp.state=NULL;
+ ab->sp.p=NULL;
+ ab->sp.hash=NULL;
+ ab->sp.next=NULL;
+}
+
+void init_adaptive_belief(struct adaptive_belief *ab)
+{
+ ab->sparse=0;
+ ab->sp.count=0;
+ ab->sp.elsewhere=0;
+ init_beliefs(ab->dense,ab->n,&ab->scale);
+}
+
+double belief_entropy(double (*b)[4], int n, double scale)
+{
+ // Entropy in bits of the (lazily scaled) beliefs
+ double *p=&b[0][0];
+ double h=0, q;
+
+ for (int s=0; s<n*4; s++)
+ {
+  q=p[s]*scale;
+  if (q>0) h-=q*log2(q);
+ }
+ return(h);
+}
+
+static inline unsigned int hash_state(int state, int size)
+{
+ return(((unsigned int)state*2654435761u)&(unsigned int)(size-1));
+}
+
+void rebuild_sparse_hash(struct sparse_belief *sp)
+{
+ // Rebuilds the state -> entry hash after the list has changed (linear probing)
+ unsigned int h;
+
+ for (int i=0; i<sp->hash_size; i++)
+  sp->hash[i]=-1;
+ for (int e=0; e<sp->count; e++)
+ {
+  h=hash_state(sp->state[e],sp->hash_size);
+  while (sp->hash[h]>=0) h=(h+1)&(sp->hash_size-1);
+  sp->hash[h]=e;
+ }
+}
+
+static int find_entry(struct sparse_belief *sp, int state)
+{
+ unsigned int h=hash_state(state,sp->hash_size);
+
+ while (sp->hash[h]>=0)
+ {
+  if (sp->state[sp->hash[h]]==state) return(sp->hash[h]);
+  h=(h+1)&(sp->hash_size-1);
+ }
+ return(-1);
+}
+
+static void heap_sift_down(int *st, double *p, int count, int i)
+{
+ // Min-heap on p[], st[] carries the state ids along
+ int c, ts;
+ double tp;
+
+ while ((c=(2*i)+1)<count)
+ {
+  if (c+1<count&&p[c+1]<p[c]) c++;
+  if (p[i]<=p[c]) break;
+  tp=p[i]; p[i]=p[c]; p[c]=tp;
+  ts=st[i]; st[i]=st[c]; st[c]=ts;
+  i=c;
+ }
+}
+
+int top_states(double (*b)[4], int n, double scale, int k, int *state, double *p)
+{
+ // The k most likely states of a (lazily scaled) dense belief, in no particular order,
+ // selected with a size-k min-heap over all states in O(n log k). Returns how many were
+ // written (k, unless there are fewer states).
+ double *v=&b[0][0];
+ double q;
+ int count=0;
+
+ for (int s=0; s<n*4; s++)
+ {
+  q=v[s]*scale;
+  if (count<k)
+  {
+   state[count]=s;
+   p[count]=q;
+   count++;
+   if (count==k)
+    for (int i=(k/2)-1; i>=0; i--) heap_sift_down(state,p,count,i);
+  }
+  else if (q>p[0])
+  {
+   state[0]=s;
+   p[0]=q;
+   heap_sift_down(state,p,count,0);
+  }
+ }
+ return(count);
+}
+
+void make_sparse(struct adaptive_belief *ab)
+{
+ // Keeps the K most likely states, everything else becomes the uniform residual
+ struct sparse_belief *sp=&ab->sp;
+ double kept=0;
+
+ sp->count=top_states(ab->dense,ab->n,ab->scale,sp->k,sp->state,sp->p);
+ for (int e=0; e<sp->count; e++)
+  kept+=sp->p[e];
+ sp->elsewhere=(kept<1.0)?1.0-kept:0;
+ rebuild_sparse_hash(sp);
+ ab->sparse=1;
+}
+
+void make_dense(struct adaptive_belief *ab)
+{
+ // Rebuilds the dense array - listed states exactly, the residual spread uniformly
+ struct sparse_belief *sp=&ab->sp;
+ double *b=&ab->dense[0][0];
+ int others=(ab->n*4)-sp->count;
+ double u=(others>0)?sp->elsewhere/(double)others:0;
+
+ for (int s=0; s<ab->n*4; s++)
+  b[s]=u;
+ for (int e=0; e<sp->count; e++)
+  b[sp->state[e]]=sp->p[e];
+ ab->scale=1.0;
+ fold_belief_scale(ab->dense,ab->n,&ab->scale);
+ ab->sparse=0;
+}
+
+static void update_sparse(struct adaptive_belief *ab, int sig, double p_match)
+{
+ // O(K) measurement update. The residual states are assumed uniform, so their average
+ // likelihood follows from how many of them agree with the scan.
+ struct sparse_belief *sp=&ab->sp;
+ double p_miss=(1.0-p_match)/(double)(N_SIGNATURES-1);
+ int listed_matches=0, total_matches, others;
+ double f, z;
+
+ total_matches=map_sig_start[sig+1]-map_sig_start[sig];
+ z=0;
+ for (int e=0; e<sp->count; e++)
+ {
+  if (map_sig[sp->state[e]]==sig)
+  {
+   sp->p[e]*=p_match;
+   listed_matches++;
+  }
+  else sp->p[e]*=p_miss;
+  z+=sp->p[e];
+ }
+ others=(ab->n*4)-sp->count;
+ f=(others>0)?(double)(total_matches-listed_matches)/(double)others:0;
+ sp->elsewhere*=(p_match*f)+(p_miss*(1.0-f));
+ z+=sp->elsewhere;
+ if (z<=0)
+ {
+  init_adaptive_belief(ab);
+  return;
+ }
+ for (int e=0; e<sp->count; e++)
+  sp->p[e]/=z;
+ sp->elsewhere/=z;
+}
+
+static double match_max(struct adaptive_belief *ab, int sig)
+{
+ // Largest probability among the states that agree with scan sig. The entropy is at
+ // least -log2 of the largest probability, and after a scan that is almost always one of
+ // these states, so this O(matches) test saves the O(n) entropy pass on most updates.
+ double *p=&ab->dense[0][0];
+ double mx=0;
+
+ for (int k=map_sig_start[sig]; k<map_sig_start[sig+1]; k++)
+  if (p[map_sig_states[k]]>mx) mx=p[map_sig_states[k]];
+ return(mx*ab->scale);
+}
+
+void update_adaptive_belief(struct adaptive_belief *ab, int sig, double p_match)
+{
+ // Measurement update for a scan with signature sig, switching representation as needed
+ if (sig<0||sig>=N_SIGNATURES) return;
+ if (ab->sparse)
+ {
+  update_sparse(ab,sig,p_match);
+  if (ab->sparse&&ab->sp.elsewhere>ab->leave_mass) make_dense(ab);
+ }
+ else
+ {
+  update_beliefs_indexed(ab->dense,ab->n,&ab->scale,sig,p_match);
+  if (match_max(ab,sig)<exp2(-ab->enter_entropy)) return;
+  if (belief_entropy(ab->dense,ab->n,ab->scale)<ab->enter_entropy)
+  {
+   make_sparse(ab);
+   if (ab->sp.elsewhere>ab->leave_mass) ab->sparse=0;      // Too much mass outside the top K
+  }
+ }
+}
+
+double adaptive_belief_prob(struct adaptive_belief *ab, int state)
+{
+ // Probability of one state, in either representation
+ int e;
+
+ if (!ab->sparse) return((&ab->dense[0][0])[state]*ab->scale);
+ e=find_entry(&ab->sp,state);
+ if (e>=0) return(ab->sp.p[e]);
+ return(ab->sp.elsewhere/(double)((ab->n*4)-ab->sp.count));
+}
+
+double adaptive_belief_best(struct adaptive_belief *ab, int *state)
+{
+ // Most likely state and its probability
+ double best=-1, q;
+
+ *state=0;
+ if (ab->sparse)
+ {
+  for (int e=0; e<ab->sp.count; e++)
+   if (ab->sp.p[e]>best)
+   {
+    best=ab->sp.p[e];
+    *state=ab->sp.state[e];
+   }
+  return(best);
+ }
+ for (int s=0; s<ab->n*4; s++)
+ {
+  q=(&ab->dense[0][0])[s];
+  if (q>best)
+  {
+   best=q;
+   *state=s;
+  }
+ }
+ return(best*ab->scale);
+}
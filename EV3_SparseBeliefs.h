@@ -0,0 +1,77 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Adaptive dense/sparse beliefs.
+
+ After a few scans nearly all of the probability sits on a handful of (intersection,
+ direction) states, but a dense update still visits all 4*sx*sy of them. struct
+ adaptive_belief starts out dense (beliefs[][] layout with the lazy scale from
+ EV3_Beliefs.h) and, once the entropy of the distribution drops below enter_entropy bits,
+ switches to a sparse representation:
+
+  * the K most likely states, selected with a size-K min-heap, with their probabilities
+    and an open-addressing hash from state to entry for O(1) lookups
+  * a residual 'elsewhere' mass, spread uniformly over all the other states
+
+ A sparse measurement update costs O(K): each listed state gets its own likelihood, and
+ the residual gets the average likelihood of the unlisted states, which the signature
+ index gives directly (matches for the scan overall, minus the listed matches). The O(n)
+ entropy test is only run once the best matching state is above 2^-enter_entropy. When the
+ residual mass grows above leave_mass the distribution has spread again, and the dense
+ array is rebuilt from the list plus the uniform residual.
+
+ States are numbered (idx*4)+d throughout, as in map_sig[] and map_sig_states[].
+
+*/
+
+#ifndef __sparse_beliefs_header
+#define __sparse_beliefs_header
+
+#include "EV3_Beliefs.h"
+
+#define SPARSE_TOP_K 64             // Default number of states tracked in sparse mode
+#define SPARSE_ENTER_ENTROPY 4.0    // Switch to sparse below this entropy (bits)
+#define SPARSE_LEAVE_MASS 0.05      // Switch back to dense when this much mass is 'elsewhere'
+
+#define SPARSE_FANOUT 4             // Most outcomes a single state can have in one prediction step
+
+struct sparse_entry{
+ int state;
+ double p;
+};
+
+struct sparse_belief{
+ int k;                     // Capacity
+ int count;                 // Entries in use
+ int *state;                // state[e] - state id of entry e
+ double *p;                 // p[e] - probability of entry e
+ int hash_size;             // Power of two, >= 2k
+ int *hash;                 // State id -> entry, -1 for empty slots
+ double elsewhere;          // Mass spread uniformly over all unlisted states
+ struct sparse_entry *next; // Scratch for prediction, SPARSE_FANOUT*k entries
+};
+
+struct adaptive_belief{
+ int n;                     // Number of intersections
+ int sparse;                // 1 while in sparse mode
+ double (*dense)[4];        // Dense beliefs (valid in dense mode)
+ double scale;              // Lazy scale for dense[][]
+ struct sparse_belief sp;
+ double enter_entropy;      // Thresholds, default SPARSE_ENTER_ENTROPY / SPARSE_LEAVE_MASS
+ double leave_mass;
+};
+
+int alloc_adaptive_belief(struct adaptive_belief *ab, int n, int k);
+void free_adaptive_belief(struct adaptive_belief *ab);
+void init_adaptive_belief(struct adaptive_belief *ab);
+void update_adaptive_belief(struct adaptive_belief *ab, int sig, double p_match);
+double adaptive_belief_prob(struct adaptive_belief *ab, int state);
+double adaptive_belief_best(struct adaptive_belief *ab, int *state);
+double belief_entropy(double (*b)[4], int n, double scale);
+int top_states(double (*b)[4], int n, double scale, int k, int *state, double *p);
+void make_sparse(struct adaptive_belief *ab);
+void make_dense(struct adaptive_belief *ab);
+void rebuild_sparse_hash(struct sparse_belief *sp);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Minimal parallel-for - see EV3_Threads.h
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "EV3_Threads.h"
+
+struct parallel_job{
+ parallel_task fn;
+ void *arg;
+ int n_tasks;
+ int next;                  // Next unclaimed task, advanced atomically
+};
+
+struct parallel_worker{
+ struct parallel_job *job;
+ int worker;
+};
+
+int default_threads(void)
+{
+ // Number of online cores, can be overridden with the EV3_THREADS environment variable
+ char *env;
+ long n;
+
+ env=getenv("EV3_THREADS");
+ if (env!=NULL&&atoi(env)>0) return(atoi(env));
+ n=sysconf(_SC_NPROCESSORS_ONLN);
+ return(n>0?(int)n:1);
+}
+
+static void *worker_loop(void *p)
+{
+ struct parallel_worker *w=(struct parallel_worker *)p;
+ int task;
+
+ while ((task=__sync_fetch_and_add(&w->job->next,1))<w->job->n_tasks)
+  w->job->fn(task,w->worker,w->job->arg);
+ return(NULL);
+}
+
+int run_parallel(int n_tasks, int n_threads, parallel_task fn, void *arg)
+{
+ // Runs fn() over tasks 0..n_tasks-1 on n_threads threads (n_threads<=0 selects
+ // default_threads()). Returns the number of threads actually used.
+ struct parallel_job job;
+ struct parallel_worker *workers;
+ pthread_t *threads;
+ int started;
+
+ if (n_threads<=0) n_threads=default_threads();
+ if (n_threads>n_tasks) n_threads=n_tasks;
+ if (n_threads<1) n_threads=1;
+
+ job.fn=fn;
+ job.arg=arg;
+ job.n_tasks=n_tasks;
+ job.next=0;
+
+ workers=(struct parallel_worker *)calloc(n_threads,sizeof(struct parallel_worker));
+ threads=(pthread_t *)calloc(n_threads,sizeof(pthread_t));
+ if (workers==NULL||threads==NULL) n_threads=1;     // Out of memory, run inline instead
+
+ started=1;
+ for (int i=1; i<n_threads; i++)
+ {
+  workers[i].job=&job;
+  workers[i].worker=i;
+  if (pthread_create(&threads[i],NULL,worker_loop,&workers[i])!=0) break;
+  started++;
+ }
+
+ // The calling thread is worker 0
+ {
+  struct parallel_worker self;
+  self.job=&job;
+  self.worker=0;
+  worker_loop(&self);
+ }
+
+ for (int i=1; i<started; i++)
+  pthread_join(threads[i],NULL);
+ free(workers);
+ free(threads);
+ return(started);
+}
@@ -0,0 +1,27 @@
+/*
+
+  CSC C85 - Embedded Systems - Project # 1 - EV3 Robot Localization
+
+ Minimal parallel-for on top of pthreads, shared by the parts of the code that split
+ work over large maps (tiled parsing, belief updates, planning, offline tools).
+
+ run_parallel() starts n_threads workers which repeatedly claim the next task index
+ from a shared atomic counter and call fn(task, worker, arg) until all n_tasks tasks
+ are done. Tasks should be coarse (a tile, a block of states, a target) so that the
+ claiming overhead is negligible. The worker index (0..n_threads-1) lets a task use
+ per-thread scratch space without locking. The calling thread acts as worker 0, so
+ run_parallel() with n_threads=1 runs everything inline with no thread creation.
+
+*/
+
+#ifndef __threads_header
+#define __threads_header
+
+#include <pthread.h>
+
+typedef void (*parallel_task)(int task, int worker, void *arg);
+
+int default_threads(void);
+int run_parallel(int n_tasks, int n_threads, parallel_task fn, void *arg);
+
+#endif
@@ -1 +1 @@
-g++ EV3_Localization.c ./EV3_RobotControl/btcomm.c -lbluetooth
+g++ -O2 -march=native EV3_Localization.c EV3_Map.c EV3_MapCache.c EV3_Threads.c EV3_Beliefs.c EV3_SensorModel.c EV3_Monitor.c EV3_LogBeliefs.c EV3_SparseBeliefs.c EV3_Motion.c EV3_Particles.c EV3_Explore.c EV3_Planner.c EV3_RouteTable.c EV3_DStar.c EV3_QMDP.c EV3_CostModel.c EV3_Executor.c EV3_Ambiguity.c ./EV3_RobotControl/btcomm.c -lbluetooth -pthread